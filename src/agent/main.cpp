@@ -0,0 +1,122 @@
+#include <csignal>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <mavsdk/mavsdk.h>
+#include <mavsdk/plugins/mavlink_passthrough/mavlink_passthrough.h>
+
+#include "../link_agent.hpp"
+
+using namespace RASATestingSuite;
+
+namespace {
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void printUsage() {
+    std::cout << "Usage: ras_a_link_agent CONNECTION_URL [NAME] [SYSTEM_ID]\n"
+              << "  Connects to the vehicle once and keeps the link open, so that test runs started\n"
+              << "  with agent://NAME (default name: default) skip connecting and discovery.\n"
+              << "  SYSTEM_ID is the system id of the autopilot to share (default 1), as in the test configs.\n";
+}
+
+std::shared_ptr<mavsdk::System> waitForAutopilot(mavsdk::Mavsdk& mavsdk, uint8_t system_id) {
+    std::cout << "Waiting to discover system " << static_cast<int>(system_id) << "...\n";
+    auto prom = std::promise<std::shared_ptr<mavsdk::System>>{};
+    auto fut = prom.get_future();
+    std::once_flag found;
+    auto check_systems = [&mavsdk, &prom, &found, system_id]() {
+        for (auto &system : mavsdk.systems()) {
+            if (system->get_system_id() == system_id && system->has_autopilot()) {
+                std::call_once(found, [&prom, &system]() { prom.set_value(system); });
+                return;
+            }
+        }
+    };
+    mavsdk.subscribe_on_new_system(check_systems);
+    // the system may have been discovered before subscribing
+    check_systems();
+    // the agent is started once, so it can wait longer for the vehicle to boot
+    while (fut.wait_for(std::chrono::seconds(1)) == std::future_status::timeout) {
+        if (stop_requested != 0) {
+            mavsdk.subscribe_on_new_system(nullptr);
+            return {};
+        }
+    }
+    mavsdk.subscribe_on_new_system(nullptr);
+    return fut.get();
+}
+
+};  // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    const std::string name = argc > 2 ? argv[2] : "default";
+    int system_id = 1;
+    if (argc > 3) {
+        try {
+            system_id = std::stoi(argv[3]);
+        } catch (std::logic_error&) {
+            system_id = -1;
+        }
+        if (system_id < 1 || system_id > 255) {
+            std::cerr << "Invalid system id " << argv[3] << '\n';
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::signal(SIGINT, [](int) { stop_requested = 1; });
+    std::signal(SIGTERM, [](int) { stop_requested = 1; });
+
+    mavsdk::Mavsdk mavsdk;
+    auto configuration = mavsdk::Mavsdk::Configuration(mavsdk::Mavsdk::Configuration::UsageType::GroundStation);
+    configuration.set_system_id(255);
+    mavsdk.set_configuration(configuration);
+    mavsdk::ConnectionResult connection_result = mavsdk.add_any_connection(argv[1]);
+    if (connection_result != mavsdk::ConnectionResult::Success) {
+        std::cerr << "Connection failed: " << connection_result << '\n';
+        return 1;
+    }
+    auto system = waitForAutopilot(mavsdk, static_cast<uint8_t>(system_id));
+    if (!system) {
+        return 1;
+    }
+    auto passthrough = std::make_shared<mavsdk::MavlinkPassthrough>(system);
+
+    std::unique_ptr<LinkAgent> agent;
+    try {
+        auto ring = ShmRing::create(name, passthrough->get_our_sysid(), passthrough->get_our_compid());
+        ring->setCapabilities(system->get_autopilot_version_data().capabilities);
+        agent = std::make_unique<LinkAgent>(std::move(ring), [&passthrough](mavlink_message_t &message) {
+            passthrough->send_message(message);
+        });
+    } catch (AgentError& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    passthrough->intercept_incoming_messages_async([&agent](mavlink_message_t &message) {
+        agent->publish(message, ShmRing::nowNs());
+        return true;
+    });
+    std::cout << "Agent " << name << " ready, run the suite with agent://" << name << "\n";
+
+    while (stop_requested == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    passthrough->intercept_incoming_messages_async(nullptr);
+    agent = nullptr;
+    std::cout << "Agent " << name << " stopped\n";
+    return 0;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "shm_ring.hpp"
+#include "transport.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * Transport through a connection agent (ras_a_link_agent) that owns the vehicle link. Sends
+ * with the ids of the agent, or with its own component id so that the acknowledgements of
+ * processes sharing the agent can be told apart.
+ */
+class AgentTransport : public Transport {
+private:
+    std::unique_ptr<ShmRing> _ring;
+    const uint8_t _component_id;  // 0 for the one of the agent
+    TimedMessageCallback _incoming;
+    MessageCallback _outgoing;
+    std::mutex _incoming_mutex;
+    std::mutex _outgoing_mutex;
+    std::atomic<bool> _running{true};
+    std::thread _reader_thread;
+
+    void readLoop() {
+        auto reader = _ring->reader();
+        mavlink_message_t message;
+        int64_t arrival_ns;
+        while (_running) {
+            if (!reader.read(message, arrival_ns)) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            // called without the lock, so a handler can send a reply
+            TimedMessageCallback incoming;
+            {
+                std::scoped_lock lock(_incoming_mutex);
+                incoming = _incoming;
+            }
+            if (incoming) {
+                // the agent stamps the arrival on the link with the same steady clock
+                incoming(message, std::chrono::steady_clock::time_point(std::chrono::nanoseconds(arrival_ns)));
+            }
+        }
+    }
+
+public:
+    AgentTransport(std::unique_ptr<ShmRing> ring, uint8_t component_id = 0) :
+          _ring(std::move(ring)), _component_id(component_id) {
+        _reader_thread = std::thread([this]() { readLoop(); });
+    }
+
+    void send(mavlink_message_t &message) override {
+        _ring->send(message);
+        MessageCallback outgoing;
+        {
+            std::scoped_lock lock(_outgoing_mutex);
+            outgoing = _outgoing;
+        }
+        if (outgoing) {
+            outgoing(message);
+        }
+    }
+
+    uint8_t ourSystemId() const override {
+        return _ring->ourSystemId();
+    }
+
+    uint8_t ourComponentId() const override {
+        return _component_id != 0 ? _component_id : _ring->ourComponentId();
+    }
+
+    void subscribeIncoming(MessageCallback callback) override {
+        if (!callback) {
+            subscribeIncomingTimed(nullptr);
+            return;
+        }
+        subscribeIncomingTimed([callback](mavlink_message_t &message, std::chrono::steady_clock::time_point) {
+            callback(message);
+        });
+    }
+
+    void subscribeIncomingTimed(TimedMessageCallback callback) override {
+        std::scoped_lock lock(_incoming_mutex);
+        _incoming = std::move(callback);
+    }
+
+    void subscribeOutgoing(MessageCallback callback) override {
+        std::scoped_lock lock(_outgoing_mutex);
+        _outgoing = std::move(callback);
+    }
+
+    uint64_t capabilities() const {
+        return _ring->capabilities();
+    }
+
+    ~AgentTransport() override {
+        _running = false;
+        _reader_thread.join();
+    }
+};
+
+};
@@ -0,0 +1,252 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "passthrough_tester.hpp"
+#include "source_timing.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * How a message is split into columns: the names of its numeric fields and a function writing
+ * their values of one message into a row.
+ */
+struct CaptureLayout {
+    std::vector<std::string> fields;
+    std::function<void(const mavlink_message_t&, double*)> decode;
+};
+
+template<int MSG>
+struct CaptureField {
+    const char* name;
+    double (*get)(const typename msg_helper<MSG>::decode_type&);
+};
+
+#define CAPTURE_FIELD(MESSAGE_SHORT_UC, FIELD) \
+    CaptureField<MESSAGE_SHORT_UC>{#FIELD, [](const msg_helper<MESSAGE_SHORT_UC>::decode_type &m) { \
+        return static_cast<double>(m.FIELD); }}
+
+template<int MSG>
+CaptureLayout captureLayout(std::vector<CaptureField<MSG>> fields) {
+    CaptureLayout layout;
+    for (const auto &field : fields) {
+        layout.fields.push_back(field.name);
+    }
+    layout.decode = [fields](const mavlink_message_t &message, double* row) {
+        typename msg_helper<MSG>::decode_type decoded;
+        msg_helper<MSG>::unpack(&message, &decoded);
+        for (size_t i = 0; i < fields.size(); i++) {
+            row[i] = fields[i].get(decoded);
+        }
+    };
+    return layout;
+}
+
+/**
+ * The messages that can be captured, by id, with the fields that are stored. The layouts are
+ * written by hand, so only these messages can be captured; a new one needs an entry here.
+ */
+inline const std::map<int, CaptureLayout>& captureLayouts() {
+    static const std::map<int, CaptureLayout> layouts = {
+        {ATTITUDE, captureLayout<ATTITUDE>({
+            CAPTURE_FIELD(ATTITUDE, time_boot_ms), CAPTURE_FIELD(ATTITUDE, roll), CAPTURE_FIELD(ATTITUDE, pitch),
+            CAPTURE_FIELD(ATTITUDE, yaw), CAPTURE_FIELD(ATTITUDE, rollspeed), CAPTURE_FIELD(ATTITUDE, pitchspeed),
+            CAPTURE_FIELD(ATTITUDE, yawspeed)})},
+        {GLOBAL_POSITION_INT, captureLayout<GLOBAL_POSITION_INT>({
+            CAPTURE_FIELD(GLOBAL_POSITION_INT, time_boot_ms), CAPTURE_FIELD(GLOBAL_POSITION_INT, lat),
+            CAPTURE_FIELD(GLOBAL_POSITION_INT, lon), CAPTURE_FIELD(GLOBAL_POSITION_INT, alt),
+            CAPTURE_FIELD(GLOBAL_POSITION_INT, relative_alt), CAPTURE_FIELD(GLOBAL_POSITION_INT, vx),
+            CAPTURE_FIELD(GLOBAL_POSITION_INT, vy), CAPTURE_FIELD(GLOBAL_POSITION_INT, vz),
+            CAPTURE_FIELD(GLOBAL_POSITION_INT, hdg)})},
+        {ALTITUDE, captureLayout<ALTITUDE>({
+            CAPTURE_FIELD(ALTITUDE, time_usec), CAPTURE_FIELD(ALTITUDE, altitude_monotonic),
+            CAPTURE_FIELD(ALTITUDE, altitude_amsl), CAPTURE_FIELD(ALTITUDE, altitude_local),
+            CAPTURE_FIELD(ALTITUDE, altitude_relative), CAPTURE_FIELD(ALTITUDE, altitude_terrain),
+            CAPTURE_FIELD(ALTITUDE, bottom_clearance)})},
+        {LOCAL_POSITION_NED, captureLayout<LOCAL_POSITION_NED>({
+            CAPTURE_FIELD(LOCAL_POSITION_NED, time_boot_ms), CAPTURE_FIELD(LOCAL_POSITION_NED, x),
+            CAPTURE_FIELD(LOCAL_POSITION_NED, y), CAPTURE_FIELD(LOCAL_POSITION_NED, z),
+            CAPTURE_FIELD(LOCAL_POSITION_NED, vx), CAPTURE_FIELD(LOCAL_POSITION_NED, vy),
+            CAPTURE_FIELD(LOCAL_POSITION_NED, vz)})},
+        {VFR_HUD, captureLayout<VFR_HUD>({
+            CAPTURE_FIELD(VFR_HUD, airspeed), CAPTURE_FIELD(VFR_HUD, groundspeed), CAPTURE_FIELD(VFR_HUD, heading),
+            CAPTURE_FIELD(VFR_HUD, throttle), CAPTURE_FIELD(VFR_HUD, alt), CAPTURE_FIELD(VFR_HUD, climb)})},
+        {SYS_STATUS, captureLayout<SYS_STATUS>({
+            CAPTURE_FIELD(SYS_STATUS, load), CAPTURE_FIELD(SYS_STATUS, voltage_battery),
+            CAPTURE_FIELD(SYS_STATUS, current_battery), CAPTURE_FIELD(SYS_STATUS, battery_remaining),
+            CAPTURE_FIELD(SYS_STATUS, drop_rate_comm), CAPTURE_FIELD(SYS_STATUS, errors_comm)})},
+        {GPS_RAW_INT, captureLayout<GPS_RAW_INT>({
+            CAPTURE_FIELD(GPS_RAW_INT, time_usec), CAPTURE_FIELD(GPS_RAW_INT, fix_type),
+            CAPTURE_FIELD(GPS_RAW_INT, lat), CAPTURE_FIELD(GPS_RAW_INT, lon), CAPTURE_FIELD(GPS_RAW_INT, alt),
+            CAPTURE_FIELD(GPS_RAW_INT, eph), CAPTURE_FIELD(GPS_RAW_INT, epv), CAPTURE_FIELD(GPS_RAW_INT, vel),
+            CAPTURE_FIELD(GPS_RAW_INT, satellites_visible)})},
+        {BATTERY_STATUS, captureLayout<BATTERY_STATUS>({
+            CAPTURE_FIELD(BATTERY_STATUS, temperature), CAPTURE_FIELD(BATTERY_STATUS, current_battery),
+            CAPTURE_FIELD(BATTERY_STATUS, current_consumed), CAPTURE_FIELD(BATTERY_STATUS, energy_consumed),
+            CAPTURE_FIELD(BATTERY_STATUS, battery_remaining)})},
+    };
+    return layouts;
+}
+
+/**
+ * Samples of one message type in structure-of-arrays form: one contiguous column per field, and
+ * a time column in seconds, from the source timestamp if the message has one and from the
+ * arrival otherwise.
+ */
+struct CapturedStream {
+    std::string message_name;
+    std::vector<std::string> fields;
+    std::vector<double> time_s;
+    std::vector<std::vector<double>> columns;
+
+    size_t size() const {
+        return time_s.size();
+    }
+
+    // nullptr if the message has no such field
+    const std::vector<double>* column(const std::string &field) const {
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (fields[i] == field) {
+                return &columns[i];
+            }
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * Captures the last max_samples messages of the selected types from one component, from start()
+ * until stop(). Columns grow to twice the window before the older half is dropped, so adding a
+ * sample stays cheap and the columns stay contiguous.
+ */
+class CaptureStore {
+private:
+    struct Capture {
+        const CaptureLayout* layout;
+        CapturedStream stream;
+        std::vector<double> row;
+    };
+
+    const std::shared_ptr<PassthroughTester> _tester;
+    const uint8_t _system_id;
+    const uint8_t _component_id;
+    const size_t _max_samples;
+    std::map<int, Capture> _captures;
+    std::mutex _mutex;
+    int _listener_id = -1;
+    const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+
+    void add(Capture &capture, const mavlink_message_t &message, std::chrono::steady_clock::time_point arrival) {
+        CapturedStream &stream = capture.stream;
+        if (stream.size() >= 2 * _max_samples) {
+            stream.time_s.erase(stream.time_s.begin(), stream.time_s.begin() + _max_samples);
+            for (auto &column : stream.columns) {
+                column.erase(column.begin(), column.begin() + _max_samples);
+            }
+        }
+        uint64_t source_us = 0;
+        if (SourceTimingTracker::sourceTimeUs(message, source_us)) {
+            stream.time_s.push_back(static_cast<double>(source_us) / 1e6);
+        } else {
+            stream.time_s.push_back(std::chrono::duration<double>(arrival - _start).count());
+        }
+        capture.layout->decode(message, capture.row.data());
+        for (size_t i = 0; i < stream.columns.size(); i++) {
+            stream.columns[i].push_back(capture.row[i]);
+        }
+    }
+
+public:
+    CaptureStore(std::shared_ptr<PassthroughTester> tester, const TestTargetAddress &source, size_t max_samples) :
+          _tester(std::move(tester)), _system_id(source.system_id), _component_id(source.component_id),
+          _max_samples(max_samples) {}
+
+    ~CaptureStore() {
+        stop();
+    }
+
+    CaptureStore(const CaptureStore&) = delete;
+    CaptureStore& operator=(const CaptureStore&) = delete;
+
+    /**
+     * Selects a message type by name, throws std::invalid_argument naming the messages that can be
+     * captured if it has no layout in captureLayouts().
+     */
+    void capture(const std::string &message_name) {
+        const int message_id = messageIdByName(message_name);
+        auto layout = captureLayouts().find(message_id);
+        if (layout == captureLayouts().end()) {
+            std::string supported;
+            for (const auto &message : messageIdsByName()) {
+                if (captureLayouts().count(message.second) > 0) {
+                    supported += (supported.empty() ? "" : ", ") + message.first;
+                }
+            }
+            throw std::invalid_argument((message_id < 0 ? "Unknown message " : "No capture layout for message ") +
+                                        message_name + ", can capture " + supported);
+        }
+        std::scoped_lock lock(_mutex);
+        Capture &capture = _captures[message_id];
+        capture.layout = &layout->second;
+        capture.stream.message_name = message_name;
+        capture.stream.fields = layout->second.fields;
+        capture.stream.columns.assign(layout->second.fields.size(), {});
+        capture.row.assign(layout->second.fields.size(), 0.);
+        for (auto &column : capture.stream.columns) {
+            column.reserve(2 * _max_samples);
+        }
+        capture.stream.time_s.reserve(2 * _max_samples);
+    }
+
+    void start() {
+        if (_listener_id >= 0) {
+            return;
+        }
+        _listener_id = _tester->addListener([this](const mavlink_message_t &message,
+                                                   PassthroughTester::Clock::time_point arrival) {
+            if (message.sysid != _system_id || message.compid != _component_id) {
+                return;
+            }
+            std::scoped_lock lock(_mutex);
+            auto capture = _captures.find(message.msgid);
+            if (capture != _captures.end()) {
+                add(capture->second, message, arrival);
+            }
+        });
+    }
+
+    void stop() {
+        if (_listener_id >= 0) {
+            _tester->removeListener(_listener_id);
+            _listener_id = -1;
+        }
+    }
+
+    /**
+     * The last max_samples of the message, empty if it was not captured.
+     */
+    CapturedStream stream(const std::string &message_name) {
+        std::scoped_lock lock(_mutex);
+        auto capture = _captures.find(messageIdByName(message_name));
+        if (capture == _captures.end()) {
+            return {};
+        }
+        CapturedStream window = capture->second.stream;
+        if (window.size() > _max_samples) {
+            const size_t excess = window.size() - _max_samples;
+            window.time_s.erase(window.time_s.begin(), window.time_s.begin() + excess);
+            for (auto &column : window.columns) {
+                column.erase(column.begin(), column.begin() + excess);
+            }
+        }
+        return window;
+    }
+};
+
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include "statistics.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * Offset and skew of the vehicle clock against the host clock, from TIMESYNC round trips. Each
+ * round trip gives the vehicle time at the middle between sending and receiving; round trips
+ * much slower than the fastest one so far were queued somewhere and are dropped. A line through
+ * the offsets over host time gives the offset now and the skew, which includes the speed of a
+ * simulation. Host times are steady clock milliseconds.
+ */
+class ClockSync {
+private:
+    static constexpr uint64_t MIN_SAMPLES = 3;
+    static constexpr double MAX_RTT_FACTOR = 2.;
+    static constexpr double RTT_TOLERANCE_MS = 2.;
+
+    Trend _offset_ms;  // vehicle minus host time, over host time
+    double _min_rtt_ms = std::numeric_limits<double>::infinity();
+    uint64_t _rejected = 0;
+    mutable std::mutex _mutex;
+
+public:
+    static double hostMs(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration<double, std::milli>(time.time_since_epoch()).count();
+    }
+
+    void addSample(double host_send_ms, double vehicle_ms, double host_receive_ms) {
+        const double rtt_ms = host_receive_ms - host_send_ms;
+        if (rtt_ms < 0.) {
+            return;
+        }
+        std::scoped_lock lock(_mutex);
+        if (rtt_ms > std::max(MAX_RTT_FACTOR * _min_rtt_ms, _min_rtt_ms + RTT_TOLERANCE_MS)) {
+            _rejected++;
+            return;
+        }
+        _min_rtt_ms = std::min(_min_rtt_ms, rtt_ms);
+        const double host_middle_ms = (host_send_ms + host_receive_ms) / 2.;
+        _offset_ms.add(host_middle_ms, vehicle_ms - host_middle_ms);
+    }
+
+    bool valid() const {
+        std::scoped_lock lock(_mutex);
+        return _offset_ms.count() >= MIN_SAMPLES;
+    }
+
+    // vehicle minus host time at the host time
+    double offsetMs(double host_ms) const {
+        std::scoped_lock lock(_mutex);
+        return _offset_ms.at(host_ms);
+    }
+
+    // how much faster the vehicle clock runs, e.g. 1e-5 for 10 ppm
+    double skew() const {
+        std::scoped_lock lock(_mutex);
+        return _offset_ms.slope();
+    }
+
+    double minRttMs() const {
+        std::scoped_lock lock(_mutex);
+        return _min_rtt_ms;
+    }
+
+    uint64_t samples() const {
+        std::scoped_lock lock(_mutex);
+        return _offset_ms.count();
+    }
+
+    uint64_t rejected() const {
+        std::scoped_lock lock(_mutex);
+        return _rejected;
+    }
+
+    /**
+     * Host time at which the vehicle clock showed vehicle_ms.
+     */
+    double toHostMs(double vehicle_ms) const {
+        std::scoped_lock lock(_mutex);
+        // vehicle = host + offset(0) + skew * host, solved for host
+        return (vehicle_ms - _offset_ms.at(0.)) / (1. + _offset_ms.slope());
+    }
+};
+
+};
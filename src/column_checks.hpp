@@ -0,0 +1,153 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include "capture_store.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * Outcome of one check over a whole column: how many samples failed it, and the first one.
+ */
+struct ColumnCheckResult {
+    std::string field;
+    std::string check;
+    size_t checked = 0;
+    size_t violations = 0;
+    size_t first_index = 0;
+    double first_value = 0.;
+};
+
+/**
+ * Range, NaN, rate of change and monotonicity checks over the columns of a capture, configured
+ * per field:
+ *
+ *   roll: {min: -3.15, max: 3.15, max_rate: 10, wrap: 6.2832}
+ *   time_boot_ms: {monotonic: strict}
+ *
+ * NaN values fail every check unless allow_nan is set. The loops only count violations, without
+ * branches on the values, so the compiler can vectorize them; the first violation is looked up
+ * only for checks that failed.
+ */
+class ColumnChecks {
+private:
+    static size_t countOutside(const double* values, size_t n, double min, double max) {
+        size_t count = 0;
+        for (size_t i = 0; i < n; i++) {
+            // NaN compares false and is counted
+            count += !(values[i] >= min && values[i] <= max);
+        }
+        return count;
+    }
+
+    static size_t countNan(const double* values, size_t n) {
+        size_t count = 0;
+        for (size_t i = 0; i < n; i++) {
+            count += values[i] != values[i];
+        }
+        return count;
+    }
+
+    static size_t countDecreasing(const double* values, size_t n, bool strict) {
+        size_t count = 0;
+        for (size_t i = 1; i < n; i++) {
+            count += strict ? !(values[i] > values[i - 1]) : !(values[i] >= values[i - 1]);
+        }
+        return count;
+    }
+
+    // changes faster than max_rate per second of the time column
+    static size_t countFastChanges(const double* values, const double* time_s, size_t n, double max_rate) {
+        size_t count = 0;
+        for (size_t i = 1; i < n; i++) {
+            count += std::abs(values[i] - values[i - 1]) > max_rate * (time_s[i] - time_s[i - 1]);
+        }
+        return count;
+    }
+
+    static std::vector<double> unwrapped(const std::vector<double> &values, double period) {
+        std::vector<double> result(values.size());
+        double offset = 0.;
+        for (size_t i = 0; i < values.size(); i++) {
+            if (i > 0) {
+                offset -= period * std::round((values[i] + offset - result[i - 1]) / period);
+            }
+            result[i] = values[i] + offset;
+        }
+        return result;
+    }
+
+    template<typename Failed>
+    static ColumnCheckResult makeResult(const std::string &field, const std::string &check, size_t checked,
+                                        size_t violations, const std::vector<double> &values, Failed failed) {
+        ColumnCheckResult result{field, check, checked, violations, 0, 0.};
+        for (size_t i = 0; violations > 0 && i < values.size(); i++) {
+            if (failed(i)) {
+                result.first_index = i;
+                result.first_value = values[i];
+                break;
+            }
+        }
+        return result;
+    }
+
+public:
+    /**
+     * Runs the checks configured for the fields of the stream. Fields the stream does not have
+     * are reported as a single violation of the check "missing".
+     */
+    static std::vector<ColumnCheckResult> run(const CapturedStream &stream, const YAML::Node &fields) {
+        std::vector<ColumnCheckResult> results;
+        const size_t n = stream.size();
+        for (const auto &entry : fields) {
+            const std::string field = entry.first.as<std::string>();
+            const YAML::Node &checks = entry.second;
+            const std::vector<double>* column = stream.column(field);
+            if (column == nullptr) {
+                results.push_back({field, "missing", 0, 1, 0, 0.});
+                continue;
+            }
+            const std::vector<double> &values = *column;
+            const double* data = values.data();
+
+            if (!checks["allow_nan"].as<bool>(false)) {
+                size_t count = countNan(data, n);
+                results.push_back(makeResult(field, "not NaN", n, count, values, [&](size_t i) {
+                    return std::isnan(values[i]);
+                }));
+            }
+            if (checks["min"] || checks["max"]) {
+                const double min = checks["min"].as<double>(-INFINITY);
+                const double max = checks["max"].as<double>(INFINITY);
+                size_t count = countOutside(data, n, min, max);
+                results.push_back(makeResult(field, "range", n, count, values, [&](size_t i) {
+                    return !(values[i] >= min && values[i] <= max);
+                }));
+            }
+            if (checks["max_rate"] && n > 1) {
+                const double max_rate = checks["max_rate"].as<double>();
+                // angles jumping by a full turn are not a change
+                const std::vector<double> continuous = checks["wrap"] ? unwrapped(values, checks["wrap"].as<double>())
+                                                                      : values;
+                size_t count = countFastChanges(continuous.data(), stream.time_s.data(), n, max_rate);
+                results.push_back(makeResult(field, "rate of change", n - 1, count, values, [&](size_t i) {
+                    return i > 0 && std::abs(continuous[i] - continuous[i - 1]) >
+                                    max_rate * (stream.time_s[i] - stream.time_s[i - 1]);
+                }));
+            }
+            if (checks["monotonic"] && n > 1) {
+                const bool strict = checks["monotonic"].as<std::string>() == "strict";
+                size_t count = countDecreasing(data, n, strict);
+                results.push_back(makeResult(field, strict ? "increasing" : "non-decreasing", n - 1, count, values,
+                                             [&](size_t i) {
+                    return i > 0 && (strict ? !(values[i] > values[i - 1]) : !(values[i] >= values[i - 1]));
+                }));
+            }
+        }
+        return results;
+    }
+};
+
+};
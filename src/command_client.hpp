@@ -0,0 +1,188 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "passthrough_tester.hpp"
+#include "statistics.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * Outcome of a command: the final MAV_RESULT, how many times it was sent, the progress reported
+ * with MAV_RESULT_IN_PROGRESS, and the times to the first COMMAND_ACK and to the final one.
+ */
+struct CommandResult {
+    uint16_t command = 0;
+    uint8_t result = 0;
+    int32_t result_param2 = 0;
+    uint8_t progress = 0;
+    int transmissions = 0;
+    int in_progress_updates = 0;
+    double first_ack_ms = 0.;
+    double total_ms = 0.;
+
+    int retries() const {
+        return transmissions - 1;
+    }
+};
+
+/**
+ * Totals over all commands sent with a CommandClient during the run.
+ */
+struct CommandTotals {
+    uint64_t commands = 0;
+    uint64_t retransmissions = 0;
+    uint64_t in_progress = 0;
+    uint64_t unanswered = 0;
+    RunningStats total_ms;
+};
+
+/**
+ * Sends commands the way the MAVLink command protocol recovers from lost messages: a command
+ * without COMMAND_ACK is sent again with the confirmation field incremented, after the default
+ * receive timeout (which follows the measured round trip time), doubled with every attempt.
+ * COMMAND_ACKs are matched by command id. Once the component answers MAV_RESULT_IN_PROGRESS, the
+ * command is not sent again; the progress updates are passed to the progress callback until the
+ * final result arrives. COMMAND_INT has no confirmation field and is sent again unchanged.
+ * COMMAND_ACKs of the command still queued from earlier are dropped before sending it, and after
+ * a retransmission the acks of the other attempts are awaited, so that they are not taken as the
+ * answer to the next command.
+ */
+class CommandClient {
+public:
+    using Progress = std::function<void(const CommandResult&)>;
+
+    static constexpr int DEFAULT_MAX_ATTEMPTS = 5;
+    static constexpr double MAX_BACKOFF = 8.;
+    // vehicle time between two MAV_RESULT_IN_PROGRESS updates before the command counts as lost
+    static constexpr uint32_t DEFAULT_PROGRESS_TIMEOUT_MS = 30000;
+
+private:
+    const std::shared_ptr<PassthroughTester> _link;
+    const int _max_attempts;
+    const uint32_t _progress_timeout_ms;
+    Progress _on_progress;
+
+    static std::mutex& totalsMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static CommandTotals& mutableTotals() {
+        static CommandTotals totals;
+        return totals;
+    }
+
+    static void count(const CommandResult &result, bool answered) {
+        std::scoped_lock lock(totalsMutex());
+        CommandTotals &totals = mutableTotals();
+        totals.commands++;
+        totals.retransmissions += result.retries();
+        totals.in_progress += result.in_progress_updates > 0;
+        if (answered) {
+            totals.total_ms.add(result.total_ms);
+        } else {
+            totals.unanswered++;
+        }
+    }
+
+    template<typename Send>
+    CommandResult run(const TestTargetAddress &target, uint16_t command, Send send_attempt) {
+        using Clock = std::chrono::steady_clock;
+        const auto since = [start = Clock::now()]() {
+            return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        };
+        const auto is_ack = [command](const auto &ack) {
+            return ack.command == command;
+        };
+        CommandResult result;
+        result.command = command;
+        mavlink_command_ack_t ack;
+        _link->flushIf<COMMAND_ACK>(target, is_ack);
+        double backoff = 1.;
+        for (int attempt = 0;; attempt++) {
+            send_attempt(static_cast<uint8_t>(std::min(attempt, 255)));
+            result.transmissions++;
+            try {
+                backoff = std::min(MAX_BACKOFF, std::pow(2., attempt));
+                ack = _link->receiveIfBackingOff<COMMAND_ACK>(target, backoff, is_ack);
+                break;
+            } catch (TimeoutError&) {
+                if (result.transmissions >= _max_attempts) {
+                    count(result, false);
+                    throw TimeoutError("No COMMAND_ACK for command " + std::to_string(command) + " after " +
+                                       std::to_string(result.transmissions) + " attempts");
+                }
+            }
+        }
+        result.first_ack_ms = since();
+        while (ack.result == MAV_RESULT_IN_PROGRESS) {
+            result.in_progress_updates++;
+            result.progress = ack.progress;
+            if (_on_progress) {
+                _on_progress(result);
+            }
+            try {
+                ack = _link->receiveIf<COMMAND_ACK>(target, _progress_timeout_ms, is_ack);
+            } catch (TimeoutError&) {
+                count(result, false);
+                throw TimeoutError("Command " + std::to_string(command) + " stuck in progress at " +
+                                   std::to_string(result.progress) + "%");
+            }
+        }
+        result.result = ack.result;
+        result.result_param2 = ack.result_param2;
+        result.total_ms = since();
+        count(result, true);
+        for (int duplicate = 1; duplicate < result.transmissions; duplicate++) {
+            try {
+                _link->receiveIfBackingOff<COMMAND_ACK>(target, backoff, is_ack);
+            } catch (TimeoutError&) {
+                break;
+            }
+        }
+        return result;
+    }
+
+public:
+    explicit CommandClient(std::shared_ptr<PassthroughTester> link, int max_attempts = DEFAULT_MAX_ATTEMPTS,
+                           uint32_t progress_timeout_ms = DEFAULT_PROGRESS_TIMEOUT_MS) :
+          _link(std::move(link)), _max_attempts(max_attempts), _progress_timeout_ms(progress_timeout_ms) {}
+
+    void onProgress(Progress on_progress) {
+        _on_progress = std::move(on_progress);
+    }
+
+    /**
+     * Sends a COMMAND_LONG and waits for its final result, throws a TimeoutError if there is none.
+     */
+    CommandResult sendLong(const TestTargetAddress &target, uint16_t command, float param1, float param2, float param3,
+                           float param4, float param5, float param6, float param7) {
+        return run(target, command, [&](uint8_t confirmation) {
+            _link->send<COMMAND_LONG>(target, command, confirmation, param1, param2, param3, param4, param5, param6,
+                                      param7);
+        });
+    }
+
+    /**
+     * Sends a COMMAND_INT and waits for its final result, throws a TimeoutError if there is none.
+     */
+    CommandResult sendInt(const TestTargetAddress &target, uint8_t frame, uint16_t command, float param1, float param2,
+                          float param3, float param4, int32_t x, int32_t y, float z) {
+        return run(target, command, [&](uint8_t) {
+            _link->send<COMMAND_INT>(target, frame, command, 0, 0, param1, param2, param3, param4, x, y, z);
+        });
+    }
+
+    static CommandTotals totals() {
+        std::scoped_lock lock(totalsMutex());
+        return mutableTotals();
+    }
+};
+
+};
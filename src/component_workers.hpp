@@ -0,0 +1,148 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace RASATestingSuite {
+
+/**
+ * Runs the tests of additional component configs (camera, gimbal, ...) in worker processes next
+ * to the suite. gtest and the Environment exist once per process, so each component gets its
+ * own process; the workers do not connect themselves but use the suite's connection through
+ * the shared link (see LinkAgent). The workers are forked before the suite starts any thread.
+ * Each worker sends with its own component id, so that it only takes the COMMAND_ACKs of its
+ * own commands, also when it tests the same component as the suite.
+ */
+class ComponentWorkers {
+private:
+    struct Worker {
+        std::string name;
+        std::string config_path;
+        std::filesystem::path log_path;
+        pid_t pid;
+        int exit_code;
+    };
+
+    // MAV_COMP_ID_USER1, the suite keeps the component id of the connection
+    static constexpr int FIRST_COMPONENT_ID = 25;
+
+    const std::string _link_name;
+    std::vector<Worker> _workers;
+    int _component_id = 0;  // of this process if it is a worker
+    bool _waited = false;
+
+public:
+    ComponentWorkers() : _link_name("suite_" + std::to_string(getpid())) {}
+
+    static std::string componentName(const std::string &config_path) {
+        return std::filesystem::path(config_path).stem().string();
+    }
+
+    /**
+     * gtest output file of a component, e.g. xml:results.xml becomes xml:results_ras_a_camera.xml
+     */
+    static std::string componentOutput(const std::string &output, const std::string &component) {
+        if (output.empty()) {
+            return output;
+        }
+        auto colon = output.find(':');
+        const std::string format = output.substr(0, colon);
+        std::filesystem::path path = colon == std::string::npos ? "" : output.substr(colon + 1);
+        if (path.empty() || output.back() == '/') {
+            path /= "test_detail." + format;
+        }
+        path.replace_filename(path.stem().string() + "_" + component + path.extension().string());
+        return format + ":" + path.string();
+    }
+
+    /**
+     * Forks one worker per config. Returns true in a worker, with worker_config set to its
+     * config, and false in the suite process.
+     */
+    bool fork(const std::vector<std::string> &config_paths, std::string &worker_config) {
+        for (const auto &config_path : config_paths) {
+            Worker worker{componentName(config_path), config_path,
+                          std::filesystem::temp_directory_path() / (_link_name + "_" + componentName(config_path) + ".log"),
+                          -1, -1};
+            std::cout.flush();
+            pid_t pid = ::fork();
+            if (pid < 0) {
+                throw std::runtime_error("Could not start worker for " + config_path);
+            }
+            if (pid == 0) {
+                // the suite prints the output once the worker is done, so components do not mix
+                int log = open(worker.log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (log >= 0) {
+                    dup2(log, STDOUT_FILENO);
+                    dup2(log, STDERR_FILENO);
+                    close(log);
+                }
+                _component_id = FIRST_COMPONENT_ID + static_cast<int>(_workers.size());
+                _workers.clear();
+                worker_config = config_path;
+                return true;
+            }
+            worker.pid = pid;
+            _workers.push_back(worker);
+        }
+        return false;
+    }
+
+    bool empty() const {
+        return _workers.empty();
+    }
+
+    const std::string& linkName() const {
+        return _link_name;
+    }
+
+    // the connection of a worker
+    std::string agentUrl() const {
+        return "agent://" + _link_name + "?component_id=" + std::to_string(_component_id);
+    }
+
+    /**
+     * Waits for all workers and prints their output. The shared link has to stay up until then.
+     */
+    void waitAll() {
+        if (_waited) {
+            return;
+        }
+        _waited = true;
+        for (auto &worker : _workers) {
+            int status = 0;
+            waitpid(worker.pid, &status, 0);
+            worker.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+            std::cout << "\n========== " << worker.name << " (" << worker.config_path << ") ==========\n";
+            std::ifstream log(worker.log_path);
+            std::cout << log.rdbuf() << std::flush;
+            std::filesystem::remove(worker.log_path);
+        }
+    }
+
+    /**
+     * Prints the result per component and returns the exit code of the whole run.
+     */
+    int summarize(const std::string &suite_config, int suite_exit_code) {
+        waitAll();
+        int exit_code = suite_exit_code;
+        printf("\nComponent results:\n");
+        printf("  %-32s %s\n", componentName(suite_config).c_str(), suite_exit_code == 0 ? "PASSED" : "FAILED");
+        for (const auto &worker : _workers) {
+            printf("  %-32s %s\n", worker.name.c_str(), worker.exit_code == 0 ? "PASSED" : "FAILED");
+            if (worker.exit_code != 0) {
+                exit_code = 1;
+            }
+        }
+        return exit_code;
+    }
+};
+
+};
@@ -7,9 +7,23 @@
 #include <mavsdk/plugins/ftp/ftp.h>
 #include <yaml-cpp/yaml.h>
 #include "gtest/gtest.h"
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <future>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include "agent_transport.hpp"
+#include "command_client.hpp"
+#include "link_agent.hpp"
+#include "multi_link_transport.hpp"
 #include "passthrough_tester.hpp"
+#include "scheduler.hpp"
+#include "sim_speed_estimator.hpp"
+#include "telemetry_streams.hpp"
+#include "test_plan.hpp"
 
 namespace RASATestingSuite {
 
@@ -37,9 +51,12 @@ float floatPack(T o) {
 class Environment : public ::testing::Environment {
 private:
     inline static Environment* _instance;
+    static constexpr const char* AGENT_URL_PREFIX = "agent://";
+    static constexpr const char* AGENT_COMPONENT_QUERY = "?component_id=";
 
     const std::string _connection_url;
     YAML::Node _config;
+    const TestPlan _plan;
     std::shared_ptr<mavsdk::Mavsdk> _mavsdk;
     std::shared_ptr<mavsdk::System> _system;
     std::shared_ptr<mavsdk::MavlinkPassthrough> _mavlinkPassthrough;
@@ -47,46 +64,324 @@ private:
     std::shared_ptr<mavsdk::Ftp> _ftp;
     std::shared_ptr<PassthroughTester> _tester;
 
-    mavsdk::System::AutopilotVersion _autopilotVersionData;
+    // further links to the same vehicle, next to the primary one above
+    struct ExtraLink {
+        std::shared_ptr<mavsdk::Mavsdk> mavsdk;
+        std::shared_ptr<mavsdk::System> system;
+        std::shared_ptr<mavsdk::MavlinkPassthrough> passthrough;
+    };
+    std::vector<ExtraLink> _extra_links;
+    // guards the lazily created plugins and autopilot version
+    std::mutex _plugin_mutex;
+
+    std::optional<mavsdk::System::AutopilotVersion> _autopilotVersionData;
     TestTargetAddress _test_target;
+    static constexpr uint32_t DISCOVERY_TIMEOUT_MS = 3000;
+    // component workers start before the suite has connected
+    static constexpr uint32_t AGENT_ATTACH_TIMEOUT_MS = 10000;
+
+    // set when the connection is shared with component workers
+    std::string _shared_link_name;
+    std::function<void()> _wait_for_link_users;
+    std::unique_ptr<LinkAgent> _link_agent;
+    int _link_agent_listener = -1;
+
+    // durations of the startup phases, printed once the environment is set up
+    std::vector<std::pair<std::string, double>> _startup_phases;
+    std::chrono::steady_clock::time_point _phase_start;
+
+    void endPhase(const std::string &name) {
+        auto now = std::chrono::steady_clock::now();
+        _startup_phases.emplace_back(name, std::chrono::duration<double, std::milli>(now - _phase_start).count());
+        _phase_start = now;
+    }
+
+    // messages sent periodically in the background: PINGs measuring the round trip time for the
+    // default receive timeout, TIMESYNC requests for the clock offset
+    struct LinkProbe {
+        std::chrono::milliseconds interval;
+        std::function<void()> send;
+        std::chrono::steady_clock::time_point next;
+    };
+    std::vector<LinkProbe> _link_probes;
+    std::thread _link_probe_thread;
+    std::mutex _link_probe_mutex;
+    std::condition_variable _link_probe_stop_cv;
+    bool _link_probe_stop = false;
+
+    void addLinkProbe(unsigned interval_ms, std::function<void()> send) {
+        if (interval_ms > 0) {
+            _link_probes.push_back({std::chrono::milliseconds(interval_ms), std::move(send), std::chrono::steady_clock::now()});
+        }
+    }
+
+    void startLinkProbes() {
+        if (_link_probes.empty()) {
+            return;
+        }
+        _link_probe_thread = std::thread([this]() {
+            std::unique_lock lock(_link_probe_mutex);
+            while (!_link_probe_stop) {
+                auto next = std::chrono::steady_clock::time_point::max();
+                for (auto &probe : _link_probes) {
+                    if (probe.next <= std::chrono::steady_clock::now()) {
+                        probe.send();
+                        probe.next += probe.interval;
+                    }
+                    next = std::min(next, probe.next);
+                }
+                _link_probe_stop_cv.wait_until(lock, next);
+            }
+        });
+    }
+
+    // also drops the probes, the next connection (e.g. with --gtest_repeat) registers them again
+    void stopLinkProbes() {
+        if (_link_probe_thread.joinable()) {
+            {
+                std::scoped_lock lock(_link_probe_mutex);
+                _link_probe_stop = true;
+            }
+            _link_probe_stop_cv.notify_all();
+            _link_probe_thread.join();
+        }
+        _link_probes.clear();
+        _link_probe_stop = false;
+    }
 
-    static std::shared_ptr<mavsdk::System> getSystem(mavsdk::Mavsdk& mavsdk)
+    SimSpeedEstimator _sim_speed;
+    // fixed simulation speed from the config, 0 if it is estimated
+    double _configured_sim_factor = 0.;
+
+    void updateSimSpeed(PassthroughTester &tester, const mavlink_message_t &message,
+                        PassthroughTester::Clock::time_point arrival) {
+        if (message.sysid != _test_target.system_id || message.compid != _test_target.component_id) {
+            return;
+        }
+        if (message.msgid == msg_helper<ATTITUDE>::ID) {
+            msg_helper<ATTITUDE>::decode_type attitude;
+            msg_helper<ATTITUDE>::unpack(&message, &attitude);
+            _sim_speed.update(message.msgid, attitude.time_boot_ms * 1000ULL, arrival);
+        } else if (message.msgid == msg_helper<SYSTEM_TIME>::ID) {
+            msg_helper<SYSTEM_TIME>::decode_type system_time;
+            msg_helper<SYSTEM_TIME>::unpack(&message, &system_time);
+            _sim_speed.update(message.msgid, system_time.time_boot_ms * 1000ULL, arrival);
+        } else {
+            return;
+        }
+        tester.setTimeScale(getSimFactor());
+    }
+
+    /**
+     * Waits for the system with the configured system id, whatever its components are. Camera
+     * or gimbal configs can run against a system without autopilot.
+     */
+    static std::shared_ptr<mavsdk::System> getSystem(mavsdk::Mavsdk& mavsdk, uint8_t system_id)
     {
-        std::cout << "Waiting to discover system...\n";
+        std::cout << "Waiting to discover system " << static_cast<int>(system_id) << "...\n";
         auto prom = std::promise<std::shared_ptr<mavsdk::System>>{};
         auto fut = prom.get_future();
+        std::once_flag found;
+        auto check_systems = [&mavsdk, &prom, &found, system_id]() {
+            for (auto &system : mavsdk.systems()) {
+                if (system->get_system_id() == system_id) {
+                    std::call_once(found, [&prom, &system]() { prom.set_value(system); });
+                    return;
+                }
+            }
+        };
+        mavsdk.subscribe_on_new_system(check_systems);
+        // the system may have been discovered before subscribing
+        check_systems();
+
+        auto status = fut.wait_for(std::chrono::milliseconds(DISCOVERY_TIMEOUT_MS));
+        mavsdk.subscribe_on_new_system(nullptr);
+        if (status == std::future_status::timeout) {
+            std::cerr << "System " << static_cast<int>(system_id) << " not found.\n";
+            return {};
+        }
+        return fut.get();
+    }
+
+    /**
+     * Discovery is complete with the first HEARTBEAT of the target component. MAVSDK may already
+     * have seen it while discovering the system, otherwise the tester waits for the next one.
+     */
+    void waitForTargetHeartbeat() {
+        if (_system) {
+            auto components = _system->component_ids();
+            if (std::find(components.begin(), components.end(), _test_target.component_id) != components.end()) {
+                return;
+            }
+        }
+        try {
+            _tester->receive<HEARTBEAT>(_test_target, DISCOVERY_TIMEOUT_MS);
+        } catch (TimeoutError&) {
+            throw std::runtime_error("No heartbeat from component " + std::to_string(_test_target.component_id));
+        }
+    }
+
+    /**
+     * Attaches to a running ras_a_link_agent instead of connecting to the vehicle, given as NAME
+     * or NAME?component_id=ID to send with an own component id. Only the passthrough tester is
+     * available then, the MAVSDK plugins stay null.
+     */
+    void setUpAgent(const std::string &agent) {
+        const size_t query = agent.find(AGENT_COMPONENT_QUERY);
+        const std::string agent_name = agent.substr(0, query);
+        int component_id = 0;
+        if (query != std::string::npos) {
+            const std::string value = agent.substr(query + std::string(AGENT_COMPONENT_QUERY).size());
+            try {
+                component_id = std::stoi(value);
+            } catch (std::logic_error&) {
+                component_id = -1;
+            }
+            if (component_id < 1 || component_id > 255) {
+                throw std::runtime_error("Invalid component id " + value + " in agent://" + agent);
+            }
+        }
+        std::unique_ptr<ShmRing> ring;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(AGENT_ATTACH_TIMEOUT_MS);
+        while (!ring) {
+            try {
+                ring = ShmRing::attach(agent_name);
+            } catch (AgentError&) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    throw;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        }
+        auto transport = std::make_shared<AgentTransport>(std::move(ring), static_cast<uint8_t>(component_id));
+        std::cout << "Attached to connection agent " << agent_name << "\n";
+        mavsdk::System::AutopilotVersion version{};
+        version.capabilities = transport->capabilities();
+        _autopilotVersionData = version;
+        _tester = std::make_shared<PassthroughTester>(transport);
+        endPhase("agent attach");
+    }
 
-        // We wait for new systems to be discovered, once we find one that has an
-        // autopilot, we decide to use it.
-        mavsdk.subscribe_on_new_system([&mavsdk, &prom]() {
-            auto system = mavsdk.systems().back();
+    static std::shared_ptr<mavsdk::Mavsdk> connect(const std::string &url) {
+        auto mavsdk = std::make_shared<mavsdk::Mavsdk>();
+        auto configuration = mavsdk::Mavsdk::Configuration(mavsdk::Mavsdk::Configuration::UsageType::GroundStation);
+        configuration.set_system_id(255);
+        mavsdk->set_configuration(configuration);
 
-            if (system->has_autopilot()) {
-                std::cout << "Discovered autopilot\n";
+        mavsdk::ConnectionResult connection_result = mavsdk->add_any_connection(url);
 
-                // Unsubscribe again as we only want to find one system.
-                mavsdk.subscribe_on_new_system(nullptr);
-                prom.set_value(system);
+        if (connection_result != mavsdk::ConnectionResult::Success) {
+            std::cerr << "Connection to " << url << " failed: " << connection_result << '\n';
+            throw std::runtime_error("Connection failed");
+        }
+        return mavsdk;
+    }
+
+    /**
+     * Connects to the vehicle. A comma separated URL connects over several links, each with its
+     * own MAVSDK instance; the first link provides the MAVSDK plugins.
+     */
+    void setUpMavsdk() {
+        std::vector<std::string> urls;
+        std::istringstream list(_connection_url);
+        for (std::string url; std::getline(list, url, ',');) {
+            if (!url.empty()) {
+                urls.push_back(url);
             }
+        }
+        if (urls.empty()) {
+            throw std::runtime_error("No connection URL");
+        }
+
+        _mavsdk = connect(urls.front());
+        for (size_t i = 1; i < urls.size(); i++) {
+            _extra_links.push_back({connect(urls[i]), nullptr, nullptr});
+        }
+        endPhase("connect");
+        _system = getSystem(*_mavsdk, _test_target.system_id);
+        if (!_system) {
+            throw std::runtime_error("No system found");
+        }
+        for (auto &link : _extra_links) {
+            link.system = getSystem(*link.mavsdk, _test_target.system_id);
+            if (!link.system) {
+                throw std::runtime_error("No system found on every link");
+            }
+        }
+        endPhase("system discovery");
+        // the mission and FTP plugins and the autopilot version are only fetched when needed
+        _mavlinkPassthrough = std::make_shared<mavsdk::MavlinkPassthrough>(_system);
+        std::shared_ptr<Transport> transport = std::make_shared<MavsdkTransport>(_mavlinkPassthrough);
+        if (!_extra_links.empty()) {
+            std::vector<std::shared_ptr<Transport>> links = {transport};
+            for (auto &link : _extra_links) {
+                link.passthrough = std::make_shared<mavsdk::MavlinkPassthrough>(link.system);
+                links.push_back(std::make_shared<MavsdkTransport>(link.passthrough));
+            }
+            transport = std::make_shared<MultiLinkTransport>(links);
+            std::cout << "Connected over " << links.size() << " links\n";
+        }
+        _tester = std::make_shared<PassthroughTester>(transport);
+        if (!_shared_link_name.empty()) {
+            startLinkAgent();
+        }
+    }
+
+    void startLinkAgent() {
+        auto ring = ShmRing::create(_shared_link_name, _mavlinkPassthrough->get_our_sysid(),
+                                    _mavlinkPassthrough->get_our_compid());
+        ring->setCapabilities(_system->get_autopilot_version_data().capabilities);
+        _link_agent = std::make_unique<LinkAgent>(std::move(ring), [passthrough = _mavlinkPassthrough](mavlink_message_t &message) {
+            passthrough->send_message(message);
+        });
+        _link_agent_listener = _tester->addListener([agent = _link_agent.get()](const mavlink_message_t &message,
+                                                                                 PassthroughTester::Clock::time_point arrival) {
+            agent->publish(message, std::chrono::duration_cast<std::chrono::nanoseconds>(arrival.time_since_epoch()).count());
         });
+        endPhase("link sharing");
+    }
 
-        // We usually receive heartbeats at 1Hz, therefore we should find a
-        // system after around 3 seconds max, surely.
-        if (fut.wait_for(std::chrono::seconds(3)) == std::future_status::timeout) {
-            std::cerr << "No autopilot found.\n";
-            return {};
+    void setUpConnection() {
+        _phase_start = std::chrono::steady_clock::now();
+        if (_connection_url.rfind(AGENT_URL_PREFIX, 0) == 0) {
+            setUpAgent(_connection_url.substr(std::string(AGENT_URL_PREFIX).size()));
+        } else {
+            setUpMavsdk();
+        }
+        _tester->setTimeScale(getSimFactor());
+        _tester->setDefaultTimeout(_plan.receiveTimeoutMs());
+        if (_plan.receiveTimeoutMs() == 0) {
+            addLinkProbe(_plan.rttProbeIntervalMs(), [tester = _tester]() { tester->sendRttProbe(); });
+        }
+        addLinkProbe(_plan.timesyncIntervalMs(), [tester = _tester]() { tester->sendTimesync(); });
+        startLinkProbes();
+        _tester->addListener([this, tester = _tester.get()](const mavlink_message_t &message,
+                                                             PassthroughTester::Clock::time_point arrival) {
+            updateSimSpeed(*tester, message, arrival);
+        });
+        waitForTargetHeartbeat();
+        endPhase("target heartbeat");
+        if (_plan.provisionStreams()) {
+            TelemetryStreams::getInstance().provision(*_tester, _test_target, _config, Scheduler::testsToRun());
+            endPhase("stream provisioning");
         }
 
-        // Get discovered system now.
-        return fut.get();
+        double total_ms = 0.;
+        printf("Startup:");
+        for (const auto &phase : _startup_phases) {
+            printf(" %s %.0f ms,", phase.first.c_str(), phase.second);
+            total_ms += phase.second;
+        }
+        printf(" total %.0f ms\n", total_ms);
     }
 
+    // set while repeating the tests, the connection then stays open between the repetitions
+    bool _keep_connected = false;
+
     Environment(const std::string &connection_url, const std::string &yaml_path) : 
-    _connection_url(connection_url), _config(YAML::LoadFile(yaml_path)) {
-        _test_target = {
-            _config["Global"]["system_id"].as<int>(), 
-            _config["Global"]["component_id"].as<int>()
-        };
+    _connection_url(connection_url), _config(YAML::LoadFile(yaml_path)), _plan(_config) {
+        _test_target = {_plan.systemId(), _plan.componentId()};
+        _configured_sim_factor = _plan.simFactor();
     }
 
 public:
@@ -105,26 +400,18 @@ public:
     }
 
     void SetUp() override {
-        _mavsdk = std::make_shared<mavsdk::Mavsdk>();
-        auto configuration = mavsdk::Mavsdk::Configuration(mavsdk::Mavsdk::Configuration::UsageType::GroundStation);
-        configuration.set_system_id(255);
-        _mavsdk->set_configuration(configuration);
-
-        mavsdk::ConnectionResult connection_result = _mavsdk->add_any_connection(_connection_url);
-
-        if (connection_result != mavsdk::ConnectionResult::Success) {
-            std::cerr << "Connection failed: " << connection_result << '\n';
-            throw std::runtime_error("Connection failed");
-        }
-        _system = getSystem(*_mavsdk);
-        if (!_system) {
-            throw std::runtime_error("No system found");
+        if (!_tester) {
+            setUpConnection();
         }
-        _autopilotVersionData = _system->get_autopilot_version_data();
-        _mavlinkPassthrough = std::make_shared<mavsdk::MavlinkPassthrough>(_system);
-        _mission = std::make_shared<mavsdk::Mission>(_system);
-        _ftp = std::make_shared<mavsdk::Ftp>(_system);
-        _tester = std::make_shared<PassthroughTester>(_mavlinkPassthrough);
+        Scheduler::getInstance().runAll(_plan.parallelJobs());
+    }
+
+    /**
+     * Keeps the connection open in TearDown, so that repeated test iterations share it. The
+     * last TearDown has to be called after switching it off again.
+     */
+    void setKeepConnected(bool keep_connected) {
+        _keep_connected = keep_connected;
     }
 
     std::shared_ptr<mavsdk::System> getSystem() const {
@@ -135,11 +422,22 @@ public:
         return _mavlinkPassthrough;
     }
 
-    std::shared_ptr<mavsdk::Mission> getMissionPlugin() const {
+    /**
+     * Creates the plugin on first use. Null when running through a connection agent.
+     */
+    std::shared_ptr<mavsdk::Mission> getMissionPlugin() {
+        std::scoped_lock lock(_plugin_mutex);
+        if (!_mission && _system) {
+            _mission = std::make_shared<mavsdk::Mission>(_system);
+        }
         return _mission;
     }
 
-    std::shared_ptr<mavsdk::Ftp> getFtpPlugin() const {
+    std::shared_ptr<mavsdk::Ftp> getFtpPlugin() {
+        std::scoped_lock lock(_plugin_mutex);
+        if (!_ftp && _system) {
+            _ftp = std::make_shared<mavsdk::Ftp>(_system);
+        }
         return _ftp;
     }
 
@@ -154,26 +452,90 @@ public:
                 printf("KEY NOT IN %s\n", key.c_str());
                 return node;
             }
-            node.reset(node[key]);
+            // const lookup, a non-const one inserts missing keys and observations read concurrently
+            node.reset(static_cast<const YAML::Node&>(node)[key]);
         }
         return node;
     }
 
-    const mavsdk::System::AutopilotVersion& getAutopilotVersion() const {
-        return _autopilotVersionData;
+    const TestPlan& getTestPlan() const {
+        return _plan;
+    }
+
+    const mavsdk::System::AutopilotVersion& getAutopilotVersion() {
+        std::scoped_lock lock(_plugin_mutex);
+        if (!_autopilotVersionData) {
+            _autopilotVersionData = _system ? _system->get_autopilot_version_data()
+                                            : mavsdk::System::AutopilotVersion{};
+        }
+        return *_autopilotVersionData;
     }
 
     const TestTargetAddress& getTargetAddress() const {
         return _test_target;
     }
 
+    /**
+     * How fast the vehicle runs compared to real time. Either configured with sim_factor, or
+     * estimated continuously from the vehicle's boot time (sim_factor: auto).
+     */
+    double getSimFactor() const {
+        return _configured_sim_factor > 0. ? _configured_sim_factor : _sim_speed.factor();
+    }
+
+    /**
+     * Shares the connection with other processes under the given name, see ComponentWorkers.
+     * TearDown calls wait_for_users before closing the connection. Must be called before SetUp.
+     */
+    void shareLink(const std::string &name, std::function<void()> wait_for_users) {
+        _shared_link_name = name;
+        _wait_for_link_users = std::move(wait_for_users);
+    }
+
     void TearDown() override {
+        if (_keep_connected || !_tester) {
+            return;
+        }
+        TelemetryStreams::getInstance().restore(*_tester);
+        stopLinkProbes();
+        if (_link_agent) {
+            _wait_for_link_users();
+            _tester->removeListener(_link_agent_listener);
+            _link_agent = nullptr;
+        }
+        if (_configured_sim_factor > 0.) {
+            printf("Simulation speed factor: %.2f (configured)\n", _configured_sim_factor);
+        } else if (_sim_speed.hasEstimate()) {
+            printf("Simulation speed factor: %.2f (estimated)\n", _sim_speed.factor());
+        }
+        const ClockSync &clock = _tester->getClockSync();
+        if (clock.valid()) {
+            printf("Vehicle clock: offset %.1f ms, skew %.1f ppm from %lu TIMESYNC round trips (best %.1f ms)\n",
+                   clock.offsetMs(ClockSync::hostMs(std::chrono::steady_clock::now())), clock.skew() * 1e6,
+                   static_cast<unsigned long>(clock.samples()), clock.minRttMs());
+        }
+        const CommandTotals commands = CommandClient::totals();
+        if (commands.commands > 0) {
+            printf("Commands: %lu sent, %lu retransmissions, %lu in progress, %lu unanswered, %.1f ms mean to the "
+                   "result\n", static_cast<unsigned long>(commands.commands),
+                   static_cast<unsigned long>(commands.retransmissions), static_cast<unsigned long>(commands.in_progress),
+                   static_cast<unsigned long>(commands.unanswered), commands.total_ms.mean());
+        }
+        const RttEstimator &rtt = _tester->getRttEstimator();
+        if (_plan.receiveTimeoutMs() > 0) {
+            printf("Receive timeout: %u ms (configured)\n", _plan.receiveTimeoutMs());
+        } else if (rtt.samples() > 0) {
+            printf("Round trip time: %.1f ms +- %.1f ms from %lu samples, receive timeout %u ms\n",
+                   rtt.srttMs(), rtt.rttvarMs(), static_cast<unsigned long>(rtt.samples()),
+                   _tester->getDefaultTimeout());
+        }
         _tester = nullptr;
         _ftp = nullptr;
         _mission = nullptr;
         _mavlinkPassthrough = nullptr;
         _system = nullptr;
         _mavsdk = nullptr;
+        _extra_links.clear();
     }
 
     ~Environment() override {
@@ -0,0 +1,257 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace RASATestingSuite {
+
+/**
+ * Records the result of every test of a vehicle process into a file read by the fleet.
+ */
+class FleetResultListener : public ::testing::EmptyTestEventListener {
+private:
+    std::ofstream _out;
+
+public:
+    FleetResultListener(const std::string &path) : _out(path) {}
+
+    void OnTestEnd(const ::testing::TestInfo &info) override {
+        const auto* result = info.result();
+        const char* status = result->Skipped() ? "SKIPPED" : (result->Passed() ? "PASSED" : "FAILED");
+        _out << info.test_suite_name() << "." << info.name() << "\t" << status << "\t"
+             << result->elapsed_time() << std::endl;
+    }
+};
+
+/**
+ * Runs the suite on many vehicles, e.g. a rack of flight controllers or a batch of SITL
+ * instances. Every vehicle gets its own process with its own connection, as gtest and the
+ * Environment exist once per process; at most max_parallel of them run at the same time. The
+ * fleet collects the test results of all vehicles into one report.
+ */
+class Fleet {
+private:
+    struct TestResult {
+        std::string status;
+        long elapsed_ms;
+    };
+
+    struct Vehicle {
+        std::string url;
+        std::filesystem::path log_path;
+        std::filesystem::path result_path;
+        pid_t pid = -1;
+        int exit_code = -1;
+        double seconds = 0.;
+        std::map<std::string, TestResult> results;
+    };
+
+    std::vector<Vehicle> _vehicles;
+    const unsigned _max_parallel;
+
+    void collect(Vehicle &vehicle, int status, double seconds) {
+        vehicle.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+        vehicle.seconds = seconds;
+        std::ifstream results(vehicle.result_path);
+        std::string line;
+        while (std::getline(results, line)) {
+            std::istringstream fields(line);
+            std::string name;
+            TestResult result;
+            if (std::getline(fields, name, '\t') && std::getline(fields, result.status, '\t') &&
+                fields >> result.elapsed_ms) {
+                vehicle.results[name] = result;
+            }
+        }
+        std::filesystem::remove(vehicle.result_path);
+        if (vehicle.exit_code == 0) {
+            std::filesystem::remove(vehicle.log_path);
+        }
+    }
+
+public:
+    /**
+     * Connection URLs of a fleet: a comma separated list, or a port range such as
+     * udp://:14540-14543 for four SITL instances. Throws std::invalid_argument naming the URL
+     * if a range is invalid or the list is empty.
+     */
+    static std::vector<std::string> expandUrls(const std::string &urls) {
+        std::vector<std::string> expanded;
+        std::istringstream list(urls);
+        std::string url;
+        const std::regex port_range("^(.*:)([0-9]+)-([0-9]+)$");
+        while (std::getline(list, url, ',')) {
+            std::smatch match;
+            if (std::regex_match(url, match, port_range)) {
+                int first = 0;
+                int last = 0;
+                try {
+                    first = std::stoi(match[2]);
+                    last = std::stoi(match[3]);
+                } catch (std::out_of_range&) {
+                }
+                if (first < 1 || last > 65535 || first > last) {
+                    throw std::invalid_argument("Invalid port range in " + url);
+                }
+                for (int port = first; port <= last; port++) {
+                    expanded.push_back(match[1].str() + std::to_string(port));
+                }
+            } else if (!url.empty()) {
+                expanded.push_back(url);
+            }
+        }
+        if (expanded.empty()) {
+            throw std::invalid_argument("No connection URL in " + urls);
+        }
+        return expanded;
+    }
+
+    Fleet(const std::vector<std::string> &urls, unsigned max_parallel) :
+          _max_parallel(max_parallel == 0 ? urls.size() : max_parallel) {
+        const std::string prefix = "fleet_" + std::to_string(getpid()) + "_";
+        for (size_t i = 0; i < urls.size(); i++) {
+            Vehicle vehicle;
+            vehicle.url = urls[i];
+            vehicle.log_path = std::filesystem::temp_directory_path() / (prefix + std::to_string(i + 1) + ".log");
+            vehicle.result_path = std::filesystem::temp_directory_path() / (prefix + std::to_string(i + 1) + ".results");
+            _vehicles.push_back(vehicle);
+        }
+    }
+
+    /**
+     * Runs all vehicles. Returns true in a vehicle process, with url, result_path and index
+     * set for it, and false in the fleet process once all vehicles are done.
+     */
+    bool run(std::string &url, std::string &result_path, size_t &index) {
+        std::map<pid_t, std::pair<size_t, std::chrono::steady_clock::time_point>> running;
+        size_t next = 0;
+        while (next < _vehicles.size() || !running.empty()) {
+            if (next < _vehicles.size() && running.size() < _max_parallel) {
+                Vehicle &vehicle = _vehicles[next];
+                std::cout << "Starting vehicle " << next + 1 << " (" << vehicle.url << ")" << std::endl;
+                pid_t pid = ::fork();
+                if (pid < 0) {
+                    // counts as failed in the report
+                    std::cerr << "Could not start the process for " << vehicle.url << ": " << strerror(errno) << std::endl;
+                    next++;
+                    continue;
+                }
+                if (pid == 0) {
+                    int log = open(vehicle.log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                    if (log >= 0) {
+                        dup2(log, STDOUT_FILENO);
+                        dup2(log, STDERR_FILENO);
+                        close(log);
+                    }
+                    url = vehicle.url;
+                    result_path = vehicle.result_path.string();
+                    index = next + 1;
+                    return true;
+                }
+                vehicle.pid = pid;
+                running[pid] = {next, std::chrono::steady_clock::now()};
+                next++;
+                continue;
+            }
+            int status = 0;
+            pid_t pid = waitpid(-1, &status, 0);
+            auto done = running.find(pid);
+            if (done == running.end()) {
+                continue;
+            }
+            Vehicle &vehicle = _vehicles[done->second.first];
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - done->second.second).count();
+            collect(vehicle, status, seconds);
+            std::cout << "Vehicle " << done->second.first + 1 << " (" << vehicle.url << ") "
+                      << (vehicle.exit_code == 0 ? "passed" : "failed") << std::endl;
+            running.erase(done);
+        }
+        return false;
+    }
+
+    /**
+     * Prints the combined report and returns the exit code of the whole fleet run.
+     */
+    int report() const {
+        int failed_vehicles = 0;
+        std::map<std::string, std::vector<const TestResult*>> by_test;
+        printf("\nFleet report: %zu vehicles\n", _vehicles.size());
+        printf("  %-4s %-32s %7s %7s %7s %9s\n", "#", "URL", "passed", "failed", "skipped", "time [s]");
+        for (size_t i = 0; i < _vehicles.size(); i++) {
+            const Vehicle &vehicle = _vehicles[i];
+            int passed = 0, failed = 0, skipped = 0;
+            for (const auto &result : vehicle.results) {
+                by_test[result.first].push_back(&result.second);
+                passed += result.second.status == "PASSED";
+                failed += result.second.status == "FAILED";
+                skipped += result.second.status == "SKIPPED";
+            }
+            printf("  %-4zu %-32s %7d %7d %7d %9.1f%s\n", i + 1, vehicle.url.c_str(), passed, failed, skipped,
+                   vehicle.seconds, vehicle.results.empty() ? "  (no results, see log)" : "");
+            failed_vehicles += vehicle.exit_code != 0;
+        }
+
+        printf("\n  %-48s %9s %8s %8s %8s %8s\n", "Test", "passed", "min ms", "median", "max ms", "mean ms");
+        for (const auto &test : by_test) {
+            std::vector<long> times;
+            int passed = 0, ran = 0;
+            for (const auto* result : test.second) {
+                if (result->status == "SKIPPED") {
+                    continue;
+                }
+                ran++;
+                passed += result->status == "PASSED";
+                times.push_back(result->elapsed_ms);
+            }
+            if (ran == 0) {
+                continue;
+            }
+            std::sort(times.begin(), times.end());
+            double mean = 0.;
+            for (long time : times) {
+                mean += static_cast<double>(time) / static_cast<double>(times.size());
+            }
+            printf("  %-48s %4d/%-4d %8ld %8ld %8ld %8.0f\n", test.first.c_str(), passed, ran,
+                   times.front(), times[times.size() / 2], times.back(), mean);
+        }
+
+        bool header = false;
+        for (size_t i = 0; i < _vehicles.size(); i++) {
+            const Vehicle &vehicle = _vehicles[i];
+            if (vehicle.exit_code == 0) {
+                continue;
+            }
+            if (!header) {
+                printf("\nFailures:\n");
+                header = true;
+            }
+            printf("  vehicle %zu (%s), log %s:", i + 1, vehicle.url.c_str(), vehicle.log_path.c_str());
+            for (const auto &result : vehicle.results) {
+                if (result.second.status == "FAILED") {
+                    printf(" %s", result.first.c_str());
+                }
+            }
+            printf("\n");
+        }
+        printf("\n%zu of %zu vehicles passed\n", _vehicles.size() - failed_vehicles, _vehicles.size());
+        return failed_vehicles > 0 ? 1 : 0;
+    }
+};
+
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include "shm_ring.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * Agent side of the shared link: forwards what the test processes queue to the vehicle and
+ * keeps the segment marked alive. Received messages are handed in with publish by whoever
+ * receives them, the ras_a_link_agent or a suite sharing its connection with component workers.
+ */
+class LinkAgent {
+public:
+    using SendFunction = std::function<void(mavlink_message_t&)>;
+
+private:
+    static constexpr std::chrono::milliseconds TOUCH_INTERVAL{100};
+
+    std::unique_ptr<ShmRing> _ring;
+    SendFunction _send;
+    std::atomic<bool> _running{true};
+    std::thread _thread;
+
+    void run() {
+        mavlink_message_t message;
+        auto next_touch = std::chrono::steady_clock::now();
+        while (_running) {
+            bool idle = true;
+            while (_ring->takeOutgoing(message)) {
+                _send(message);
+                idle = false;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next_touch) {
+                _ring->touch();
+                next_touch = now + TOUCH_INTERVAL;
+            }
+            if (idle) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+    }
+
+public:
+    LinkAgent(std::unique_ptr<ShmRing> ring, SendFunction send) : _ring(std::move(ring)), _send(std::move(send)) {
+        _thread = std::thread([this]() { run(); });
+    }
+
+    void publish(const mavlink_message_t &message, int64_t arrival_ns) {
+        _ring->publish(message, arrival_ns);
+    }
+
+    void setCapabilities(uint64_t capabilities) {
+        _ring->setCapabilities(capabilities);
+    }
+
+    ~LinkAgent() {
+        _running = false;
+        _thread.join();
+    }
+};
+
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <random>
+
+namespace RASATestingSuite {
+
+struct ImpairmentConfig {
+    // independent (random) loss probability per datagram
+    double loss = 0.;
+    // Gilbert-Elliott burst loss: probability to enter / leave the bad state per datagram,
+    // and the loss probability while in the bad state
+    double burst_enter = 0.;
+    double burst_exit = 1.;
+    double burst_loss = 1.;
+    // one-way latency and normally distributed jitter (standard deviation) on top of it
+    double delay_ms = 0.;
+    double jitter_ms = 0.;
+    // probability that a datagram is held back and overtaken by the following ones
+    double reorder = 0.;
+    double reorder_delay_ms = 20.;
+    // serial line rate in bits per second, 0 means unlimited. Bytes are counted as
+    // 10 bits (8N1 framing), as on a telemetry radio.
+    uint32_t bandwidth_bps = 0;
+    // datagrams are tail-dropped once this many bytes wait for the line, 0 means unlimited
+    uint32_t queue_limit_bytes = 0;
+};
+
+struct ImpairmentCounters {
+    uint64_t forwarded = 0;
+    uint64_t forwarded_bytes = 0;
+    uint64_t dropped_random = 0;
+    uint64_t dropped_burst = 0;
+    uint64_t dropped_queue = 0;
+    uint64_t reordered = 0;
+};
+
+/**
+ * Decides for every datagram of one link direction whether it is lost and when it is
+ * delivered. Delivery stays in order unless a datagram is explicitly picked for reordering.
+ */
+class LinkImpairment {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    static constexpr double BITS_PER_BYTE = 10.;
+
+    ImpairmentConfig _config;
+    std::mt19937 _rng;
+    std::uniform_real_distribution<double> _uniform{0., 1.};
+    std::normal_distribution<double> _jitter;
+    bool _burst_state = false;
+    Clock::time_point _line_free;
+    Clock::time_point _last_release;
+    ImpairmentCounters _counters;
+
+    static Clock::duration fromMs(double ms) {
+        return std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::milli>(ms));
+    }
+
+    bool isLost() {
+        if (_burst_state) {
+            _burst_state = _uniform(_rng) >= _config.burst_exit;
+        } else {
+            _burst_state = _uniform(_rng) < _config.burst_enter;
+        }
+        if (_burst_state && _uniform(_rng) < _config.burst_loss) {
+            _counters.dropped_burst++;
+            return true;
+        }
+        if (_uniform(_rng) < _config.loss) {
+            _counters.dropped_random++;
+            return true;
+        }
+        return false;
+    }
+
+public:
+    LinkImpairment(const ImpairmentConfig& config, uint32_t seed) :
+          _config(config), _rng(seed),
+          // the distribution needs a positive deviation, it is only sampled with jitter
+          _jitter(0., config.jitter_ms > 0. ? config.jitter_ms : 1.) {}
+
+    /**
+     * Returns the time at which a datagram of the given size arriving now has to be
+     * delivered, or nothing if it is lost.
+     */
+    std::optional<Clock::time_point> schedule(size_t bytes, Clock::time_point now) {
+        if (isLost()) {
+            return std::nullopt;
+        }
+
+        Clock::time_point sent = now;
+        if (_config.bandwidth_bps > 0) {
+            Clock::time_point start = std::max(now, _line_free);
+            if (_config.queue_limit_bytes > 0) {
+                double queued_bytes = std::chrono::duration<double>(start - now).count() *
+                                      _config.bandwidth_bps / BITS_PER_BYTE;
+                if (queued_bytes + bytes > _config.queue_limit_bytes) {
+                    _counters.dropped_queue++;
+                    return std::nullopt;
+                }
+            }
+            _line_free = start + fromMs(1000. * BITS_PER_BYTE * bytes / _config.bandwidth_bps);
+            sent = _line_free;
+        }
+
+        double latency_ms = _config.delay_ms;
+        if (_config.jitter_ms > 0.) {
+            latency_ms = std::max(0., latency_ms + _jitter(_rng));
+        }
+        Clock::time_point release = sent + fromMs(latency_ms);
+
+        _counters.forwarded++;
+        _counters.forwarded_bytes += bytes;
+        if (_config.reorder > 0. && _uniform(_rng) < _config.reorder) {
+            // held back without moving the in-order horizon, so later datagrams overtake it
+            _counters.reordered++;
+            return std::max(release, _last_release) + fromMs(_config.reorder_delay_ms);
+        }
+        _last_release = std::max(release, _last_release);
+        return _last_release;
+    }
+
+    const ImpairmentCounters& counters() const { return _counters; }
+};
+
+};
@@ -0,0 +1,260 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "link_impairment.hpp"
+
+using namespace RASATestingSuite;
+using Clock = LinkImpairment::Clock;
+
+namespace {
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+enum Direction { TO_SUITE = 0, TO_VEHICLE = 1 };
+
+struct PendingDatagram {
+    Clock::time_point release;
+    uint64_t order;
+    Direction direction;
+    std::vector<uint8_t> data;
+
+    bool operator>(const PendingDatagram& other) const {
+        return release != other.release ? release > other.release : order > other.order;
+    }
+};
+
+void printUsage() {
+    std::cout << "Usage: ras_a_link_proxy VEHICLE_PORT SUITE_HOST:SUITE_PORT [options]\n"
+              << "  Receives the vehicle's UDP traffic on VEHICLE_PORT and forwards it to the suite\n"
+              << "  (run the suite with udp://:SUITE_PORT), impairing both directions.\n"
+              << "Options:\n"
+              << "  --loss=P               independent loss probability\n"
+              << "  --burst-enter=P        probability to enter burst loss per datagram\n"
+              << "  --burst-exit=P         probability to leave burst loss per datagram\n"
+              << "  --burst-loss=P         loss probability during a burst (default 1)\n"
+              << "  --delay-ms=MS          one-way latency\n"
+              << "  --jitter-ms=MS         standard deviation of the latency\n"
+              << "  --reorder=P            probability that a datagram gets overtaken\n"
+              << "  --reorder-delay-ms=MS  hold-back time of reordered datagrams (default 20)\n"
+              << "  --bandwidth-bps=BPS    line rate, e.g. 57600 for a telemetry radio\n"
+              << "  --queue-limit-bytes=N  radio buffer size, tail drop when exceeded\n"
+              << "  --seed=N               random seed (default 1)\n"
+              << "  --stats-interval-s=S   print counters every S seconds (default 10)\n";
+}
+
+bool parseOption(const std::string& arg, ImpairmentConfig& config, uint32_t& seed,
+                 int& stats_interval_s) {
+    auto pos = arg.find('=');
+    if (arg.rfind("--", 0) != 0 || pos == std::string::npos) {
+        return false;
+    }
+    const std::string key = arg.substr(2, pos - 2);
+    const std::string value = arg.substr(pos + 1);
+    static const std::map<std::string, double ImpairmentConfig::*> double_options = {
+        {"loss", &ImpairmentConfig::loss},
+        {"burst-enter", &ImpairmentConfig::burst_enter},
+        {"burst-exit", &ImpairmentConfig::burst_exit},
+        {"burst-loss", &ImpairmentConfig::burst_loss},
+        {"delay-ms", &ImpairmentConfig::delay_ms},
+        {"jitter-ms", &ImpairmentConfig::jitter_ms},
+        {"reorder", &ImpairmentConfig::reorder},
+        {"reorder-delay-ms", &ImpairmentConfig::reorder_delay_ms},
+    };
+    try {
+        if (double_options.count(key) > 0) {
+            config.*(double_options.at(key)) = std::stod(value);
+        } else if (key == "bandwidth-bps") {
+            config.bandwidth_bps = std::stoul(value);
+        } else if (key == "queue-limit-bytes") {
+            config.queue_limit_bytes = std::stoul(value);
+        } else if (key == "seed") {
+            seed = std::stoul(value);
+        } else if (key == "stats-interval-s") {
+            stats_interval_s = std::max(1, std::stoi(value));
+        } else {
+            return false;
+        }
+    } catch (std::logic_error&) {
+        return false;
+    }
+    return true;
+}
+
+bool parsePort(const std::string& value, uint16_t& port) {
+    try {
+        size_t end = 0;
+        int parsed = std::stoi(value, &end);
+        if (end != value.size() || parsed < 0 || parsed > 65535) {
+            return false;
+        }
+        port = static_cast<uint16_t>(parsed);
+    } catch (std::logic_error&) {
+        return false;
+    }
+    return true;
+}
+
+bool parseAddress(const std::string& host_port, sockaddr_in& addr) {
+    auto pos = host_port.rfind(':');
+    uint16_t port = 0;
+    if (pos == std::string::npos || !parsePort(host_port.substr(pos + 1), port)) {
+        return false;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    return inet_pton(AF_INET, host_port.substr(0, pos).c_str(), &addr.sin_addr) == 1;
+}
+
+int openSocket(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void printCounters(const char* name, const LinkImpairment& impairment) {
+    const auto& c = impairment.counters();
+    printf("%s: forwarded %" PRIu64 " (%" PRIu64 " bytes), dropped %" PRIu64 " random / %" PRIu64
+           " burst / %" PRIu64 " queue, reordered %" PRIu64 "\n",
+           name, c.forwarded, c.forwarded_bytes, c.dropped_random, c.dropped_burst,
+           c.dropped_queue, c.reordered);
+}
+
+};  // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        printUsage();
+        return 1;
+    }
+
+    ImpairmentConfig config;
+    uint32_t seed = 1;
+    int stats_interval_s = 10;
+    for (int i = 3; i < argc; i++) {
+        if (!parseOption(argv[i], config, seed, stats_interval_s)) {
+            std::cerr << "Invalid option " << argv[i] << std::endl;
+            printUsage();
+            return 1;
+        }
+    }
+
+    uint16_t vehicle_port = 0;
+    if (!parsePort(argv[1], vehicle_port)) {
+        std::cerr << "Invalid vehicle port " << argv[1] << std::endl;
+        printUsage();
+        return 1;
+    }
+    sockaddr_in suite_addr{};
+    if (!parseAddress(argv[2], suite_addr)) {
+        std::cerr << "Invalid suite address " << argv[2] << std::endl;
+        printUsage();
+        return 1;
+    }
+    int vehicle_fd = openSocket(vehicle_port);
+    int suite_fd = openSocket(0);
+    if (vehicle_fd < 0 || suite_fd < 0) {
+        std::cerr << "Could not open UDP sockets: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::signal(SIGINT, [](int) { stop_requested = 1; });
+    std::signal(SIGTERM, [](int) { stop_requested = 1; });
+
+    // each direction has its own line and loss state, as a full-duplex radio link
+    LinkImpairment impairments[2] = {LinkImpairment(config, seed), LinkImpairment(config, seed + 1)};
+    std::priority_queue<PendingDatagram, std::vector<PendingDatagram>, std::greater<>> pending;
+    uint64_t order = 0;
+    sockaddr_in vehicle_addr{};
+    bool vehicle_known = false;
+    auto next_stats = Clock::now() + std::chrono::seconds(stats_interval_s);
+
+    std::vector<uint8_t> buffer(65536);
+    pollfd fds[2] = {{vehicle_fd, POLLIN, 0}, {suite_fd, POLLIN, 0}};
+
+    while (stop_requested == 0) {
+        auto now = Clock::now();
+        auto wake = next_stats;
+        if (!pending.empty()) {
+            wake = std::min(wake, pending.top().release);
+        }
+        int timeout_ms = static_cast<int>(std::max<int64_t>(
+            0, std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count()));
+        if (poll(fds, 2, timeout_ms) < 0 && errno != EINTR) {
+            std::cerr << "poll failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        now = Clock::now();
+        for (int i = 0; i < 2; i++) {
+            if ((fds[i].revents & POLLIN) == 0) {
+                continue;
+            }
+            sockaddr_in from{};
+            socklen_t from_len = sizeof(from);
+            ssize_t len = recvfrom(fds[i].fd, buffer.data(), buffer.size(), 0,
+                                   reinterpret_cast<sockaddr*>(&from), &from_len);
+            if (len <= 0) {
+                continue;
+            }
+            Direction direction = i == 0 ? TO_SUITE : TO_VEHICLE;
+            if (direction == TO_SUITE) {
+                vehicle_addr = from;
+                vehicle_known = true;
+            }
+            auto release = impairments[direction].schedule(len, now);
+            if (release) {
+                pending.push({*release, order++, direction,
+                              std::vector<uint8_t>(buffer.begin(), buffer.begin() + len)});
+            }
+        }
+
+        while (!pending.empty() && pending.top().release <= now) {
+            const auto& datagram = pending.top();
+            if (datagram.direction == TO_SUITE) {
+                sendto(suite_fd, datagram.data.data(), datagram.data.size(), 0,
+                       reinterpret_cast<const sockaddr*>(&suite_addr), sizeof(suite_addr));
+            } else if (vehicle_known) {
+                sendto(vehicle_fd, datagram.data.data(), datagram.data.size(), 0,
+                       reinterpret_cast<const sockaddr*>(&vehicle_addr), sizeof(vehicle_addr));
+            }
+            pending.pop();
+        }
+
+        if (now >= next_stats) {
+            printCounters("vehicle->suite", impairments[TO_SUITE]);
+            printCounters("suite->vehicle", impairments[TO_VEHICLE]);
+            next_stats = now + std::chrono::seconds(stats_interval_s);
+        }
+    }
+
+    printCounters("vehicle->suite", impairments[TO_SUITE]);
+    printCounters("suite->vehicle", impairments[TO_VEHICLE]);
+    close(vehicle_fd);
+    close(suite_fd);
+    return 0;
+}
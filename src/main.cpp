@@ -8,9 +8,13 @@
 #include <iostream>
 #include <thread>
 #include <memory>
+#include <optional>
 #include <vector>
 #include <chrono>
+#include "component_workers.hpp"
 #include "environment.hpp"
+#include "fleet.hpp"
+#include "soak.hpp"
 
 #include "gtest/gtest.h"
 
@@ -19,22 +23,145 @@
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
-    
+
+    // --fleet[=N] runs the suite on every vehicle of the connection URL list, N at a time
+    bool fleet_mode = false;
+    unsigned fleet_parallel = 0;
+    // --soak=LIMIT repeats the tests for a duration or a number of iterations
+    std::optional<RASATestingSuite::SoakLimit> soak_limit;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--fleet" || arg.rfind("--fleet=", 0) == 0) {
+            fleet_mode = true;
+            try {
+                size_t end = 0;
+                fleet_parallel = arg.size() > 8 ? std::stoul(arg.substr(8), &end) : 0;
+                if (arg.size() > 8 && end != arg.size() - 8) {
+                    throw std::invalid_argument(arg);
+                }
+            } catch (std::logic_error &) {
+                std::cerr << "Invalid vehicle count in " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--soak=", 0) == 0) {
+            try {
+                soak_limit = RASATestingSuite::SoakLimit::parse(arg.substr(7));
+            } catch (std::invalid_argument &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else {
+            continue;
+        }
+        std::copy(argv + i + 1, argv + argc, argv + i);
+        argc--;
+        i--;
+    }
+
     if (argc < 3) {
-        std::cout << "Usage: ras_a_test_suite CONNECTION_URL [yaml-config file] [gtest arguments]" << std::endl;
+        std::cout << "Usage: ras_a_test_suite [--fleet[=N]] [--soak=LIMIT] CONNECTION_URL [yaml-config file]... [gtest arguments]" << std::endl;
+        std::cout << "  CONNECTION_URL is a MAVSDK connection URL or agent://NAME[?component_id=ID] of a running ras_a_link_agent" << std::endl;
+        std::cout << "  Additional config files (e.g. camera, gimbal) run in parallel on the same connection" << std::endl;
+        std::cout << "  A comma separated CONNECTION_URL without --fleet connects to one vehicle over several links" << std::endl;
+        std::cout << "  --fleet[=N] tests every vehicle of a comma separated URL list or a port range" << std::endl;
+        std::cout << "    (e.g. udp://:14540-14543), N vehicles at a time (default all)" << std::endl;
+        std::cout << "  --soak=LIMIT repeats the tests for a duration (e.g. 8h, 30m, 90s) or a number of" << std::endl;
+        std::cout << "    iterations and prints a statistics report at the end" << std::endl;
         return 1;
     }
 
-    const std::string yaml_path = argv[2];
-    const std::string connection_url{argv[1]};
+    std::string connection_url{argv[1]};
+    std::vector<std::string> yaml_paths(argv + 2, argv + argc);
+    std::string yaml_path = yaml_paths.front();
+
+    // check all configs before starting the component workers
+    for (const auto &path : yaml_paths) {
+        try {
+            RASATestingSuite::TestPlan plan(YAML::LoadFile(path));
+        } catch(YAML::BadFile &e) {
+            std::cerr << "YAML file load \""<< path << "\" failed: " << e.msg << std::endl;
+            exit(1);
+        } catch(RASATestingSuite::ConfigError &e) {
+            std::cerr << "Invalid config \"" << path << "\": " << e.what() << std::endl;
+            exit(1);
+        }
+    }
+
+    if (fleet_mode) {
+        std::vector<std::string> vehicle_urls;
+        try {
+            vehicle_urls = RASATestingSuite::Fleet::expandUrls(connection_url);
+        } catch (std::invalid_argument &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        RASATestingSuite::Fleet fleet(vehicle_urls, fleet_parallel);
+        std::string result_path;
+        size_t vehicle_index = 0;
+        if (!fleet.run(connection_url, result_path, vehicle_index)) {
+            return fleet.report();
+        }
+        ::testing::UnitTest::GetInstance()->listeners().Append(new RASATestingSuite::FleetResultListener(result_path));
+        ::testing::GTEST_FLAG(output) = RASATestingSuite::ComponentWorkers::componentOutput(
+            ::testing::GTEST_FLAG(output), "vehicle" + std::to_string(vehicle_index));
+    }
 
-    try {
-        RASATestingSuite::Environment::create(connection_url, yaml_path);
-    } catch(YAML::BadFile &e) {
-        std::cerr << "YAML file load \""<< yaml_path << "\" failed: " << e.msg << std::endl;
-        exit(1);
+    // fork before MAVSDK starts its threads
+    RASATestingSuite::ComponentWorkers workers;
+    bool is_worker = false;
+    if (yaml_paths.size() > 1) {
+        std::string worker_config;
+        is_worker = workers.fork({yaml_paths.begin() + 1, yaml_paths.end()}, worker_config);
+        if (is_worker) {
+            const std::string component = RASATestingSuite::ComponentWorkers::componentName(worker_config);
+            ::testing::GTEST_FLAG(output) = RASATestingSuite::ComponentWorkers::componentOutput(
+                ::testing::GTEST_FLAG(output), component);
+            yaml_path = worker_config;
+            connection_url = workers.agentUrl();
+        }
     }
 
-    ::testing::AddGlobalTestEnvironment(RASATestingSuite::Environment::getInstance());
-    return RUN_ALL_TESTS();
+    RASATestingSuite::Environment::create(connection_url, yaml_path);
+    auto* environment = RASATestingSuite::Environment::getInstance();
+    if (!workers.empty()) {
+        environment->shareLink(workers.linkName(), [&workers]() { workers.waitAll(); });
+    }
+    // skipped tests are filtered out, so their fixtures are never constructed
+    environment->getTestPlan().applyFilter();
+
+    RASATestingSuite::SoakListener* soak = nullptr;
+    if (soak_limit) {
+        // one report at the end instead of the output of every iteration
+        auto &listeners = ::testing::UnitTest::GetInstance()->listeners();
+        delete listeners.Release(listeners.default_result_printer());
+        soak = new RASATestingSuite::SoakListener(*soak_limit, {
+            {"resident_kB", RASATestingSuite::residentMemoryKb},
+            {"queued_messages", [environment]() {
+                auto tester = environment->getPassthroughTester();
+                return tester ? static_cast<double>(tester->getQueuedMessages()) : 0.;
+            }},
+        });
+        listeners.Append(soak);
+        environment->setKeepConnected(true);
+    }
+
+    ::testing::AddGlobalTestEnvironment(environment);
+    int result = 0;
+    if (soak) {
+        // the limit may be a duration, so the iterations are run here instead of with gtest_repeat
+        ::testing::GTEST_FLAG(repeat) = 1;
+        int run_result = 0;
+        do {
+            run_result |= RUN_ALL_TESTS();
+        } while (!soak->done());
+        result = soak->report() != 0 || run_result != 0 ? 1 : 0;
+        environment->setKeepConnected(false);
+        environment->TearDown();
+    } else {
+        result = RUN_ALL_TESTS();
+    }
+    if (!workers.empty()) {
+        result = workers.summarize(yaml_path, result);
+    }
+    return result;
 }
@@ -0,0 +1,200 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "transport.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * Several links to the same vehicle, e.g. USB serial and Ethernet. Every message the vehicle
+ * sends on more than one link is delivered once, on the link it arrived first; the copies are
+ * used to compare the links. Copies are matched by message id and payload, as autopilots
+ * number the messages of each link separately. Messages are sent on the first link unless
+ * sent via another one.
+ */
+class MultiLinkTransport : public Transport {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // MAVLink 2 header and checksum, as counted by the PassthroughTester
+    static constexpr uint64_t FRAME_OVERHEAD_BYTES = 12;
+
+    // a copy on another link within this time with the same message id and payload is a duplicate
+    static constexpr std::chrono::milliseconds DUPLICATE_WINDOW{1000};
+
+    // the links a frame arrived on are a bit mask
+    static constexpr size_t MAX_LINKS = 32;
+
+    struct SeenFrame {
+        Clock::time_point first_arrival;
+        uint32_t links;  // bit per link the frame arrived on
+        uint8_t seq;     // on the first link
+    };
+
+    struct Source {
+        std::unordered_map<uint64_t, SeenFrame> frames;       // by payload hash
+        std::deque<std::pair<uint64_t, Clock::time_point>> expiry;
+        std::vector<int> last_seq;  // per link, -1 before the first message
+    };
+
+    const std::vector<std::shared_ptr<Transport>> _links;
+    std::vector<PerLinkStats> _stats;
+    std::map<uint16_t, Source> _sources;  // by sysid << 8 | compid
+    const Clock::time_point _start;
+    MessageCallback _incoming;
+    std::mutex _mutex;
+    bool _seq_warned = false;
+
+    // FNV-1a over message id and payload
+    static uint64_t payloadHash(const mavlink_message_t &message) {
+        uint64_t hash = 14695981039346656037ULL;
+        auto add = [&hash](uint8_t byte) {
+            hash = (hash ^ byte) * 1099511628211ULL;
+        };
+        for (int shift = 0; shift < 24; shift += 8) {
+            add(static_cast<uint8_t>(message.msgid >> shift));
+        }
+        const auto* payload = reinterpret_cast<const uint8_t*>(message.payload64);
+        for (uint8_t i = 0; i < message.len; i++) {
+            add(payload[i]);
+        }
+        return hash;
+    }
+
+    static void expire(Source &source, Clock::time_point now) {
+        while (!source.expiry.empty() && now - source.expiry.front().second >= DUPLICATE_WINDOW) {
+            auto frame = source.frames.find(source.expiry.front().first);
+            // a repetition of the payload replaced the frame and expires later
+            if (frame != source.frames.end() && frame->second.first_arrival == source.expiry.front().second) {
+                source.frames.erase(frame);
+            }
+            source.expiry.pop_front();
+        }
+    }
+
+    void receive(size_t link, mavlink_message_t &message) {
+        MessageCallback deliver;
+        {
+            std::scoped_lock lock(_mutex);
+            const auto now = Clock::now();
+            PerLinkStats &stats = _stats[link];
+            stats.rx_messages++;
+            stats.rx_bytes += message.len + FRAME_OVERHEAD_BYTES;
+
+            Source &source = _sources[static_cast<uint16_t>(message.sysid << 8 | message.compid)];
+            if (source.last_seq.empty()) {
+                source.last_seq.assign(_links.size(), -1);
+            }
+            // gaps in the sequence of a component on one link, bigger jumps are a restart
+            int &last_seq = source.last_seq[link];
+            if (last_seq >= 0) {
+                int gap = (message.seq - last_seq - 1 + 256) % 256;
+                if (gap < 128) {
+                    stats.lost += gap;
+                }
+            }
+            last_seq = message.seq;
+
+            expire(source, now);
+            const uint64_t hash = payloadHash(message);
+            const uint32_t link_bit = 1u << link;
+            auto seen = source.frames.find(hash);
+            // the same payload again on a link it already came on is a repetition, e.g. a HEARTBEAT
+            if (seen != source.frames.end() && (seen->second.links & link_bit) == 0) {
+                seen->second.links |= link_bit;
+                stats.duplicates++;
+                double lag_ms = std::chrono::duration<double, std::milli>(now - seen->second.first_arrival).count();
+                stats.lag_sum_ms += lag_ms;
+                stats.lag_max_ms = std::max(stats.lag_max_ms, lag_ms);
+                if (seen->second.seq != message.seq && !_seq_warned) {
+                    _seq_warned = true;
+                    printf("Warning: the links number the messages of %u:%u separately, loss is counted per "
+                           "link\n", message.sysid, message.compid);
+                }
+                return;
+            }
+            source.frames[hash] = {now, link_bit, message.seq};
+            source.expiry.emplace_back(hash, now);
+            stats.first++;
+            deliver = _incoming;
+        }
+        if (deliver) {
+            deliver(message);
+        }
+    }
+
+public:
+    MultiLinkTransport(std::vector<std::shared_ptr<Transport>> links) :
+          _links(std::move(links)), _stats(_links.size()), _start(Clock::now()) {
+        if (_links.size() > MAX_LINKS) {
+            throw std::invalid_argument("At most " + std::to_string(MAX_LINKS) + " links are supported");
+        }
+        for (size_t i = 0; i < _links.size(); i++) {
+            _links[i]->subscribeIncoming([this, i](mavlink_message_t &message) {
+                receive(i, message);
+            });
+        }
+    }
+
+    ~MultiLinkTransport() override {
+        for (auto &link : _links) {
+            link->subscribeIncoming(nullptr);
+        }
+    }
+
+    void send(mavlink_message_t &message) override {
+        sendVia(0, message);
+    }
+
+    void sendVia(size_t link, mavlink_message_t &message) override {
+        {
+            std::scoped_lock lock(_mutex);
+            _stats.at(link).tx_messages++;
+        }
+        _links.at(link)->send(message);
+    }
+
+    size_t linkCount() const override {
+        return _links.size();
+    }
+
+    uint8_t ourSystemId() const override {
+        return _links.front()->ourSystemId();
+    }
+
+    uint8_t ourComponentId() const override {
+        return _links.front()->ourComponentId();
+    }
+
+    void subscribeIncoming(MessageCallback callback) override {
+        std::scoped_lock lock(_mutex);
+        _incoming = std::move(callback);
+    }
+
+    void subscribeOutgoing(MessageCallback callback) override {
+        for (auto &link : _links) {
+            link->subscribeOutgoing(callback);
+        }
+    }
+
+    std::vector<PerLinkStats> linkStats() override {
+        std::scoped_lock lock(_mutex);
+        std::vector<PerLinkStats> stats = _stats;
+        double seconds = std::chrono::duration<double>(Clock::now() - _start).count();
+        for (auto &link : stats) {
+            link.seconds = seconds;
+        }
+        return stats;
+    }
+};
+
+};
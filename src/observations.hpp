@@ -0,0 +1,73 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include "gtest/gtest.h"
+#include "environment.hpp"
+#include "scheduler.hpp"
+#include "telemetry_streams.hpp"
+
+namespace RASATestingSuite {
+
+// fewer messages give no meaningful confidence interval
+static constexpr int MIN_RATE_SAMPLES = 5;
+
+/**
+ * Registers the rate measurement of a telemetry test as observation, with the values "rate",
+ * "rate_low" and "rate_high" (95% confidence interval) and "samples". The rate comes from the
+ * window the tester keeps for every stream, so the observation only waits while the window holds
+ * fewer than n_samples messages. The stream comes from the target component, unless the test
+ * config sets a component_id. The stream is provisioned with the minimal_rate of the test config,
+ * see TelemetryStreams.
+ */
+template<int MSG>
+void addRateObservation(const std::string &section, const std::string &test, int n_samples) {
+    TelemetryStreams::getInstance().add(section, test, msg_helper<MSG>::ID, msg_helper<MSG>::NAME);
+    // nothing is consumed from the queues, but a request of the same message would add a sample,
+    // so the rate observations of different messages run at the same time. The intervals are set
+    // by TelemetryStreams before the observations start and by tests that run after them.
+    Scheduler::getInstance().add(section + "." + test, {msg_helper<MSG>::NAME}, [section, test, n_samples]() {
+        auto* environment = Environment::getInstance();
+        const TestTargetAddress &target = environment->getTargetAddress();
+        const YAML::Node config = environment->getConfig({section, test});
+        const int component_id = config["component_id"].as<int>(target.component_id);
+        RateEstimate estimate = environment->getPassthroughTester()->measureRate<MSG>(
+                target.system_id, component_id, std::max(n_samples, MIN_RATE_SAMPLES),
+                TelemetryStreams::getInstance().sampleTimeoutMs(section + "." + test));
+        return ObservationValues{{"rate", estimate.rate_hz}, {"rate_low", estimate.low_hz},
+                                 {"rate_high", estimate.high_hz}, {"samples", static_cast<double>(estimate.samples)}};
+    });
+}
+
+/**
+ * Registers a MAV_CMD_REQUEST_MESSAGE for the message as observation, with the values
+ * "ack_result" and "received" (1 if the message arrived). The acknowledgement is matched by
+ * command, so requests of different commands can overlap.
+ */
+template<int MSG>
+void addRequestMessageObservation(const std::string &test) {
+    const std::set<std::string> resources = {msg_helper<MSG>::NAME,
+                                             "COMMAND_ACK:" + std::to_string(MAV_CMD_REQUEST_MESSAGE)};
+    Scheduler::getInstance().add(test, resources, []() {
+        auto* environment = Environment::getInstance();
+        auto link = environment->getPassthroughTester();
+        const TestTargetAddress &target = environment->getTargetAddress();
+        link->flush<MSG>(target);
+        auto ack = CommandClient(link).sendLong(target, MAV_CMD_REQUEST_MESSAGE,
+                                                static_cast<float>(msg_helper<MSG>::ID), NAN, NAN, NAN, NAN, NAN, NAN);
+        ObservationValues values{{"ack_result", ack.result}, {"received", 0.}};
+        try {
+            link->receive<MSG>(target, 1000);
+            values["received"] = 1.;
+        } catch (TimeoutError&) {
+        }
+        return values;
+    });
+}
+
+inline void expectRequestedMessage(const ObservationValues &values) {
+    EXPECT_EQ(values.at("ack_result"), MAV_RESULT_ACCEPTED);
+    EXPECT_EQ(values.at("received"), 1.) << "Requested message not received";
+}
+
+};
@@ -0,0 +1,237 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "passthrough_tester.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * Outcome of a parameter download: the ids by index, what was missing in the PARAM_VALUE stream
+ * answering PARAM_REQUEST_LIST and had to be read by index, and the timing.
+ */
+struct ParamDownloadResult {
+    uint16_t param_count = 0;
+    std::vector<std::string> param_ids;  // by index, empty if not received
+    std::vector<uint16_t> missing;       // indices still missing after the last attempt
+    size_t received = 0;
+    size_t duplicates = 0;
+    size_t gap_filled = 0;               // indices received only after reading them by index
+    uint64_t retries = 0;                // repeated PARAM_REQUEST_LIST and PARAM_REQUEST_READ
+    double list_ms = 0.;                 // until the PARAM_VALUE stream stopped
+    double total_ms = 0.;
+
+    bool complete() const {
+        return received == param_count && param_count > 0;
+    }
+
+    double paramsPerSecond() const {
+        return total_ms > 0. ? static_cast<double>(received) * 1000. / total_ms : 0.;
+    }
+};
+
+/**
+ * Downloads all parameters of a component the way a GCS should over a lossy link: it requests
+ * the list once, marks the indices received in a bitmap until the stream stops for the list
+ * timeout, and then reads only the missing indices with PARAM_REQUEST_READ, keeping up to depth
+ * requests outstanding. The autopilot paces the stream to its link bandwidth, so the list timeout
+ * is longer than the round trip time: list_timeout_ms, or by default LIST_TIMEOUT_FACTOR times
+ * the default receive timeout, at least MIN_LIST_TIMEOUT_MS. A read unanswered for the default
+ * timeout is sent again, up to max_attempts times per index. The _HASH_CHECK parameter of PX4 has
+ * no index and is ignored.
+ */
+class ParamDownloader {
+public:
+    static constexpr int DEFAULT_DEPTH = 8;
+    static constexpr int DEFAULT_MAX_ATTEMPTS = 5;
+    static constexpr uint32_t LIST_TIMEOUT_FACTOR = 4;
+    static constexpr uint32_t MIN_LIST_TIMEOUT_MS = 1000;
+
+private:
+    using Clock = PassthroughTester::Clock;
+
+    struct Outstanding {
+        Clock::time_point sent;
+        int attempts;
+    };
+
+    const std::shared_ptr<PassthroughTester> _link;
+    const TestTargetAddress _target;
+    const int _depth;
+    const int _max_attempts;
+    const uint32_t _list_timeout_ms;  // 0 follows the default receive timeout
+
+    std::mutex _mutex;
+    std::condition_variable _received;
+    std::vector<bool> _have;
+    ParamDownloadResult _result;
+    Clock::time_point _last_value;
+
+    void onValue(const mavlink_message_t &message, Clock::time_point arrival) {
+        if (message.msgid != msg_helper<PARAM_VALUE>::ID || message.sysid != _target.system_id ||
+            message.compid != _target.component_id) {
+            return;
+        }
+        mavlink_param_value_t value;
+        msg_helper<PARAM_VALUE>::unpack(&message, &value);
+        const std::string param_id(value.param_id, strnlen(value.param_id, sizeof(value.param_id)));
+        std::scoped_lock lock(_mutex);
+        _last_value = arrival;
+        if (_have.empty() && value.param_count > 0) {
+            _result.param_count = value.param_count;
+            _result.param_ids.resize(value.param_count);
+            _have.assign(value.param_count, false);
+        }
+        if (param_id == "_HASH_CHECK" || value.param_index >= _have.size()) {
+            return;
+        }
+        if (_have[value.param_index]) {
+            _result.duplicates++;
+        } else {
+            _have[value.param_index] = true;
+            _result.param_ids[value.param_index] = param_id;
+            _result.received++;
+        }
+        _received.notify_all();
+    }
+
+    static double since(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // called with the lock held
+    bool allReceived() const {
+        return !_have.empty() && _result.received == _have.size();
+    }
+
+    void requestList(std::unique_lock<std::mutex> &lock, std::chrono::milliseconds timeout) {
+        // the list request or the whole stream may be lost
+        for (int attempt = 0; attempt < _max_attempts && _have.empty(); attempt++) {
+            if (attempt > 0) {
+                _result.retries++;
+            }
+            lock.unlock();
+            _link->send<PARAM_REQUEST_LIST>(_target);
+            lock.lock();
+            _received.wait_for(lock, timeout, [this]() {
+                return !_have.empty();
+            });
+        }
+        // the stream ends when it is complete or pauses for the timeout
+        while (!allReceived() && !_have.empty()) {
+            const auto last = _last_value;
+            if (!_received.wait_until(lock, last + timeout, [this, last]() {
+                    return allReceived() || _last_value != last;
+                })) {
+                break;
+            }
+        }
+    }
+
+    void fillGaps(std::unique_lock<std::mutex> &lock, std::chrono::milliseconds timeout) {
+        std::vector<uint16_t> pending;
+        for (size_t index = 0; index < _have.size(); index++) {
+            if (!_have[index]) {
+                pending.push_back(static_cast<uint16_t>(index));
+            }
+        }
+        const size_t missing_after_list = pending.size();
+        std::map<uint16_t, Outstanding> outstanding;
+        size_t next = 0;
+        while (next < pending.size() || !outstanding.empty()) {
+            // answered, timed out and given up requests free their slot
+            const auto now = Clock::now();
+            std::vector<uint16_t> resend;
+            for (auto request = outstanding.begin(); request != outstanding.end();) {
+                if (_have[request->first]) {
+                    request = outstanding.erase(request);
+                } else if (now - request->second.sent >= timeout) {
+                    if (request->second.attempts >= _max_attempts) {
+                        _result.missing.push_back(request->first);
+                        request = outstanding.erase(request);
+                    } else {
+                        resend.push_back(request->first);
+                        request->second.sent = now;
+                        request->second.attempts++;
+                        _result.retries++;
+                        ++request;
+                    }
+                } else {
+                    ++request;
+                }
+            }
+            while (next < pending.size() && static_cast<int>(outstanding.size()) < _depth) {
+                const uint16_t index = pending[next++];
+                if (!_have[index]) {
+                    outstanding[index] = {now, 1};
+                    resend.push_back(index);
+                }
+            }
+            lock.unlock();
+            for (uint16_t index : resend) {
+                _link->send<PARAM_REQUEST_READ>(_target, "", static_cast<int16_t>(index));
+            }
+            lock.lock();
+            if (outstanding.empty()) {
+                continue;
+            }
+            Clock::time_point first_deadline = Clock::time_point::max();
+            for (const auto &request : outstanding) {
+                first_deadline = std::min(first_deadline, request.second.sent + timeout);
+            }
+            const size_t received = _result.received;
+            _received.wait_until(lock, first_deadline, [this, received]() {
+                return _result.received != received;
+            });
+        }
+        _result.gap_filled = missing_after_list - _result.missing.size();
+    }
+
+public:
+    ParamDownloader(std::shared_ptr<PassthroughTester> link, const TestTargetAddress &target,
+                    int depth = DEFAULT_DEPTH, int max_attempts = DEFAULT_MAX_ATTEMPTS, uint32_t list_timeout_ms = 0) :
+          _link(std::move(link)), _target(target), _depth(depth), _max_attempts(max_attempts),
+          _list_timeout_ms(list_timeout_ms) {}
+
+    ParamDownloader(const ParamDownloader&) = delete;
+    ParamDownloader& operator=(const ParamDownloader&) = delete;
+
+    /**
+     * Downloads the parameter list. Without any PARAM_VALUE the result has a param_count of 0.
+     */
+    ParamDownloadResult download() {
+        const auto start = Clock::now();
+        const auto timeout = std::chrono::milliseconds(_link->getDefaultTimeout());
+        // in vehicle time like the configured timeouts, the default timeout is in host time already
+        const auto list_timeout = std::chrono::milliseconds(
+                _list_timeout_ms > 0 ? _link->scaleTimeout(_list_timeout_ms)
+                                     : std::max(_link->scaleTimeout(MIN_LIST_TIMEOUT_MS),
+                                                LIST_TIMEOUT_FACTOR * _link->getDefaultTimeout()));
+        {
+            std::scoped_lock lock(_mutex);
+            _have.clear();
+            _result = ParamDownloadResult();
+            _last_value = start;
+        }
+        const int listener = _link->addListener([this](const mavlink_message_t &message, Clock::time_point arrival) {
+            onValue(message, arrival);
+        });
+        std::unique_lock lock(_mutex);
+        requestList(lock, list_timeout);
+        _result.list_ms = since(start);
+        fillGaps(lock, timeout);
+        _result.total_ms = since(start);
+        lock.unlock();
+        _link->removeListener(listener);
+        return _result;
+    }
+};
+
+};
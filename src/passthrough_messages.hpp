@@ -1,4 +1,6 @@
 #pragma once
+#include <map>
+#include <string>
 #include <mavsdk/mavsdk.h>
 #include <mavsdk/plugins/mavlink_passthrough/mavlink_passthrough.h>
 #include "environment.hpp"
@@ -8,6 +10,25 @@
 #define MAVLINK_MSG_TYPE(MESSAGE_SHORT) mavlink_##MESSAGE_SHORT##_t
 #define MAVLINK_MSG_ID(MESSAGE_SHORT_UC) MAVLINK_MSG_ID_##MESSAGE_SHORT_UC
 
+/**
+ * Ids of the messages listed below by name, e.g. for messages named in the test config.
+ */
+inline std::map<std::string, int>& messageIdsByName() {
+    static std::map<std::string, int> ids;
+    return ids;
+}
+
+inline bool registerMessageName(const char* name, int id) {
+    messageIdsByName().emplace(name, id);
+    return true;
+}
+
+// -1 for messages that are not listed
+inline int messageIdByName(const std::string &name) {
+    auto found = messageIdsByName().find(name);
+    return found == messageIdsByName().end() ? -1 : found->second;
+}
+
 #define USE_MESSAGE(MESSAGE_SHORT, MESSAGE_SHORT_UC) \
     static constexpr int MESSAGE_SHORT_UC = MAVLINK_MSG_ID(MESSAGE_SHORT_UC);                                                 \
     template<>                                                                                \
@@ -22,7 +43,9 @@
         static void unpack(const mavlink_message_t * msg, MAVLINK_MSG_TYPE(MESSAGE_SHORT)* result) {\
             MAVLINK_MSG_UNPACK(MESSAGE_SHORT)(msg, result);                                   \
         }                                                                                     \
-    };
+    };                                                                                        \
+    [[maybe_unused]] static const bool MESSAGE_SHORT##_name_registered =                      \
+            registerMessageName(#MESSAGE_SHORT_UC, MESSAGE_SHORT_UC);
 
 template<int MSG>
 struct msg_helper {};
@@ -75,3 +98,6 @@ USE_MESSAGE(storage_information, STORAGE_INFORMATION)
 USE_MESSAGE(camera_image_captured, CAMERA_IMAGE_CAPTURED)
 USE_MESSAGE(camera_capture_status, CAMERA_CAPTURE_STATUS)
 USE_MESSAGE(video_stream_information, VIDEO_STREAM_INFORMATION)
+USE_MESSAGE(file_transfer_protocol, FILE_TRANSFER_PROTOCOL)
+USE_MESSAGE(system_time, SYSTEM_TIME)
+USE_MESSAGE(timesync, TIMESYNC)
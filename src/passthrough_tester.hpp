@@ -1,13 +1,22 @@
 #pragma once
-#include <mavsdk/mavsdk.h>
-#include <mavsdk/plugins/mavlink_passthrough/mavlink_passthrough.h>
+#include <algorithm>
+#include <cmath>
 #include <map>
 #include <list>
 #include <mutex>
+#include <set>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <future>
+#include <thread>
 
 #include <utility>
 #include "passthrough_messages.hpp"
+#include "rate_tracker.hpp"
+#include "rtt_estimator.hpp"
+#include "source_timing.hpp"
+#include "transport.hpp"
 
 namespace RASATestingSuite {
 
@@ -21,57 +30,233 @@ public:
     TimeoutError(const std::string &msg) : std::runtime_error(msg) {}
 };
 
+struct LinkCounters {
+    uint64_t tx_messages;
+    uint64_t tx_bytes;
+    uint64_t rx_messages;
+    uint64_t rx_bytes;
+};
+
 class PassthroughTester {
+public:
+    using Clock = std::chrono::steady_clock;
+    using MessageListener = std::function<void(const mavlink_message_t&, Clock::time_point)>;
+
 private:
-    std::shared_ptr<mavsdk::MavlinkPassthrough> _passthrough;
+    std::shared_ptr<Transport> _transport;
     std::map<uint64_t, std::list<std::shared_ptr<std::promise<mavlink_message_t>>>> _promise_map;
     std::map<uint64_t, std::list<mavlink_message_t>> _message_queue_map;
+    // receivers waiting for a specific message, served before the promises and the queue
+    struct FilteredWaiter {
+        std::function<bool(const mavlink_message_t&)> predicate;
+        std::shared_ptr<std::promise<mavlink_message_t>> promise;
+    };
+    std::map<uint64_t, std::list<FilteredWaiter>> _filtered_waiters;
     std::mutex _map_mutex;
 
-    void passthroughIntercept(mavlink_message_t &message) {
-        std::scoped_lock lock(_map_mutex);
-        uint64_t hash = recMessageHash(message.msgid, message.sysid, message.compid);
-        if ((_promise_map[hash]).empty()) {
-            (_message_queue_map[hash]).push_back(message);
-        } else {
-            for (auto &prom : _promise_map[hash]) {
-                prom->set_value(message);
+    // MAVLink 2 header and checksum, payload length is taken from the message
+    static constexpr uint64_t FRAME_OVERHEAD_BYTES = 12;
+    std::atomic<uint64_t> _tx_messages{0};
+    std::atomic<uint64_t> _tx_bytes{0};
+    std::atomic<uint64_t> _rx_messages{0};
+    std::atomic<uint64_t> _rx_bytes{0};
+    std::map<uint32_t, uint64_t> _tx_count_by_id;
+    std::map<uint32_t, uint64_t> _rx_count_by_id;
+    std::mutex _count_mutex;
+
+    // rates of all streams on the link, see measureRate
+    RateTracker _rates;
+    SourceTimingTracker _source_timing;
+
+    // TIMESYNC requests waiting for the reply, by the host time sent in ts1
+    ClockSync _clock_sync;
+    std::set<int64_t> _pending_timesyncs;
+    static constexpr size_t MAX_PENDING_TIMESYNCS = 16;
+
+    std::map<int, MessageListener> _listeners;
+    int _next_listener_id = 0;
+    std::mutex _listener_mutex;
+
+    // vehicle time per host time, timeouts given in vehicle time are divided by it
+    std::atomic<double> _time_scale{1.};
+    static constexpr uint32_t MIN_SCALED_TIMEOUT_MS = 20;
+
+    // the default receive timeout follows the round trip time, unless a fixed one is set
+    static constexpr double MIN_ADAPTIVE_TIMEOUT_MS = 50.;
+    static constexpr double MAX_ADAPTIVE_TIMEOUT_MS = 3000.;
+    RttEstimator _rtt;
+    std::atomic<uint32_t> _fixed_default_timeout_ms{0};
+
+    // PINGs sent to measure the round trip time have this bit set in the sequence number, their
+    // replies are consumed by the tester and never reach the tests
+    static constexpr uint32_t RTT_PROBE_SEQ_FLAG = 0x80000000u;
+    static constexpr auto RTT_PROBE_EXPIRY = std::chrono::seconds(10);
+    uint32_t _next_probe_seq = 0;
+    std::map<uint32_t, Clock::time_point> _pending_probes;
+
+    // commands waiting for their first COMMAND_ACK; retransmitted ones give no sample (Karn)
+    struct PendingCommand {
+        Clock::time_point sent;
+        bool retransmitted;
+    };
+    std::map<uint16_t, PendingCommand> _pending_commands;
+    std::mutex _rtt_mutex;
+
+    // called with _rtt_mutex held; commands unanswered for the longest timeout give no sample
+    void expireCommands(Clock::time_point now) {
+        const auto max_age = std::chrono::duration<double, std::milli>(MAX_ADAPTIVE_TIMEOUT_MS);
+        for (auto pending = _pending_commands.begin(); pending != _pending_commands.end();) {
+            if (now - pending->second.sent > max_age) {
+                pending = _pending_commands.erase(pending);
+            } else {
+                ++pending;
             }
-            (_promise_map[hash]).clear();
         }
     }
 
-    static uint64_t recMessageHash(uint32_t message_id, uint8_t sys_id, uint8_t comp_id) {
-        return (static_cast<uint64_t>(message_id) << 16u) |
-               (static_cast<uint64_t>(sys_id) << 8u) |
-               (static_cast<uint64_t>(comp_id));
+    void trackCommand(uint16_t command) {
+        std::scoped_lock lock(_rtt_mutex);
+        expireCommands(Clock::now());
+        auto pending = _pending_commands.find(command);
+        if (pending != _pending_commands.end()) {
+            pending->second.retransmitted = true;
+        } else {
+            _pending_commands[command] = {Clock::now(), false};
+        }
     }
 
-
-public:
-    PassthroughTester(std::shared_ptr<mavsdk::MavlinkPassthrough> passthrough) : _passthrough(std::move(passthrough)) {
-        _passthrough->intercept_incoming_messages_async([this](mavlink_message_t &message) {
-            passthroughIntercept(message);
+    // returns false if the ack is addressed to someone else, e.g. a component worker sharing the link
+    bool onCommandAck(const mavlink_message_t &message, Clock::time_point arrival) {
+        msg_helper<COMMAND_ACK>::decode_type ack;
+        msg_helper<COMMAND_ACK>::unpack(&message, &ack);
+        // older autopilots leave the target 0
+        if ((ack.target_system != 0 && ack.target_system != _transport->ourSystemId()) ||
+            (ack.target_component != 0 && ack.target_component != _transport->ourComponentId())) {
+            return false;
+        }
+        std::scoped_lock lock(_rtt_mutex);
+        expireCommands(arrival);
+        auto pending = _pending_commands.find(ack.command);
+        if (pending == _pending_commands.end()) {
             return true;
-        });
+        }
+        if (!pending->second.retransmitted) {
+            _rtt.addSample(std::chrono::duration<double, std::milli>(arrival - pending->second.sent).count());
+        }
+        _pending_commands.erase(pending);
+        return true;
     }
 
-    template<int MSG, typename... Args>
-    void send(const TestTargetAddress& target, Args... args) {
-        send<MSG>(target.system_id, target.component_id, args...);
+    // returns true if the message is the reply to one of our probes
+    bool onPing(const mavlink_message_t &message, Clock::time_point arrival) {
+        msg_helper<PING>::decode_type ping;
+        msg_helper<PING>::unpack(&message, &ping);
+        if ((ping.seq & RTT_PROBE_SEQ_FLAG) == 0 || ping.target_system != _transport->ourSystemId()) {
+            return false;
+        }
+        std::scoped_lock lock(_rtt_mutex);
+        // several components may answer, the first reply counts
+        auto pending = _pending_probes.find(ping.seq);
+        if (pending != _pending_probes.end()) {
+            _rtt.addSample(std::chrono::duration<double, std::milli>(arrival - pending->second).count());
+            _pending_probes.erase(pending);
+        }
+        return true;
     }
 
-    template<int MSG, typename... Args>
-    void send(Args... args) {
-        mavlink_message_t msg;
-        msg_helper<MSG>::pack(_passthrough->get_our_sysid(), _passthrough->get_our_compid(), &msg, args...);
-        _passthrough->send_message(msg);
+    void countOutgoing(const mavlink_message_t &message) {
+        _tx_messages++;
+        _tx_bytes += message.len + FRAME_OVERHEAD_BYTES;
+        {
+            std::scoped_lock lock(_count_mutex);
+            _tx_count_by_id[message.msgid]++;
+        }
+        if (message.msgid == msg_helper<COMMAND_LONG>::ID) {
+            msg_helper<COMMAND_LONG>::decode_type command;
+            msg_helper<COMMAND_LONG>::unpack(&message, &command);
+            trackCommand(command.command);
+        } else if (message.msgid == msg_helper<COMMAND_INT>::ID) {
+            msg_helper<COMMAND_INT>::decode_type command;
+            msg_helper<COMMAND_INT>::unpack(&message, &command);
+            trackCommand(command.command);
+        }
+    }
+
+    void passthroughIntercept(mavlink_message_t &message, Clock::time_point arrival) {
+        {
+            std::scoped_lock listener_lock(_listener_mutex);
+            for (auto &listener : _listeners) {
+                listener.second(message, arrival);
+            }
+        }
+        _rx_messages++;
+        _rx_bytes += message.len + FRAME_OVERHEAD_BYTES;
+        {
+            std::scoped_lock count_lock(_count_mutex);
+            _rx_count_by_id[message.msgid]++;
+        }
+        uint64_t hash = recMessageHash(message.msgid, message.sysid, message.compid);
+        _rates.add(hash, arrival);
+        _source_timing.add(hash, message, arrival, _time_scale, _clock_sync);
+        if (message.msgid == msg_helper<COMMAND_ACK>::ID) {
+            if (!onCommandAck(message, arrival)) {
+                return;
+            }
+        } else if (message.msgid == msg_helper<PING>::ID && onPing(message, arrival)) {
+            return;
+        } else if (message.msgid == msg_helper<TIMESYNC>::ID && onTimesync(message, arrival)) {
+            return;
+        }
+        std::scoped_lock lock(_map_mutex);
+        auto filtered = _filtered_waiters.find(hash);
+        if (filtered != _filtered_waiters.end()) {
+            for (auto it = filtered->second.begin(); it != filtered->second.end(); ++it) {
+                if (it->predicate(message)) {
+                    it->promise->set_value(message);
+                    filtered->second.erase(it);
+                    return;
+                }
+            }
+        }
+        if ((_promise_map[hash]).empty()) {
+            (_message_queue_map[hash]).push_back(message);
+        } else {
+            for (auto &prom : _promise_map[hash]) {
+                prom->set_value(message);
+            }
+            (_promise_map[hash]).clear();
+        }
     }
 
+    // returns true if the message is the reply to one of our TIMESYNC requests
+    bool onTimesync(const mavlink_message_t &message, Clock::time_point arrival) {
+        msg_helper<TIMESYNC>::decode_type timesync;
+        msg_helper<TIMESYNC>::unpack(&message, &timesync);
+        if (timesync.tc1 == 0) {
+            return false;  // a request of the vehicle
+        }
+        {
+            std::scoped_lock lock(_rtt_mutex);
+            if (_pending_timesyncs.erase(timesync.ts1) == 0) {
+                return false;
+            }
+        }
+        _clock_sync.addSample(static_cast<double>(timesync.ts1) / 1e6, static_cast<double>(timesync.tc1) / 1e6,
+                              ClockSync::hostMs(arrival));
+        return true;
+    }
 
+    // timeout of the receive functions called without one, in host time
+    uint32_t defaultTimeout() const {
+        const uint32_t fixed = _fixed_default_timeout_ms;
+        if (fixed > 0) {
+            return scaleTimeout(fixed);
+        }
+        return static_cast<uint32_t>(std::ceil(_rtt.timeoutMs()));
+    }
 
     template<int MSG>
-    typename msg_helper<MSG>::decode_type receive(uint8_t src_sysid, uint8_t src_compid, uint32_t timeout_ms) {
+    typename msg_helper<MSG>::decode_type receiveWithin(uint8_t src_sysid, uint8_t src_compid, uint32_t wait_ms) {
         uint64_t hash = recMessageHash(msg_helper<MSG>::ID, src_sysid, src_compid);
         mavlink_message_t msg;
         {
@@ -82,9 +267,10 @@ public:
                 auto fut = prom->get_future();
                 (_promise_map[hash]).push_back(prom);
                 lock.unlock();
-                if (fut.wait_for(std::chrono::milliseconds(timeout_ms)) == std::future_status::timeout) {
+                if (fut.wait_for(std::chrono::milliseconds(wait_ms)) == std::future_status::timeout) {
                     lock.lock();
-                    (_promise_map[hash]).clear();
+                    // other receivers of the same message may still be waiting
+                    (_promise_map[hash]).remove(prom);
                     lock.unlock();
                     throw TimeoutError("Message receive timeout for message " + std::string(msg_helper<MSG>::NAME));
                 }
@@ -100,9 +286,241 @@ public:
         return decoded_data;
     }
 
+    template<int MSG>
+    typename msg_helper<MSG>::decode_type receiveIfWithin(const TestTargetAddress& target, uint32_t wait_ms,
+                                                          const std::function<bool(const typename msg_helper<MSG>::decode_type&)> &condition) {
+        uint64_t hash = recMessageHash(msg_helper<MSG>::ID, target.system_id, target.component_id);
+        auto matches = [condition](const mavlink_message_t &message) {
+            typename msg_helper<MSG>::decode_type decoded;
+            msg_helper<MSG>::unpack(&message, &decoded);
+            return condition(decoded);
+        };
+        mavlink_message_t msg;
+        {
+            std::unique_lock lock(_map_mutex);
+            auto &queue = _message_queue_map[hash];
+            auto queued = std::find_if(queue.begin(), queue.end(), matches);
+            if (queued != queue.end()) {
+                msg = *queued;
+                queue.erase(queued);
+            } else {
+                auto prom = std::make_shared<std::promise<mavlink_message_t>>();
+                auto fut = prom->get_future();
+                _filtered_waiters[hash].push_back({matches, prom});
+                lock.unlock();
+                if (fut.wait_for(std::chrono::milliseconds(wait_ms)) == std::future_status::timeout) {
+                    lock.lock();
+                    auto &waiters = _filtered_waiters[hash];
+                    waiters.remove_if([&prom](const FilteredWaiter &waiter) { return waiter.promise == prom; });
+                    // the message may have arrived just before removing the waiter
+                    if (fut.wait_for(std::chrono::milliseconds(0)) == std::future_status::timeout) {
+                        throw TimeoutError("Message receive timeout for message " + std::string(msg_helper<MSG>::NAME));
+                    }
+                }
+                msg = fut.get();
+            }
+        }
+        typename msg_helper<MSG>::decode_type decoded_data;
+        msg_helper<MSG>::unpack(&msg, &decoded_data);
+        return decoded_data;
+    }
+
+    template<int MSG>
+    typename msg_helper<MSG>::decode_type retrying(const std::function<typename msg_helper<MSG>::decode_type()> &receive_once,
+                                                   int max_attempts, const std::function<void()> &resend) {
+        for (int attempt = 1;; attempt++) {
+            try {
+                return receive_once();
+            } catch (TimeoutError&) {
+                if (attempt >= max_attempts) {
+                    throw;
+                }
+                resend();
+            }
+        }
+    }
+
+    // waiters dropped by a flush time out instead of taking a later message, called with _map_mutex held
+    static void releaseFilteredWaiters(std::list<FilteredWaiter> &waiters) {
+        for (auto &waiter : waiters) {
+            waiter.promise->set_exception(std::make_exception_ptr(TimeoutError("Receive interrupted by a flush")));
+        }
+        waiters.clear();
+    }
+
+    static uint64_t recMessageHash(uint32_t message_id, uint8_t sys_id, uint8_t comp_id) {
+        return (static_cast<uint64_t>(message_id) << 16u) |
+               (static_cast<uint64_t>(sys_id) << 8u) |
+               (static_cast<uint64_t>(comp_id));
+    }
+
+
+public:
+    // default receive timeout until the round trip time has been measured
+    static constexpr uint32_t DEFAULT_TIMEOUT_MS = 100;
+
+    PassthroughTester(std::shared_ptr<Transport> transport) :
+          _transport(std::move(transport)),
+          _rtt(DEFAULT_TIMEOUT_MS, MIN_ADAPTIVE_TIMEOUT_MS, MAX_ADAPTIVE_TIMEOUT_MS) {
+        _transport->subscribeIncomingTimed([this](mavlink_message_t &message, Clock::time_point arrival) {
+            passthroughIntercept(message, arrival);
+        });
+        // counts everything sent on the link, including the traffic of the MAVSDK plugins
+        _transport->subscribeOutgoing([this](mavlink_message_t &message) {
+            countOutgoing(message);
+        });
+    }
+
+    /**
+     * Registers a function called with every incoming message and its arrival time, before the
+     * message is queued. Listeners run on the receive thread and must not block.
+     */
+    int addListener(MessageListener listener) {
+        std::scoped_lock lock(_listener_mutex);
+        _listeners[_next_listener_id] = std::move(listener);
+        return _next_listener_id++;
+    }
+
+    void removeListener(int listener_id) {
+        std::scoped_lock lock(_listener_mutex);
+        _listeners.erase(listener_id);
+    }
+
+    /**
+     * Sets how fast the vehicle runs compared to the host, e.g. a simulation running at twice
+     * real time has a scale of 2. All receive timeouts are given in vehicle time.
+     */
+    void setTimeScale(double scale) {
+        _time_scale = scale;
+    }
+
+    uint32_t scaleTimeout(uint32_t timeout_ms) const {
+        double scaled = static_cast<double>(timeout_ms) / _time_scale;
+        return std::max(std::min(timeout_ms, MIN_SCALED_TIMEOUT_MS), static_cast<uint32_t>(scaled));
+    }
+
+    /**
+     * Uses a fixed default receive timeout in vehicle time instead of the measured round trip
+     * time, 0 switches back to the measured one.
+     */
+    void setDefaultTimeout(uint32_t timeout_ms) {
+        _fixed_default_timeout_ms = timeout_ms;
+    }
+
+    uint32_t getDefaultTimeout() const {
+        return defaultTimeout();
+    }
+
+    /**
+     * Sends a PING to measure the round trip time. The reply is consumed by the tester. The
+     * round trip time is also measured from the COMMAND_ACK of every command sent on the link.
+     */
+    void sendRttProbe() {
+        const auto now = Clock::now();
+        uint32_t seq;
+        {
+            std::scoped_lock lock(_rtt_mutex);
+            seq = RTT_PROBE_SEQ_FLAG | (_next_probe_seq++ & ~RTT_PROBE_SEQ_FLAG);
+            for (auto it = _pending_probes.begin(); it != _pending_probes.end();) {
+                it = now - it->second > RTT_PROBE_EXPIRY ? _pending_probes.erase(it) : std::next(it);
+            }
+            _pending_probes[seq] = now;
+        }
+        uint64_t time_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        send<PING>(time_usec, seq, 0, 0);
+    }
+
+    const RttEstimator& getRttEstimator() const {
+        return _rtt;
+    }
+
+    /**
+     * Sends a TIMESYNC request with the host time, the reply updates the clock offset estimate.
+     */
+    void sendTimesync() {
+        const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+        {
+            std::scoped_lock lock(_rtt_mutex);
+            if (_pending_timesyncs.size() >= MAX_PENDING_TIMESYNCS) {
+                _pending_timesyncs.erase(_pending_timesyncs.begin());
+            }
+            _pending_timesyncs.insert(now_ns);
+        }
+        // encoded from the struct, as the target fields only exist in newer MAVLink versions
+        msg_helper<TIMESYNC>::decode_type timesync{};
+        timesync.tc1 = 0;
+        timesync.ts1 = now_ns;
+        mavlink_message_t msg;
+        mavlink_msg_timesync_encode(_transport->ourSystemId(), _transport->ourComponentId(), &msg, &timesync);
+        _transport->send(msg);
+    }
+
+    const ClockSync& getClockSync() const {
+        return _clock_sync;
+    }
+
+    /**
+     * Age of the samples of a stream on arrival, since the last resetMessageAges.
+     */
+    MessageAge getMessageAge(uint32_t message_id, uint8_t src_sysid, uint8_t src_compid) const {
+        return _source_timing.age(recMessageHash(message_id, src_sysid, src_compid));
+    }
+
+    void resetMessageAges() {
+        _source_timing.resetAges();
+    }
+
+    template<int MSG, typename... Args>
+    void send(const TestTargetAddress& target, Args... args) {
+        send<MSG>(target.system_id, target.component_id, args...);
+    }
+
+    template<int MSG, typename... Args>
+    void send(Args... args) {
+        mavlink_message_t msg;
+        msg_helper<MSG>::pack(_transport->ourSystemId(), _transport->ourComponentId(), &msg, args...);
+        _transport->send(msg);
+    }
+
+    /**
+     * Sends on one of several links to the vehicle, link 0 is the one send uses.
+     */
+    template<int MSG, typename... Args>
+    void sendVia(size_t link, const TestTargetAddress& target, Args... args) {
+        sendVia<MSG>(link, target.system_id, target.component_id, args...);
+    }
+
+    template<int MSG, typename... Args>
+    void sendVia(size_t link, Args... args) {
+        mavlink_message_t msg;
+        msg_helper<MSG>::pack(_transport->ourSystemId(), _transport->ourComponentId(), &msg, args...);
+        _transport->sendVia(link, msg);
+    }
+
+    size_t linkCount() const {
+        return _transport->linkCount();
+    }
+
+    // per link statistics when connected over several links, see MultiLinkTransport
+    std::vector<PerLinkStats> getLinkStats() {
+        return _transport->linkStats();
+    }
+
+
+
+    /**
+     * Receives the next message of the type from the given component. The timeout is in vehicle
+     * time; without one, the tester waits for the round trip time plus its variation.
+     */
+    template<int MSG>
+    typename msg_helper<MSG>::decode_type receive(uint8_t src_sysid, uint8_t src_compid, uint32_t timeout_ms) {
+        return receiveWithin<MSG>(src_sysid, src_compid, scaleTimeout(timeout_ms));
+    }
+
     template<int MSG>
     typename msg_helper<MSG>::decode_type receive(uint8_t src_sysid, uint8_t src_compid) {
-        return receive<MSG>(src_sysid, src_compid, 100);
+        return receiveWithin<MSG>(src_sysid, src_compid, defaultTimeout());
     }
 
     template<int MSG>
@@ -115,6 +533,50 @@ public:
         return receive<MSG>(target.system_id, target.component_id);
     }
 
+    /**
+     * Receives the first message of the type that matches the condition. Unlike receive, it
+     * leaves other messages of the type to concurrent receivers, e.g. the COMMAND_ACK of another
+     * command.
+     */
+    template<int MSG>
+    typename msg_helper<MSG>::decode_type receiveIf(const TestTargetAddress& target, uint32_t timeout_ms,
+                                                    const std::function<bool(const typename msg_helper<MSG>::decode_type&)> &condition) {
+        return receiveIfWithin<MSG>(target, scaleTimeout(timeout_ms), condition);
+    }
+
+    template<int MSG>
+    typename msg_helper<MSG>::decode_type receiveIf(const TestTargetAddress& target,
+                                                    const std::function<bool(const typename msg_helper<MSG>::decode_type&)> &condition) {
+        return receiveIfWithin<MSG>(target, defaultTimeout(), condition);
+    }
+
+    /**
+     * Like receiveIf with the default timeout, multiplied by timeout_factor, e.g. doubled on
+     * every retransmission so that a link slower than measured is not flooded.
+     */
+    template<int MSG>
+    typename msg_helper<MSG>::decode_type receiveIfBackingOff(const TestTargetAddress& target, double timeout_factor,
+                                                              const std::function<bool(const typename msg_helper<MSG>::decode_type&)> &condition) {
+        return receiveIfWithin<MSG>(target, static_cast<uint32_t>(defaultTimeout() * timeout_factor), condition);
+    }
+
+    /**
+     * Receives a message, calling resend after every timeout and waiting again, at most
+     * max_attempts times in total. This is how the MAVLink microservices recover from lost
+     * messages; the retransmission is reported to resend so that it can be counted.
+     */
+    template<int MSG>
+    typename msg_helper<MSG>::decode_type receiveRetrying(const TestTargetAddress& target, uint32_t timeout_ms,
+                                                          int max_attempts, const std::function<void()> &resend) {
+        return retrying<MSG>([&]() { return receive<MSG>(target, timeout_ms); }, max_attempts, resend);
+    }
+
+    template<int MSG>
+    typename msg_helper<MSG>::decode_type receiveRetrying(const TestTargetAddress& target, int max_attempts,
+                                                          const std::function<void()> &resend) {
+        return retrying<MSG>([&]() { return receive<MSG>(target); }, max_attempts, resend);
+    }
+
 
 
     /**
@@ -143,12 +605,73 @@ public:
         return expectCondition<MSG>(target.system_id, target.component_id, observe_n, inidividual_timeout, condition);
     }
 
+    /**
+     * Rate of a stream from the arrivals tracked since the link came up (see RateTracker). Only
+     * waits while fewer than min_samples messages are in the window; throws a TimeoutError if no
+     * message arrives within sample_timeout_ms (vehicle time). A stream too slow to fill the
+     * window with min_samples is measured from the samples it has after min_samples timeouts,
+     * and fails with a TimeoutError if there are fewer than two.
+     */
+    template<int MSG>
+    RateEstimate measureRate(uint8_t src_sysid, uint8_t src_compid, size_t min_samples, uint32_t sample_timeout_ms) {
+        const uint64_t hash = recMessageHash(msg_helper<MSG>::ID, src_sysid, src_compid);
+        const size_t required = std::clamp<size_t>(min_samples, 2, RateTracker::MAX_SAMPLES);
+        const auto sample_timeout = std::chrono::milliseconds(scaleTimeout(sample_timeout_ms));
+        const auto start = Clock::now();
+        const auto deadline = start + sample_timeout * required;
+        while (true) {
+            RateEstimate estimate = _rates.estimate(hash);
+            if (estimate.samples >= required || (Clock::now() > deadline && estimate.samples >= 2)) {
+                return estimate;
+            }
+            if (std::min(_rates.sinceLast(hash), Clock::now() - start) > sample_timeout || Clock::now() > deadline) {
+                throw TimeoutError("Message receive timeout for message " + std::string(msg_helper<MSG>::NAME));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    template<int MSG>
+    RateEstimate measureRate(const TestTargetAddress& target, size_t min_samples, uint32_t sample_timeout_ms) {
+        return measureRate<MSG>(target.system_id, target.component_id, min_samples, sample_timeout_ms);
+    }
+
+    // rate of a stream from the arrivals in the window so far, without waiting
+    RateEstimate getRate(uint32_t message_id, uint8_t src_sysid, uint8_t src_compid) {
+        return _rates.estimate(recMessageHash(message_id, src_sysid, src_compid));
+    }
+
+    // inter-arrival times of a stream since the link came up, in host time
+    IntervalStats getIntervalStats(uint32_t message_id, uint8_t src_sysid, uint8_t src_compid) const {
+        return _rates.intervals(recMessageHash(message_id, src_sysid, src_compid));
+    }
+
+    template<int MSG>
+    IntervalStats getIntervalStats(uint8_t src_sysid, uint8_t src_compid) const {
+        return getIntervalStats(msg_helper<MSG>::ID, src_sysid, src_compid);
+    }
+
+    /**
+     * Forgets the tracked arrivals of a stream, e.g. after changing its rate.
+     */
+    void resetRate(uint32_t message_id, uint8_t src_sysid, uint8_t src_compid) {
+        _rates.reset(recMessageHash(message_id, src_sysid, src_compid));
+        _source_timing.reset(recMessageHash(message_id, src_sysid, src_compid));
+    }
+
+    // timing by the source timestamps of a stream since the link came up, see SourceTimingTracker
+    template<int MSG>
+    SourceTiming getSourceTiming(uint8_t src_sysid, uint8_t src_compid) const {
+        return _source_timing.timing(recMessageHash(msg_helper<MSG>::ID, src_sysid, src_compid));
+    }
+
     template<int MSG>
     void flush(uint8_t src_sysid, uint8_t src_compid) {
         uint64_t hash = recMessageHash(msg_helper<MSG>::ID, src_sysid, src_compid);
         std::scoped_lock lock{_map_mutex};
         (_promise_map[hash]).clear();
         (_message_queue_map[hash]).clear();
+        releaseFilteredWaiters(_filtered_waiters[hash]);
     }
 
     template<int MSG>
@@ -156,14 +679,62 @@ public:
         flush<MSG>(target.system_id, target.component_id);
     }
 
+    /**
+     * Drops the queued messages of the type that match the condition, e.g. the stale COMMAND_ACKs
+     * of one command, and leaves the others to their receivers. Returns how many were dropped.
+     */
+    template<int MSG>
+    size_t flushIf(const TestTargetAddress& target,
+                   const std::function<bool(const typename msg_helper<MSG>::decode_type&)> &condition) {
+        uint64_t hash = recMessageHash(msg_helper<MSG>::ID, target.system_id, target.component_id);
+        std::scoped_lock lock{_map_mutex};
+        auto &queue = _message_queue_map[hash];
+        const size_t queued = queue.size();
+        queue.remove_if([&condition](const mavlink_message_t &message) {
+            typename msg_helper<MSG>::decode_type decoded;
+            msg_helper<MSG>::unpack(&message, &decoded);
+            return condition(decoded);
+        });
+        return queued - queue.size();
+    }
+
     void flushAll() {
         std::scoped_lock lock{_map_mutex};
         _promise_map.clear();
         _message_queue_map.clear();
+        for (auto &waiters : _filtered_waiters) {
+            releaseFilteredWaiters(waiters.second);
+        }
+        _filtered_waiters.clear();
+    }
+
+    // messages received but not consumed by a test yet
+    size_t getQueuedMessages() {
+        std::scoped_lock lock{_map_mutex};
+        size_t queued = 0;
+        for (const auto &queue : _message_queue_map) {
+            queued += queue.second.size();
+        }
+        return queued;
+    }
+
+    LinkCounters getCounters() const {
+        return {_tx_messages, _tx_bytes, _rx_messages, _rx_bytes};
+    }
+
+    uint64_t getTxCount(uint32_t message_id) {
+        std::scoped_lock lock(_count_mutex);
+        return _tx_count_by_id[message_id];
+    }
+
+    uint64_t getRxCount(uint32_t message_id) {
+        std::scoped_lock lock(_count_mutex);
+        return _rx_count_by_id[message_id];
     }
 
     ~PassthroughTester() {
-        _passthrough->intercept_incoming_messages_async(nullptr);
+        _transport->subscribeIncomingTimed(nullptr);
+        _transport->subscribeOutgoing(nullptr);
     }
 
 };
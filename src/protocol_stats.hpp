@@ -0,0 +1,72 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include "gtest/gtest.h"
+#include "passthrough_tester.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * Measures one protocol transaction (mission upload, parameter list, file transfer) of a test:
+ * completion time, retries and the effective throughput on the link. The result is printed and
+ * recorded as test properties, so it ends up in the gtest XML output for comparing link setups.
+ */
+class ProtocolStats {
+private:
+    const std::string _name;
+    const std::shared_ptr<PassthroughTester> _link;
+    const LinkCounters _start_counters;
+    const std::chrono::steady_clock::time_point _start;
+    uint64_t _retries = 0;
+    uint64_t _payload_bytes = 0;
+    bool _finished = false;
+
+public:
+    ProtocolStats(std::string name, std::shared_ptr<PassthroughTester> link) :
+          _name(std::move(name)), _link(std::move(link)), _start_counters(_link->getCounters()),
+          _start(std::chrono::steady_clock::now()) {}
+
+    void addRetry() {
+        _retries++;
+    }
+
+    void addRetries(uint64_t retries) {
+        _retries += retries;
+    }
+
+    /**
+     * Useful data transferred by the protocol, e.g. the file size. Without it, the throughput is
+     * computed from all MAVLink traffic during the transaction.
+     */
+    void addPayloadBytes(uint64_t bytes) {
+        _payload_bytes += bytes;
+    }
+
+    void finish() {
+        if (_finished) {
+            return;
+        }
+        _finished = true;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+        LinkCounters end_counters = _link->getCounters();
+        uint64_t link_bytes = (end_counters.tx_bytes - _start_counters.tx_bytes) +
+                              (end_counters.rx_bytes - _start_counters.rx_bytes);
+        uint64_t bytes = _payload_bytes > 0 ? _payload_bytes : link_bytes;
+        double throughput = seconds > 0. ? static_cast<double>(bytes) / seconds : 0.;
+
+        printf("%s: %.3f s, %lu retries, %.1f B/s effective (%lu link bytes)\n", _name.c_str(), seconds,
+               static_cast<unsigned long>(_retries), throughput, static_cast<unsigned long>(link_bytes));
+        ::testing::Test::RecordProperty(_name + "_time_ms", static_cast<int>(seconds * 1000.));
+        ::testing::Test::RecordProperty(_name + "_retries", static_cast<int>(_retries));
+        ::testing::Test::RecordProperty(_name + "_throughput_Bps", static_cast<int>(throughput));
+    }
+
+    ~ProtocolStats() {
+        // also report transactions aborted by a failed assertion or an exception
+        finish();
+    }
+};
+
+};
@@ -0,0 +1,130 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include "statistics.hpp"
+
+namespace RASATestingSuite {
+
+struct RateEstimate {
+    double rate_hz = 0.;
+    // 95% confidence interval of the rate, from the spread of the intervals
+    double low_hz = 0.;
+    double high_hz = 0.;
+    size_t samples = 0;
+    double span_s = 0.;
+};
+
+/**
+ * Inter-arrival times of a stream since the link came up, or since the stream was reset.
+ */
+struct IntervalStats {
+    LogHistogram histogram_ms;
+    double max_gap_ms = 0.;
+};
+
+/**
+ * Arrival times of every stream on the link in a sliding window, from the moment the link comes
+ * up. A rate is then known as soon as it is asked for, instead of being measured from scratch.
+ * The window keeps the last WINDOW of arrivals, at most MAX_SAMPLES per stream. The intervals
+ * between arrivals are also kept in a histogram over the whole run, to find gaps and bursts.
+ */
+class RateTracker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto WINDOW = std::chrono::seconds(10);
+    static constexpr size_t MAX_SAMPLES = 512;
+
+private:
+    static constexpr double Z_95 = 1.96;
+
+    struct Stream {
+        std::deque<Clock::time_point> arrivals;
+        IntervalStats intervals;
+    };
+
+    std::map<uint64_t, Stream> _streams;
+    mutable std::mutex _mutex;
+
+    static void expire(std::deque<Clock::time_point> &arrivals, Clock::time_point now) {
+        while (!arrivals.empty() && (now - arrivals.front() > WINDOW || arrivals.size() > MAX_SAMPLES)) {
+            arrivals.pop_front();
+        }
+    }
+
+public:
+    void add(uint64_t stream, Clock::time_point arrival) {
+        std::scoped_lock lock(_mutex);
+        Stream &tracked = _streams[stream];
+        if (!tracked.arrivals.empty()) {
+            double interval_ms = std::chrono::duration<double, std::milli>(arrival - tracked.arrivals.back()).count();
+            tracked.intervals.histogram_ms.add(interval_ms);
+            tracked.intervals.max_gap_ms = std::max(tracked.intervals.max_gap_ms, interval_ms);
+        }
+        tracked.arrivals.push_back(arrival);
+        expire(tracked.arrivals, arrival);
+    }
+
+    /**
+     * Forgets the arrivals of a stream, e.g. after its rate was changed.
+     */
+    void reset(uint64_t stream) {
+        std::scoped_lock lock(_mutex);
+        _streams.erase(stream);
+    }
+
+    RateEstimate estimate(uint64_t stream) {
+        std::scoped_lock lock(_mutex);
+        RateEstimate estimate;
+        auto found = _streams.find(stream);
+        if (found == _streams.end()) {
+            return estimate;
+        }
+        auto &arrivals = found->second.arrivals;
+        expire(arrivals, Clock::now());
+        estimate.samples = arrivals.size();
+        if (arrivals.size() < 2) {
+            return estimate;
+        }
+        const double intervals = static_cast<double>(arrivals.size() - 1);
+        estimate.span_s = std::chrono::duration<double>(arrivals.back() - arrivals.front()).count();
+        if (estimate.span_s <= 0.) {
+            return estimate;
+        }
+        const double mean_interval = estimate.span_s / intervals;
+        double sum_squares = 0.;
+        for (size_t i = 1; i < arrivals.size(); i++) {
+            double deviation = std::chrono::duration<double>(arrivals[i] - arrivals[i - 1]).count() - mean_interval;
+            sum_squares += deviation * deviation;
+        }
+        const double stddev = arrivals.size() > 2 ? std::sqrt(sum_squares / (intervals - 1.)) : mean_interval;
+        const double margin = Z_95 * stddev / std::sqrt(intervals);
+        estimate.rate_hz = 1. / mean_interval;
+        estimate.low_hz = 1. / (mean_interval + margin);
+        estimate.high_hz = mean_interval > margin ? 1. / (mean_interval - margin) : INFINITY;
+        return estimate;
+    }
+
+    // time since the last message of the stream, or max() if none is in the window
+    Clock::duration sinceLast(uint64_t stream) const {
+        std::scoped_lock lock(_mutex);
+        auto found = _streams.find(stream);
+        if (found == _streams.end() || found->second.arrivals.empty()) {
+            return Clock::duration::max();
+        }
+        return Clock::now() - found->second.arrivals.back();
+    }
+
+    IntervalStats intervals(uint64_t stream) const {
+        std::scoped_lock lock(_mutex);
+        auto found = _streams.find(stream);
+        return found == _streams.end() ? IntervalStats{} : found->second.intervals;
+    }
+};
+
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+
+namespace RASATestingSuite {
+
+/**
+ * Smoothed round trip time and its variation, computed like the TCP retransmission timeout
+ * (RFC 6298): the timeout is the smoothed round trip time plus four times its mean deviation,
+ * so it follows a slow radio link as well as localhost. Until the first sample arrives, the
+ * timeout is the initial one.
+ */
+class RttEstimator {
+private:
+    static constexpr double ALPHA = 1. / 8.;
+    static constexpr double BETA = 1. / 4.;
+    static constexpr double K = 4.;
+
+    const double _initial_ms;
+    const double _min_ms;
+    const double _max_ms;
+    double _srtt_ms = 0.;
+    double _rttvar_ms = 0.;
+    uint64_t _samples = 0;
+    mutable std::mutex _mutex;
+
+public:
+    RttEstimator(double initial_ms, double min_ms, double max_ms) :
+          _initial_ms(initial_ms), _min_ms(min_ms), _max_ms(max_ms) {}
+
+    void addSample(double rtt_ms) {
+        if (!std::isfinite(rtt_ms) || rtt_ms < 0.) {
+            return;
+        }
+        std::scoped_lock lock(_mutex);
+        if (_samples == 0) {
+            _srtt_ms = rtt_ms;
+            _rttvar_ms = rtt_ms / 2.;
+        } else {
+            _rttvar_ms = (1. - BETA) * _rttvar_ms + BETA * std::abs(_srtt_ms - rtt_ms);
+            _srtt_ms = (1. - ALPHA) * _srtt_ms + ALPHA * rtt_ms;
+        }
+        _samples++;
+    }
+
+    double srttMs() const {
+        std::scoped_lock lock(_mutex);
+        return _srtt_ms;
+    }
+
+    double rttvarMs() const {
+        std::scoped_lock lock(_mutex);
+        return _rttvar_ms;
+    }
+
+    uint64_t samples() const {
+        std::scoped_lock lock(_mutex);
+        return _samples;
+    }
+
+    double timeoutMs() const {
+        std::scoped_lock lock(_mutex);
+        if (_samples == 0) {
+            return _initial_ms;
+        }
+        return std::clamp(_srtt_ms + K * _rttvar_ms, _min_ms, _max_ms);
+    }
+};
+
+};
@@ -0,0 +1,207 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace RASATestingSuite {
+
+using ObservationValues = std::map<std::string, double>;
+
+/**
+ * Runs the read-only part of tests concurrently before gtest runs the tests one by one.
+ *
+ * A test that only observes the vehicle (measures a stream rate, requests a message) registers
+ * an observation under its full gtest name, together with the resources it uses, typically the
+ * messages it consumes or measures. Observations without common resources run at the same time
+ * on a thread pool sharing the PassthroughTester; the test body then only checks the result.
+ * Tests that change the vehicle state (arming, missions, parameters, camera mode) are not
+ * registered and run alone as before. Observations must not use gtest assertions, as they run outside of a test.
+ */
+class Scheduler {
+private:
+    struct Job {
+        std::set<std::string> resources;
+        std::function<ObservationValues()> body;
+        std::shared_ptr<std::promise<ObservationValues>> promise;
+        std::shared_future<ObservationValues> result;
+        bool started = false;
+    };
+
+    std::map<std::string, Job> _jobs;
+    std::set<std::string> _held_resources;
+    std::mutex _mutex;
+    std::condition_variable _released;
+
+    Scheduler() = default;
+
+    static void arm(Job &job) {
+        job.promise = std::make_shared<std::promise<ObservationValues>>();
+        job.result = job.promise->get_future().share();
+        job.started = false;
+    }
+
+    static void runBody(Job &job) {
+        try {
+            job.promise->set_value(job.body());
+        } catch (...) {
+            job.promise->set_exception(std::current_exception());
+        }
+    }
+
+    bool conflicts(const Job &job) const {
+        for (const auto &resource : job.resources) {
+            if (_held_resources.count(resource) > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // takes the next job whose resources are free, waits if all remaining jobs are blocked
+    Job* takeJob(const std::set<std::string> &selected) {
+        std::unique_lock lock(_mutex);
+        while (true) {
+            bool remaining = false;
+            for (auto &entry : _jobs) {
+                Job &job = entry.second;
+                if (job.started || selected.count(entry.first) == 0) {
+                    continue;
+                }
+                remaining = true;
+                if (!conflicts(job)) {
+                    job.started = true;
+                    _held_resources.insert(job.resources.begin(), job.resources.end());
+                    return &job;
+                }
+            }
+            if (!remaining) {
+                return nullptr;
+            }
+            _released.wait(lock);
+        }
+    }
+
+    void release(const Job &job) {
+        {
+            std::scoped_lock lock(_mutex);
+            for (const auto &resource : job.resources) {
+                _held_resources.erase(resource);
+            }
+        }
+        _released.notify_all();
+    }
+
+public:
+    // the tests gtest is going to run, i.e. enabled in the config and matching the filter
+    static std::set<std::string> testsToRun() {
+        std::set<std::string> tests;
+        auto* unit_test = ::testing::UnitTest::GetInstance();
+        for (int i = 0; i < unit_test->total_test_suite_count(); i++) {
+            const auto* suite = unit_test->GetTestSuite(i);
+            for (int j = 0; j < suite->total_test_count(); j++) {
+                const auto* info = suite->GetTestInfo(j);
+                if (info->should_run()) {
+                    tests.insert(std::string(suite->name()) + "." + info->name());
+                }
+            }
+        }
+        return tests;
+    }
+
+    static Scheduler& getInstance() {
+        static Scheduler instance;
+        return instance;
+    }
+
+    /**
+     * Registers the observation of a test, usually during static initialization of the test file.
+     */
+    void add(const std::string &test, std::set<std::string> resources, std::function<ObservationValues()> body) {
+        std::scoped_lock lock(_mutex);
+        Job job;
+        job.resources = std::move(resources);
+        job.body = std::move(body);
+        arm(job);
+        _jobs[test] = std::move(job);
+    }
+
+    /**
+     * Runs the observations of all tests that are going to run on at most max_threads threads,
+     * with 0 they run when their test does. Must be called once the test filter is applied, i.e.
+     * from the gtest environment SetUp, which gtest repeats for every iteration.
+     */
+    void runAll(unsigned max_threads) {
+        const auto start = std::chrono::steady_clock::now();
+        std::set<std::string> selected;
+        {
+            std::scoped_lock lock(_mutex);
+            for (auto &entry : _jobs) {
+                arm(entry.second);
+            }
+            for (const auto &test : testsToRun()) {
+                if (_jobs.count(test) > 0) {
+                    selected.insert(test);
+                }
+            }
+        }
+        if (max_threads == 0 || selected.empty()) {
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < std::min<size_t>(max_threads, selected.size()); i++) {
+            workers.emplace_back([this, &selected]() {
+                while (Job* job = takeJob(selected)) {
+                    runBody(*job);
+                    release(*job);
+                }
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("Ran %zu observations in %.1f s on %zu threads\n", selected.size(), seconds, workers.size());
+    }
+
+    /**
+     * Result of the observation of a test, running it now if it did not run yet. Rethrows the
+     * exception of the observation, e.g. a TimeoutError.
+     */
+    ObservationValues await(const std::string &test) {
+        Job* job = nullptr;
+        {
+            std::scoped_lock lock(_mutex);
+            auto entry = _jobs.find(test);
+            if (entry == _jobs.end()) {
+                throw std::runtime_error("No observation registered for " + test);
+            }
+            if (!entry->second.started) {
+                entry->second.started = true;
+                job = &entry->second;
+            }
+        }
+        if (job != nullptr) {
+            runBody(*job);
+        }
+        return _jobs.at(test).result.get();
+    }
+
+    ObservationValues awaitCurrentTest() {
+        const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+        return await(std::string(info->test_suite_name()) + "." + info->name());
+    }
+};
+
+};
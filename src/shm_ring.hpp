@@ -0,0 +1,262 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <mavsdk/plugins/mavlink_passthrough/mavlink_passthrough.h>
+
+namespace RASATestingSuite {
+
+class AgentError : public std::runtime_error {
+public:
+    AgentError(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+/**
+ * Shared memory segment through which the connection agent shares one vehicle link with any
+ * number of test processes. Received frames go into a ring with a single writer (the agent)
+ * that every reader consumes at its own pace; a reader that falls behind by more than the ring
+ * size loses the oldest frames. Frames to send go into a second ring with many writers and the
+ * agent as single reader. Timestamps are CLOCK_MONOTONIC, which all processes share.
+ */
+class ShmRing {
+public:
+    static constexpr uint64_t RX_SLOTS = 4096;
+    static constexpr uint64_t TX_SLOTS = 1024;
+
+private:
+    static constexpr uint32_t MAGIC = 0x52415341;  // "RASA"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr int64_t AGENT_ALIVE_TIMEOUT_NS = 2000000000;
+
+    struct Frame {
+        // rx: 2 * index + 1 while written, 2 * index + 2 when complete. tx: index + 1 when complete
+        std::atomic<uint64_t> sequence;
+        int64_t arrival_ns;
+        mavlink_message_t message;
+    };
+
+    struct Layout {
+        uint32_t magic;
+        uint32_t version;
+        uint8_t our_system_id;
+        uint8_t our_component_id;
+        std::atomic<uint64_t> capabilities;
+        std::atomic<int64_t> agent_alive_ns;
+        std::atomic<uint64_t> rx_write;
+        std::atomic<uint64_t> tx_reserve;
+        std::atomic<uint64_t> tx_read;
+        Frame rx[RX_SLOTS];
+        Frame tx[TX_SLOTS];
+    };
+
+    Layout* _layout;
+    const std::string _segment;
+    const bool _owner;
+    int64_t _tx_waiting_since_ns = 0;
+
+    ShmRing(Layout* layout, std::string segment, bool owner) :
+          _layout(layout), _segment(std::move(segment)), _owner(owner) {}
+
+    static std::string segmentName(const std::string &name) {
+        return "/ras_a_agent_" + name;
+    }
+
+public:
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Creates the segment, replacing a stale one of a previous agent with the same name.
+     */
+    static std::unique_ptr<ShmRing> create(const std::string &name, uint8_t our_system_id, uint8_t our_component_id) {
+        const std::string segment = segmentName(name);
+        shm_unlink(segment.c_str());
+        int fd = shm_open(segment.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 || ftruncate(fd, sizeof(Layout)) != 0) {
+            throw AgentError("Could not create shared memory " + segment + ": " + strerror(errno));
+        }
+        void* memory = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (memory == MAP_FAILED) {
+            throw AgentError("Could not map shared memory " + segment + ": " + strerror(errno));
+        }
+        auto* layout = new (memory) Layout();
+        layout->version = VERSION;
+        layout->our_system_id = our_system_id;
+        layout->our_component_id = our_component_id;
+        layout->agent_alive_ns = nowNs();
+        std::atomic_thread_fence(std::memory_order_release);
+        layout->magic = MAGIC;
+        return std::unique_ptr<ShmRing>(new ShmRing(layout, segment, true));
+    }
+
+    static std::unique_ptr<ShmRing> attach(const std::string &name) {
+        const std::string segment = segmentName(name);
+        int fd = shm_open(segment.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            throw AgentError("No connection agent \"" + name + "\" running");
+        }
+        void* memory = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (memory == MAP_FAILED) {
+            throw AgentError("Could not map shared memory " + segment + ": " + strerror(errno));
+        }
+        auto ring = std::unique_ptr<ShmRing>(new ShmRing(static_cast<Layout*>(memory), segment, false));
+        if (ring->_layout->magic != MAGIC || ring->_layout->version != VERSION) {
+            throw AgentError("Connection agent \"" + name + "\" has an incompatible version");
+        }
+        if (!ring->agentAlive()) {
+            throw AgentError("Connection agent \"" + name + "\" is not running anymore");
+        }
+        return ring;
+    }
+
+    ~ShmRing() {
+        munmap(_layout, sizeof(Layout));
+        if (_owner) {
+            shm_unlink(_segment.c_str());
+        }
+    }
+
+    /* ----------- agent side ----------- */
+
+    void publish(const mavlink_message_t &message, int64_t arrival_ns) {
+        uint64_t index = _layout->rx_write.load(std::memory_order_relaxed);
+        Frame &frame = _layout->rx[index % RX_SLOTS];
+        frame.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        frame.arrival_ns = arrival_ns;
+        frame.message = message;
+        frame.sequence.store(2 * index + 2, std::memory_order_release);
+        _layout->rx_write.store(index + 1, std::memory_order_release);
+    }
+
+    /**
+     * Takes the next message a test process wants to send. A slot reserved by a writer that
+     * did not complete it within a second (e.g. a crashed test process) is skipped.
+     */
+    bool takeOutgoing(mavlink_message_t &message) {
+        uint64_t index = _layout->tx_read.load(std::memory_order_relaxed);
+        Frame &frame = _layout->tx[index % TX_SLOTS];
+        if (frame.sequence.load(std::memory_order_acquire) != index + 1) {
+            if (_layout->tx_reserve.load(std::memory_order_acquire) <= index) {
+                return false;
+            }
+            if (_tx_waiting_since_ns == 0) {
+                _tx_waiting_since_ns = nowNs();
+            } else if (nowNs() - _tx_waiting_since_ns > 1000000000) {
+                _tx_waiting_since_ns = 0;
+                _layout->tx_read.store(index + 1, std::memory_order_release);
+            }
+            return false;
+        }
+        _tx_waiting_since_ns = 0;
+        message = frame.message;
+        _layout->tx_read.store(index + 1, std::memory_order_release);
+        return true;
+    }
+
+    void setCapabilities(uint64_t capabilities) {
+        _layout->capabilities = capabilities;
+    }
+
+    void touch() {
+        _layout->agent_alive_ns = nowNs();
+    }
+
+    /* ----------- test process side ----------- */
+
+    class Reader {
+    private:
+        Layout* _layout;
+        uint64_t _next;
+        uint64_t _lost = 0;
+
+    public:
+        Reader(Layout* layout, uint64_t next) : _layout(layout), _next(next) {}
+
+        /**
+         * Copies the next frame if there is one. Frames overwritten before they could be read
+         * are counted as lost.
+         */
+        bool read(mavlink_message_t &message, int64_t &arrival_ns) {
+            while (true) {
+                uint64_t write = _layout->rx_write.load(std::memory_order_acquire);
+                if (_next >= write) {
+                    return false;
+                }
+                if (write - _next > RX_SLOTS) {
+                    _lost += write - RX_SLOTS - _next;
+                    _next = write - RX_SLOTS;
+                }
+                Frame &frame = _layout->rx[_next % RX_SLOTS];
+                uint64_t before = frame.sequence.load(std::memory_order_acquire);
+                message = frame.message;
+                arrival_ns = frame.arrival_ns;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                uint64_t after = frame.sequence.load(std::memory_order_relaxed);
+                bool valid = before == 2 * _next + 2 && after == before;
+                _next++;
+                if (valid) {
+                    return true;
+                }
+                _lost++;
+            }
+        }
+
+        uint64_t lost() const {
+            return _lost;
+        }
+    };
+
+    // starts at the newest frame, set from_history to replay the frames still in the ring
+    Reader reader(bool from_history = false) const {
+        uint64_t write = _layout->rx_write.load(std::memory_order_acquire);
+        if (!from_history) {
+            return Reader(_layout, write);
+        }
+        return Reader(_layout, write > RX_SLOTS ? write - RX_SLOTS : 0);
+    }
+
+    void send(const mavlink_message_t &message) {
+        uint64_t index = _layout->tx_reserve.fetch_add(1, std::memory_order_acq_rel);
+        while (index - _layout->tx_read.load(std::memory_order_acquire) >= TX_SLOTS) {
+            if (!agentAlive()) {
+                throw AgentError("Connection agent stopped");
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        Frame &frame = _layout->tx[index % TX_SLOTS];
+        frame.message = message;
+        frame.sequence.store(index + 1, std::memory_order_release);
+    }
+
+    bool agentAlive() const {
+        return nowNs() - _layout->agent_alive_ns.load() < AGENT_ALIVE_TIMEOUT_NS;
+    }
+
+    uint8_t ourSystemId() const {
+        return _layout->our_system_id;
+    }
+
+    uint8_t ourComponentId() const {
+        return _layout->our_component_id;
+    }
+
+    uint64_t capabilities() const {
+        return _layout->capabilities;
+    }
+};
+
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+namespace RASATestingSuite {
+
+/**
+ * Estimates how fast the vehicle clock runs compared to the host clock from the boot
+ * timestamps the vehicle puts into its messages. A simulation running at twice real time
+ * yields a factor of 2. Each timestamp source is tracked separately, the ratios measured over
+ * windows of at least one second are smoothed into one estimate.
+ */
+class SimSpeedEstimator {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    static constexpr double MIN_WINDOW_S = 1.;
+    static constexpr double SMOOTHING = 0.3;
+    // anything outside is a reboot, a time jump or a bogus timestamp, not a simulation speed
+    static constexpr double MIN_FACTOR = 0.01;
+    static constexpr double MAX_FACTOR = 100.;
+
+    struct Window {
+        uint64_t vehicle_us;
+        Clock::time_point host;
+    };
+
+    std::map<uint32_t, Window> _windows;
+    double _factor = 1.;
+    bool _has_estimate = false;
+    mutable std::mutex _mutex;
+
+public:
+    void update(uint32_t source_id, uint64_t vehicle_us, Clock::time_point host) {
+        std::scoped_lock lock(_mutex);
+        auto it = _windows.find(source_id);
+        if (it == _windows.end() || vehicle_us < it->second.vehicle_us) {
+            _windows[source_id] = {vehicle_us, host};
+            return;
+        }
+        double host_s = std::chrono::duration<double>(host - it->second.host).count();
+        if (host_s < MIN_WINDOW_S) {
+            return;
+        }
+        double factor = static_cast<double>(vehicle_us - it->second.vehicle_us) * 1e-6 / host_s;
+        it->second = {vehicle_us, host};
+        if (factor < MIN_FACTOR || factor > MAX_FACTOR) {
+            return;
+        }
+        _factor = _has_estimate ? _factor + SMOOTHING * (factor - _factor) : factor;
+        _has_estimate = true;
+    }
+
+    bool hasEstimate() const {
+        std::scoped_lock lock(_mutex);
+        return _has_estimate;
+    }
+
+    /**
+     * Returns the current estimate, or real time as long as there is none.
+     */
+    double factor() const {
+        std::scoped_lock lock(_mutex);
+        return _factor;
+    }
+};
+
+};
@@ -0,0 +1,210 @@
+#pragma once
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include "gtest/gtest.h"
+#include "statistics.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * How long a soak run lasts: a duration such as 8h, 30m or 90s, or a number of iterations.
+ */
+struct SoakLimit {
+    std::chrono::seconds duration{0};
+    unsigned iterations = 0;
+
+    static SoakLimit parse(const std::string &text) {
+        size_t end = 0;
+        unsigned long value = 0;
+        try {
+            value = std::stoul(text, &end);
+        } catch (std::logic_error&) {
+            throw std::invalid_argument("Invalid soak limit \"" + text + "\"");
+        }
+        const std::string unit = text.substr(end);
+        SoakLimit limit;
+        if (unit.empty()) {
+            limit.iterations = static_cast<unsigned>(value);
+        } else if (unit == "s") {
+            limit.duration = std::chrono::seconds(value);
+        } else if (unit == "m") {
+            limit.duration = std::chrono::minutes(value);
+        } else if (unit == "h") {
+            limit.duration = std::chrono::hours(value);
+        } else {
+            throw std::invalid_argument("Invalid soak limit \"" + text + "\", use e.g. 8h, 30m, 90s or 100");
+        }
+        if (value == 0) {
+            throw std::invalid_argument("Soak limit must not be 0");
+        }
+        return limit;
+    }
+};
+
+/**
+ * Resident memory of the suite process in kB.
+ */
+inline double residentMemoryKb() {
+    std::ifstream statm("/proc/self/statm");
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    if (!(statm >> size >> resident)) {
+        return 0.;
+    }
+    return static_cast<double>(resident) * static_cast<double>(sysconf(_SC_PAGESIZE)) / 1024.;
+}
+
+/**
+ * Follows the cycles of the selected tests (main runs them until done) and keeps constant
+ * memory statistics per test instead of a result per run: duration percentiles, failures and
+ * the numeric test properties, e.g. telemetry rates and mission upload times. Gauges such as the
+ * suite's memory are sampled after every test. Values drifting by more than TREND_THRESHOLD of
+ * their mean over the run are flagged in the report.
+ */
+class SoakListener : public ::testing::EmptyTestEventListener {
+public:
+    using Gauge = std::function<double()>;
+
+private:
+    static constexpr double TREND_THRESHOLD = 0.2;
+    static constexpr uint64_t MIN_TREND_SAMPLES = 10;
+    static constexpr int MAX_PRINTED_FAILURES_PER_TEST = 3;
+
+    struct TestSoak {
+        uint64_t passed = 0;
+        uint64_t failed = 0;
+        uint64_t skipped = 0;
+        StreamingStats duration_ms;
+        std::map<std::string, StreamingStats> properties;
+        int printed_failures = 0;
+    };
+
+    const SoakLimit _limit;
+    const std::map<std::string, Gauge> _gauges;
+    const std::chrono::steady_clock::time_point _start;
+    std::map<std::string, TestSoak> _tests;
+    std::map<std::string, StreamingStats> _gauge_stats;
+    unsigned _iterations = 0;
+
+    double hours() const {
+        return std::chrono::duration<double, std::ratio<3600>>(std::chrono::steady_clock::now() - _start).count();
+    }
+
+    static bool parseNumber(const char* text, double &value) {
+        char* end = nullptr;
+        value = std::strtod(text, &end);
+        return end != text && *end == '\0';
+    }
+
+    static const char* trendFlag(const StreamingStats &stats) {
+        if (stats.stats().count() >= MIN_TREND_SAMPLES && std::abs(stats.relativeDrift()) > TREND_THRESHOLD) {
+            return "  TREND";
+        }
+        return "";
+    }
+
+    static void printStats(const std::string &name, const StreamingStats &stats) {
+        printf("  %-56s %7lu %10.2f %10.2f %10.2f %10.2f %10.2f %+8.1f%%%s\n", name.c_str(),
+               static_cast<unsigned long>(stats.stats().count()), stats.stats().mean(), stats.percentile(0.5),
+               stats.percentile(0.95), stats.stats().min(), stats.stats().max(), stats.relativeDrift() * 100.,
+               trendFlag(stats));
+    }
+
+public:
+    SoakListener(SoakLimit limit, std::map<std::string, Gauge> gauges) :
+          _limit(limit), _gauges(std::move(gauges)), _start(std::chrono::steady_clock::now()) {}
+
+    // whether the limit is reached after the last iteration
+    bool done() const {
+        if (_limit.iterations > 0) {
+            return _iterations >= _limit.iterations;
+        }
+        return std::chrono::steady_clock::now() - _start >= _limit.duration;
+    }
+
+    void OnTestPartResult(const ::testing::TestPartResult &result) override {
+        const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+        if (!result.failed() || info == nullptr) {
+            return;
+        }
+        TestSoak &test = _tests[std::string(info->test_suite_name()) + "." + info->name()];
+        if (test.printed_failures < MAX_PRINTED_FAILURES_PER_TEST) {
+            test.printed_failures++;
+            printf("[iteration %u] %s.%s failed at %s:%d\n%s\n", _iterations + 1, info->test_suite_name(),
+                   info->name(), result.file_name() ? result.file_name() : "?", result.line_number(),
+                   result.summary());
+        }
+    }
+
+    void OnTestEnd(const ::testing::TestInfo &info) override {
+        const double t = hours();
+        const auto* result = info.result();
+        TestSoak &test = _tests[std::string(info.test_suite_name()) + "." + info.name()];
+        if (result->Skipped()) {
+            test.skipped++;
+        } else {
+            (result->Passed() ? test.passed : test.failed)++;
+            test.duration_ms.add(t, static_cast<double>(result->elapsed_time()));
+        }
+        for (int i = 0; i < result->test_property_count(); i++) {
+            const auto &property = result->GetTestProperty(i);
+            double value = 0.;
+            if (parseNumber(property.value(), value)) {
+                test.properties[property.key()].add(t, value);
+            }
+        }
+        for (const auto &gauge : _gauges) {
+            _gauge_stats[gauge.first].add(t, gauge.second());
+        }
+    }
+
+    void OnTestIterationEnd(const ::testing::UnitTest &unit_test, int) override {
+        _iterations++;
+        printf("Soak iteration %u: %d passed, %d failed, %.2f h, %.0f kB resident\n", _iterations,
+               unit_test.successful_test_count(), unit_test.failed_test_count(), hours(), residentMemoryKb());
+        fflush(stdout);
+    }
+
+    /**
+     * Prints the report and returns 1 if any test failed during the run.
+     */
+    int report() const {
+        uint64_t failed = 0;
+        printf("\nSoak report: %u iterations in %.2f h\n", _iterations, hours());
+        printf("  %-56s %7s %7s %7s %10s %10s %10s\n", "Test", "passed", "failed", "skipped", "p50 ms",
+               "p95 ms", "max ms");
+        for (const auto &test : _tests) {
+            const StreamingStats &duration = test.second.duration_ms;
+            printf("  %-56s %7lu %7lu %7lu %10.0f %10.0f %10.0f\n", test.first.c_str(),
+                   static_cast<unsigned long>(test.second.passed), static_cast<unsigned long>(test.second.failed),
+                   static_cast<unsigned long>(test.second.skipped), duration.percentile(0.5),
+                   duration.percentile(0.95), duration.stats().max());
+            failed += test.second.failed;
+        }
+
+        printf("\n  %-56s %7s %10s %10s %10s %10s %10s %9s\n", "Value", "samples", "mean", "p50", "p95", "min",
+               "max", "drift");
+        for (const auto &test : _tests) {
+            printStats(test.first + " duration_ms", test.second.duration_ms);
+            for (const auto &property : test.second.properties) {
+                printStats(test.first + " " + property.first, property.second);
+            }
+        }
+        for (const auto &gauge : _gauge_stats) {
+            printStats("suite " + gauge.first, gauge.second);
+        }
+        printf("\nDrift is the change of the trend line over the run, relative to the mean; TREND marks a drift "
+               "above %.0f%%.\n", TREND_THRESHOLD * 100.);
+        return failed > 0 ? 1 : 0;
+    }
+};
+
+};
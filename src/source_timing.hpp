@@ -0,0 +1,154 @@
+#pragma once
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include "clock_sync.hpp"
+#include "passthrough_messages.hpp"
+#include "statistics.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * Timing of a stream as seen by its source timestamps (time_boot_ms or time_usec). The spread
+ * of the source intervals is the jitter of the onboard publication; the difference between the
+ * arrival interval and the source interval is what the link adds on top. Samples with the same
+ * timestamp as the previous one are duplicates, samples with an older one are non-monotonic.
+ */
+struct SourceTiming {
+    uint64_t samples = 0;
+    RunningStats source_interval_ms;
+    RunningStats link_jitter_ms;
+    uint64_t duplicates = 0;
+    uint64_t non_monotonic = 0;
+};
+
+/**
+ * Age of the samples of a stream when they arrive: arrival time minus source timestamp, with the
+ * source timestamp converted to host time by the TIMESYNC clock offset.
+ */
+struct MessageAge {
+    RunningStats stats_ms;
+    LogHistogram histogram_ms;
+};
+
+class SourceTimingTracker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    struct Stream {
+        SourceTiming timing;
+        uint64_t last_source_us = 0;
+        Clock::time_point last_arrival;
+    };
+
+    // ages beyond this are from a timestamp on another clock, e.g. UNIX time
+    static constexpr double MAX_PLAUSIBLE_AGE_MS = 60000.;
+
+    std::map<uint64_t, Stream> _streams;
+    std::map<uint64_t, MessageAge> _ages;
+    mutable std::mutex _mutex;
+
+    template<int MSG>
+    static uint64_t bootMsToUs(const mavlink_message_t &message) {
+        typename msg_helper<MSG>::decode_type decoded;
+        msg_helper<MSG>::unpack(&message, &decoded);
+        return decoded.time_boot_ms * 1000ULL;
+    }
+
+    template<int MSG>
+    static uint64_t timeUs(const mavlink_message_t &message) {
+        typename msg_helper<MSG>::decode_type decoded;
+        msg_helper<MSG>::unpack(&message, &decoded);
+        return decoded.time_usec;
+    }
+
+public:
+    // the source timestamp of the messages that have one
+    static bool sourceTimeUs(const mavlink_message_t &message, uint64_t &time_us) {
+        switch (message.msgid) {
+            case msg_helper<ATTITUDE>::ID: time_us = bootMsToUs<ATTITUDE>(message); return true;
+            case msg_helper<ATTITUDE_QUATERNION>::ID: time_us = bootMsToUs<ATTITUDE_QUATERNION>(message); return true;
+            case msg_helper<ATTITUDE_TARGET>::ID: time_us = bootMsToUs<ATTITUDE_TARGET>(message); return true;
+            case msg_helper<GLOBAL_POSITION_INT>::ID: time_us = bootMsToUs<GLOBAL_POSITION_INT>(message); return true;
+            case msg_helper<LOCAL_POSITION_NED>::ID: time_us = bootMsToUs<LOCAL_POSITION_NED>(message); return true;
+            case msg_helper<POSITION_TARGET_LOCAL_NED>::ID: time_us = bootMsToUs<POSITION_TARGET_LOCAL_NED>(message); return true;
+            case msg_helper<GIMBAL_DEVICE_ATTITUDE_STATUS>::ID: time_us = bootMsToUs<GIMBAL_DEVICE_ATTITUDE_STATUS>(message); return true;
+            case msg_helper<SYSTEM_TIME>::ID: time_us = bootMsToUs<SYSTEM_TIME>(message); return true;
+            case msg_helper<ALTITUDE>::ID: time_us = timeUs<ALTITUDE>(message); return true;
+            case msg_helper<ESTIMATOR_STATUS>::ID: time_us = timeUs<ESTIMATOR_STATUS>(message); return true;
+            default: return false;
+        }
+    }
+
+    /**
+     * time_scale converts the arrival intervals (host time) to vehicle time. The age is only
+     * measured once the clock is synchronized.
+     */
+    void add(uint64_t stream, const mavlink_message_t &message, Clock::time_point arrival, double time_scale,
+             const ClockSync &clock) {
+        uint64_t source_us = 0;
+        if (!sourceTimeUs(message, source_us)) {
+            return;
+        }
+        double age_ms = NAN;
+        if (clock.valid()) {
+            age_ms = ClockSync::hostMs(arrival) - clock.toHostMs(static_cast<double>(source_us) / 1000.);
+        }
+        std::scoped_lock lock(_mutex);
+        if (std::abs(age_ms) < MAX_PLAUSIBLE_AGE_MS) {
+            MessageAge &age = _ages[stream];
+            age.stats_ms.add(age_ms);
+            age.histogram_ms.add(age_ms);
+        }
+        auto found = _streams.find(stream);
+        if (found == _streams.end()) {
+            Stream &first = _streams[stream];
+            first.timing.samples = 1;
+            first.last_source_us = source_us;
+            first.last_arrival = arrival;
+            return;
+        }
+        Stream &tracked = found->second;
+        tracked.timing.samples++;
+        if (source_us == tracked.last_source_us) {
+            tracked.timing.duplicates++;
+        } else if (source_us < tracked.last_source_us) {
+            tracked.timing.non_monotonic++;
+        } else {
+            const double source_ms = static_cast<double>(source_us - tracked.last_source_us) / 1000.;
+            const double arrival_ms = std::chrono::duration<double, std::milli>(arrival - tracked.last_arrival).count() * time_scale;
+            tracked.timing.source_interval_ms.add(source_ms);
+            tracked.timing.link_jitter_ms.add(arrival_ms - source_ms);
+        }
+        tracked.last_source_us = source_us;
+        tracked.last_arrival = arrival;
+    }
+
+    void reset(uint64_t stream) {
+        std::scoped_lock lock(_mutex);
+        _streams.erase(stream);
+    }
+
+    MessageAge age(uint64_t stream) const {
+        std::scoped_lock lock(_mutex);
+        auto found = _ages.find(stream);
+        return found == _ages.end() ? MessageAge{} : found->second;
+    }
+
+    void resetAges() {
+        std::scoped_lock lock(_mutex);
+        _ages.clear();
+    }
+
+    // empty for streams without source timestamp
+    SourceTiming timing(uint64_t stream) const {
+        std::scoped_lock lock(_mutex);
+        auto found = _streams.find(stream);
+        return found == _streams.end() ? SourceTiming{} : found->second.timing;
+    }
+};
+
+};
@@ -0,0 +1,246 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+
+namespace RASATestingSuite {
+
+/**
+ * Count, mean, variance, minimum and maximum of a series, updated per value in constant memory
+ * (Welford's algorithm).
+ */
+class RunningStats {
+private:
+    uint64_t _count = 0;
+    double _mean = 0.;
+    double _m2 = 0.;
+    double _min = std::numeric_limits<double>::infinity();
+    double _max = -std::numeric_limits<double>::infinity();
+
+public:
+    void add(double value) {
+        _count++;
+        double delta = value - _mean;
+        _mean += delta / static_cast<double>(_count);
+        _m2 += delta * (value - _mean);
+        _min = std::min(_min, value);
+        _max = std::max(_max, value);
+    }
+
+    uint64_t count() const {
+        return _count;
+    }
+
+    double mean() const {
+        return _mean;
+    }
+
+    double stddev() const {
+        return _count > 1 ? std::sqrt(_m2 / static_cast<double>(_count - 1)) : 0.;
+    }
+
+    double min() const {
+        return _count > 0 ? _min : 0.;
+    }
+
+    double max() const {
+        return _count > 0 ? _max : 0.;
+    }
+};
+
+/**
+ * Histogram with logarithmic buckets for percentiles of positive values, e.g. latencies. Each
+ * bucket is 5% wide, so a percentile is off by at most 2.5%, for values from 0.001 to 10^9.
+ * Smaller values, including zero and negative ones, share the first bucket.
+ */
+class LogHistogram {
+private:
+    static constexpr double MIN_VALUE = 1e-3;
+    static constexpr double GROWTH = 1.05;
+    static constexpr size_t BUCKETS = 570;  // up to 10^9
+
+    std::array<uint64_t, BUCKETS> _buckets{};
+    uint64_t _count = 0;
+
+    static size_t bucketOf(double value) {
+        if (!(value > MIN_VALUE)) {
+            return 0;
+        }
+        double index = std::log(value / MIN_VALUE) / std::log(GROWTH) + 1.;
+        return std::min(BUCKETS - 1, static_cast<size_t>(index));
+    }
+
+    // geometric middle of the bucket
+    static double valueOf(size_t bucket) {
+        if (bucket == 0) {
+            return 0.;
+        }
+        return MIN_VALUE * std::pow(GROWTH, static_cast<double>(bucket) - 0.5);
+    }
+
+public:
+    void add(double value) {
+        _buckets[bucketOf(value)]++;
+        _count++;
+    }
+
+    uint64_t count() const {
+        return _count;
+    }
+
+    /**
+     * Number of values from low (inclusive) to high (exclusive), to the precision of a bucket.
+     */
+    uint64_t countBetween(double low, double high) const {
+        uint64_t count = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            const double value = valueOf(i);
+            if (value >= low && value < high) {
+                count += _buckets[i];
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Prints the distribution with one bar per 1-2-5 step from the smallest to the largest value.
+     */
+    void print(const char* unit) const {
+        if (_count == 0) {
+            return;
+        }
+        static constexpr int BAR_WIDTH = 40;
+        const double lowest = percentile(0.);
+        const double highest = percentile(1.);
+        double low = 1e-3;
+        for (int step = 0; low <= highest; step++) {
+            const double high = low * (step % 3 == 1 ? 2.5 : 2.);
+            if (high > lowest) {
+                const uint64_t count = countBetween(low, high);
+                const int width = static_cast<int>(std::ceil(BAR_WIDTH * static_cast<double>(count) / static_cast<double>(_count)));
+                printf("  %8g .. %-8g %s |%-*s| %lu\n", low, high, unit, BAR_WIDTH, std::string(width, '#').c_str(),
+                       static_cast<unsigned long>(count));
+            }
+            low = high;
+        }
+    }
+
+    /**
+     * Value below which the fraction p (0..1) of the values lie.
+     */
+    double percentile(double p) const {
+        if (_count == 0) {
+            return 0.;
+        }
+        const auto rank = static_cast<uint64_t>(std::ceil(std::clamp(p, 0., 1.) * static_cast<double>(_count)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            seen += _buckets[i];
+            if (seen >= std::max<uint64_t>(rank, 1)) {
+                return valueOf(i);
+            }
+        }
+        return valueOf(BUCKETS - 1);
+    }
+};
+
+/**
+ * Least squares line through (time, value) pairs in constant memory. The slope tells whether
+ * a value drifts over a long run.
+ */
+class Trend {
+private:
+    uint64_t _n = 0;
+    double _sum_t = 0.;
+    double _sum_v = 0.;
+    double _sum_tt = 0.;
+    double _sum_tv = 0.;
+    double _first_t = 0.;
+    double _last_t = 0.;
+
+public:
+    void add(double t, double value) {
+        if (_n == 0) {
+            _first_t = t;
+        }
+        _last_t = t;
+        // relative to the first sample, so the sums stay small over hours
+        const double x = t - _first_t;
+        _n++;
+        _sum_t += x;
+        _sum_v += value;
+        _sum_tt += x * x;
+        _sum_tv += x * value;
+    }
+
+    // change of the value per unit of t, 0 without a time spread
+    double slope() const {
+        const double n = static_cast<double>(_n);
+        const double denominator = n * _sum_tt - _sum_t * _sum_t;
+        if (_n < 2 || denominator <= 0.) {
+            return 0.;
+        }
+        return (n * _sum_tv - _sum_t * _sum_v) / denominator;
+    }
+
+    double span() const {
+        return _last_t - _first_t;
+    }
+
+    uint64_t count() const {
+        return _n;
+    }
+
+    // value of the line at t
+    double at(double t) const {
+        if (_n == 0) {
+            return 0.;
+        }
+        const double n = static_cast<double>(_n);
+        const double slope_now = slope();
+        return (_sum_v - slope_now * _sum_t) / n + slope_now * (t - _first_t);
+    }
+};
+
+/**
+ * A measured quantity over a long run: distribution, percentiles and drift over time. The drift
+ * is the change the trend line predicts over the whole run, relative to the mean.
+ */
+class StreamingStats {
+private:
+    RunningStats _stats;
+    LogHistogram _histogram;
+    Trend _trend;
+
+public:
+    void add(double t, double value) {
+        _stats.add(value);
+        _histogram.add(value);
+        _trend.add(t, value);
+    }
+
+    const RunningStats& stats() const {
+        return _stats;
+    }
+
+    double percentile(double p) const {
+        return _histogram.percentile(p);
+    }
+
+    double slope() const {
+        return _trend.slope();
+    }
+
+    double relativeDrift() const {
+        if (_stats.count() < 2 || _stats.mean() == 0.) {
+            return 0.;
+        }
+        return _trend.slope() * _trend.span() / std::abs(_stats.mean());
+    }
+};
+
+};
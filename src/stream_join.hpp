@@ -0,0 +1,277 @@
+#pragma once
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "passthrough_tester.hpp"
+#include "source_timing.hpp"
+#include "statistics.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * Outcome of a consistency rule: the residual of every evaluated sample or pair, and how often
+ * it exceeded the tolerance. Samples that found no partner in time are counted as unmatched.
+ */
+struct ConsistencyResult {
+    std::string name;
+    std::string unit;
+    double tolerance = 0.;
+    RunningStats residual;
+    uint64_t violations = 0;
+    double worst = 0.;
+    double first_violation_s = -1.;  // since the start, -1 if none
+    uint64_t unmatched = 0;
+};
+
+/**
+ * A rule checked on every message of the streams it looks at.
+ */
+class ConsistencyRule {
+protected:
+    ConsistencyResult _result;
+    std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+
+    void evaluate(double residual) {
+        if (std::isnan(residual)) {
+            return;
+        }
+        _result.residual.add(residual);
+        if (std::abs(residual) > std::abs(_result.worst)) {
+            _result.worst = residual;
+        }
+        if (std::abs(residual) > _result.tolerance) {
+            if (_result.violations++ == 0) {
+                _result.first_violation_s =
+                        std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+            }
+        }
+    }
+
+public:
+    ConsistencyRule(std::string name, std::string unit, double tolerance) {
+        _result.name = std::move(name);
+        _result.unit = std::move(unit);
+        _result.tolerance = tolerance;
+    }
+
+    virtual ~ConsistencyRule() = default;
+
+    virtual void add(const mavlink_message_t &message, std::chrono::steady_clock::time_point arrival) = 0;
+
+    const ConsistencyResult& result() const {
+        return _result;
+    }
+};
+
+/**
+ * Checks every sample of one stream, e.g. the norm of a quaternion.
+ */
+template<int MSG>
+class SampleCheck : public ConsistencyRule {
+public:
+    using Sample = typename msg_helper<MSG>::decode_type;
+    using Residual = std::function<double(const Sample&)>;
+
+private:
+    const Residual _residual;
+
+public:
+    SampleCheck(std::string name, std::string unit, double tolerance, Residual residual) :
+          ConsistencyRule(std::move(name), std::move(unit), tolerance), _residual(std::move(residual)) {}
+
+    void add(const mavlink_message_t &message, std::chrono::steady_clock::time_point) override {
+        if (message.msgid != msg_helper<MSG>::ID) {
+            return;
+        }
+        Sample sample;
+        msg_helper<MSG>::unpack(&message, &sample);
+        evaluate(_residual(sample));
+    }
+};
+
+// how the samples of two streams are put on one time axis
+enum class JoinAlignment { SourceTime, Arrival };
+
+/**
+ * Pairs the samples of two streams describing the same state and checks each pair. Samples are
+ * aligned by their source timestamps, or by their arrival for messages without one, and pair up
+ * when their times are at most max_skew apart. Each side keeps at most MAX_BUFFERED samples
+ * waiting for a partner; samples older than the newest one of the other side by more than
+ * max_skew can not pair anymore and are dropped as unmatched, so memory stays bounded however
+ * long the run is.
+ */
+template<int A, int B>
+class StreamJoin : public ConsistencyRule {
+public:
+    using SampleA = typename msg_helper<A>::decode_type;
+    using SampleB = typename msg_helper<B>::decode_type;
+    using Residual = std::function<double(const SampleA&, const SampleB&)>;
+
+private:
+    static constexpr size_t MAX_BUFFERED = 64;
+
+    template<typename Sample>
+    struct Timed {
+        int64_t time_us;
+        Sample sample;
+    };
+
+    const Residual _residual;
+    const JoinAlignment _alignment;
+    const int64_t _max_skew_us;
+    std::deque<Timed<SampleA>> _a;
+    std::deque<Timed<SampleB>> _b;
+
+    bool timeOf(const mavlink_message_t &message, std::chrono::steady_clock::time_point arrival,
+                int64_t &time_us) const {
+        if (_alignment == JoinAlignment::Arrival) {
+            time_us = std::chrono::duration_cast<std::chrono::microseconds>(arrival.time_since_epoch()).count();
+            return true;
+        }
+        uint64_t source_us = 0;
+        if (!SourceTimingTracker::sourceTimeUs(message, source_us)) {
+            return false;
+        }
+        time_us = static_cast<int64_t>(source_us);
+        return true;
+    }
+
+    /**
+     * Pairs the new sample with the closest one of the other side, or buffers it.
+     */
+    template<typename Own, typename Other, typename Evaluate>
+    void join(int64_t time_us, const Own &sample, std::deque<Timed<Own>> &own, std::deque<Timed<Other>> &other,
+              Evaluate evaluate_pair) {
+        // the other side has moved on beyond these
+        while (!other.empty() && other.front().time_us < time_us - _max_skew_us) {
+            other.pop_front();
+            _result.unmatched++;
+        }
+        auto best = other.end();
+        for (auto candidate = other.begin(); candidate != other.end(); ++candidate) {
+            if (std::llabs(candidate->time_us - time_us) <= _max_skew_us &&
+                (best == other.end() || std::llabs(candidate->time_us - time_us) < std::llabs(best->time_us - time_us))) {
+                best = candidate;
+            }
+        }
+        if (best != other.end()) {
+            evaluate_pair(sample, best->sample);
+            // the ones before the partner are skipped and never pair
+            _result.unmatched += static_cast<uint64_t>(best - other.begin());
+            other.erase(other.begin(), best + 1);
+            return;
+        }
+        own.push_back({time_us, sample});
+        if (own.size() > MAX_BUFFERED) {
+            own.pop_front();
+            _result.unmatched++;
+        }
+    }
+
+public:
+    StreamJoin(std::string name, std::string unit, double tolerance, JoinAlignment alignment,
+               std::chrono::microseconds max_skew, Residual residual) :
+          ConsistencyRule(std::move(name), std::move(unit), tolerance), _residual(std::move(residual)),
+          _alignment(alignment), _max_skew_us(max_skew.count()) {}
+
+    void add(const mavlink_message_t &message, std::chrono::steady_clock::time_point arrival) override {
+        if (message.msgid != msg_helper<A>::ID && message.msgid != msg_helper<B>::ID) {
+            return;
+        }
+        int64_t time_us = 0;
+        if (!timeOf(message, arrival, time_us)) {
+            return;
+        }
+        if (message.msgid == msg_helper<A>::ID) {
+            SampleA sample;
+            msg_helper<A>::unpack(&message, &sample);
+            join(time_us, sample, _a, _b, [this](const SampleA &a, const SampleB &b) { evaluate(_residual(a, b)); });
+        } else {
+            SampleB sample;
+            msg_helper<B>::unpack(&message, &sample);
+            join(time_us, sample, _b, _a, [this](const SampleB &b, const SampleA &a) { evaluate(_residual(a, b)); });
+        }
+    }
+};
+
+/**
+ * Runs consistency rules on the messages of one component as they arrive, from start() until
+ * stop(). Only the statistics of the rules are kept, not the samples.
+ */
+class StreamJoinEngine {
+private:
+    const std::shared_ptr<PassthroughTester> _tester;
+    const uint8_t _system_id;
+    const uint8_t _component_id;
+    std::vector<std::unique_ptr<ConsistencyRule>> _rules;
+    std::mutex _mutex;
+    int _listener_id = -1;
+
+public:
+    StreamJoinEngine(std::shared_ptr<PassthroughTester> tester, const TestTargetAddress &source) :
+          _tester(std::move(tester)), _system_id(source.system_id), _component_id(source.component_id) {}
+
+    ~StreamJoinEngine() {
+        stop();
+    }
+
+    StreamJoinEngine(const StreamJoinEngine&) = delete;
+    StreamJoinEngine& operator=(const StreamJoinEngine&) = delete;
+
+    void add(std::unique_ptr<ConsistencyRule> rule) {
+        std::scoped_lock lock(_mutex);
+        _rules.push_back(std::move(rule));
+    }
+
+    void start() {
+        if (_listener_id >= 0) {
+            return;
+        }
+        _listener_id = _tester->addListener([this](const mavlink_message_t &message,
+                                                   PassthroughTester::Clock::time_point arrival) {
+            if (message.sysid != _system_id || message.compid != _component_id) {
+                return;
+            }
+            std::scoped_lock lock(_mutex);
+            for (auto &rule : _rules) {
+                rule->add(message, arrival);
+            }
+        });
+    }
+
+    void stop() {
+        if (_listener_id >= 0) {
+            _tester->removeListener(_listener_id);
+            _listener_id = -1;
+        }
+    }
+
+    std::vector<ConsistencyResult> results() {
+        std::scoped_lock lock(_mutex);
+        std::vector<ConsistencyResult> results;
+        for (const auto &rule : _rules) {
+            results.push_back(rule->result());
+        }
+        return results;
+    }
+
+    static void print(const std::vector<ConsistencyResult> &results) {
+        printf("  %-36s %8s %10s %10s %10s %10s %10s\n", "Rule", "checked", "mean", "worst", "tolerance",
+               "violations", "unmatched");
+        for (const auto &result : results) {
+            printf("  %-36s %8lu %10.4g %10.4g %10.4g %10lu %10lu %s\n", result.name.c_str(),
+                   static_cast<unsigned long>(result.residual.count()), result.residual.mean(), result.worst,
+                   result.tolerance, static_cast<unsigned long>(result.violations),
+                   static_cast<unsigned long>(result.unmatched), result.unit.c_str());
+        }
+    }
+};
+
+};
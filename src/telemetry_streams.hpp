@@ -0,0 +1,243 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include "passthrough_tester.hpp"
+
+namespace RASATestingSuite {
+
+/**
+ * The message streams the rate tests need, with the minimal_rate of their config. Before the
+ * tests run, the streams that are off or slower than required are set to the required rate with
+ * MAV_CMD_SET_MESSAGE_INTERVAL, and set back to their previous interval at the end. Commands
+ * are sent in batches, so provisioning all streams takes about one round trip per batch.
+ */
+class TelemetryStreams {
+private:
+    struct Registration {
+        uint16_t message_id;
+        std::string message_name;
+    };
+
+    struct Stream {
+        uint16_t message_id;
+        std::string message_name;
+        int component_id;
+        double minimal_rate;
+        int32_t original_interval_us;  // as reported by MESSAGE_INTERVAL, 0 if unknown
+    };
+
+    // the rate set is this much above the required one, so that jitter does not fail the test
+    static constexpr double RATE_HEADROOM = 1.25;
+    static constexpr uint32_t BATCH_TIMEOUT_MS = 1000;
+    static constexpr uint32_t DEFAULT_SAMPLE_TIMEOUT_MS = 5000;
+    static constexpr uint32_t MIN_SAMPLE_TIMEOUT_MS = 500;
+    // a sample may take this many intervals of the required rate before the stream counts as missing
+    static constexpr double SAMPLE_TIMEOUT_INTERVALS = 3.;
+
+    std::map<std::string, Registration> _registrations;  // by full test name
+    std::map<std::string, double> _required_rates;       // by full test name
+    std::vector<Stream> _changed;
+    int _system_id = 0;
+    std::mutex _mutex;
+
+    TelemetryStreams() = default;
+
+    static void sendSetInterval(PassthroughTester &link, const TestTargetAddress &target, uint16_t message_id,
+                                float interval_us) {
+        link.send<COMMAND_LONG>(target, MAV_CMD_SET_MESSAGE_INTERVAL, 0,
+                                static_cast<float>(message_id), interval_us, NAN, NAN, NAN, NAN, 0.f);
+    }
+
+    /**
+     * Collects the COMMAND_ACK of count commands sent to the component, returns how many were
+     * accepted before the batch timed out.
+     */
+    static size_t collectAcks(PassthroughTester &link, const TestTargetAddress &target, uint16_t command,
+                              size_t count) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(BATCH_TIMEOUT_MS);
+        size_t accepted = 0;
+        for (size_t i = 0; i < count; i++) {
+            try {
+                auto ack = link.receiveIf<COMMAND_ACK>(target, remainingMs(deadline), [command](const auto &received) {
+                    return received.command == command;
+                });
+                accepted += ack.result == MAV_RESULT_ACCEPTED;
+            } catch (TimeoutError&) {
+                break;
+            }
+        }
+        return accepted;
+    }
+
+    static uint32_t remainingMs(std::chrono::steady_clock::time_point deadline) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return static_cast<uint32_t>(std::max<int64_t>(1, remaining.count()));
+    }
+
+    static std::map<int, std::vector<Stream*>> byComponent(std::vector<Stream> &streams) {
+        std::map<int, std::vector<Stream*>> components;
+        for (auto &stream : streams) {
+            components[stream.component_id].push_back(&stream);
+        }
+        return components;
+    }
+
+public:
+    static TelemetryStreams& getInstance() {
+        static TelemetryStreams instance;
+        return instance;
+    }
+
+    /**
+     * Registers the stream a rate test measures, usually during static initialization.
+     */
+    void add(const std::string &section, const std::string &test, uint16_t message_id, const std::string &message_name) {
+        std::scoped_lock lock(_mutex);
+        _registrations[section + "." + test] = {message_id, message_name};
+    }
+
+    /**
+     * Configures the streams of the given tests that are going to run. The required rate and
+     * component come from the test config (minimal_rate, component_id).
+     */
+    void provision(PassthroughTester &link, const TestTargetAddress &target, const YAML::Node &config,
+                   const std::set<std::string> &tests) {
+        std::scoped_lock lock(_mutex);
+        _system_id = target.system_id;
+        _required_rates.clear();
+        // the highest rate required per component and message
+        std::map<std::pair<int, uint16_t>, Stream> required;
+        for (const auto &registration : _registrations) {
+            if (tests.count(registration.first) == 0) {
+                continue;
+            }
+            const std::string section = registration.first.substr(0, registration.first.find('.'));
+            const std::string test = registration.first.substr(section.size() + 1);
+            const YAML::Node test_config = config[section][test];
+            const double minimal_rate = test_config["minimal_rate"].as<double>(0.);
+            if (minimal_rate <= 0.) {
+                continue;
+            }
+            _required_rates[registration.first] = minimal_rate;
+            const int component_id = test_config["component_id"].as<int>(target.component_id);
+            Stream &stream = required[{component_id, registration.second.message_id}];
+            stream = {registration.second.message_id, registration.second.message_name, component_id,
+                      std::max(stream.minimal_rate, minimal_rate), 0};
+        }
+        std::vector<Stream> streams;
+        for (const auto &entry : required) {
+            streams.push_back(entry.second);
+        }
+        if (streams.empty()) {
+            return;
+        }
+
+        // current intervals, requested for all streams of a component at once
+        for (auto &component : byComponent(streams)) {
+            const TestTargetAddress component_target{target.system_id, component.first};
+            for (const Stream* stream : component.second) {
+                link.send<COMMAND_LONG>(component_target, MAV_CMD_GET_MESSAGE_INTERVAL, 0,
+                                        static_cast<float>(stream->message_id), NAN, NAN, NAN, NAN, NAN, NAN);
+            }
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(BATCH_TIMEOUT_MS);
+            for (Stream* stream : component.second) {
+                try {
+                    auto interval = link.receiveIf<MESSAGE_INTERVAL>(component_target, remainingMs(deadline),
+                                                                     [stream](const auto &received) {
+                        return received.message_id == stream->message_id;
+                    });
+                    stream->original_interval_us = interval.interval_us;
+                } catch (TimeoutError&) {
+                }
+            }
+            link.flush<COMMAND_ACK>(component_target);
+        }
+
+        // raise the streams that are off, unknown or too slow
+        std::vector<Stream> changed;
+        for (const auto &stream : streams) {
+            const bool running = stream.original_interval_us > 0;
+            if (!running || 1e6 / stream.original_interval_us < stream.minimal_rate) {
+                changed.push_back(stream);
+            }
+        }
+        size_t accepted = 0;
+        for (auto &component : byComponent(changed)) {
+            const TestTargetAddress component_target{target.system_id, component.first};
+            for (const Stream* stream : component.second) {
+                sendSetInterval(link, component_target, stream->message_id,
+                                static_cast<float>(1e6 / (stream->minimal_rate * RATE_HEADROOM)));
+            }
+            accepted += collectAcks(link, component_target, MAV_CMD_SET_MESSAGE_INTERVAL, component.second.size());
+            link.flush<COMMAND_ACK>(component_target);
+            // the rate is measured from the new interval on
+            for (const Stream* stream : component.second) {
+                link.resetRate(stream->message_id, target.system_id, component.first);
+            }
+        }
+        _changed = changed;
+
+        printf("Streams: %zu required, %zu already fast enough", streams.size(), streams.size() - changed.size());
+        if (!changed.empty()) {
+            printf(", set %zu of %zu:", accepted, changed.size());
+            for (const auto &stream : changed) {
+                if (stream.original_interval_us > 0) {
+                    printf(" %s %.1f->%.1f Hz", stream.message_name.c_str(), 1e6 / stream.original_interval_us,
+                           stream.minimal_rate * RATE_HEADROOM);
+                } else {
+                    printf(" %s %s->%.1f Hz", stream.message_name.c_str(),
+                           stream.original_interval_us < 0 ? "off" : "?", stream.minimal_rate * RATE_HEADROOM);
+                }
+            }
+        }
+        printf("\n");
+    }
+
+    /**
+     * Sets the changed streams back to their previous interval, or to their default rate if it
+     * was unknown.
+     */
+    void restore(PassthroughTester &link) {
+        std::scoped_lock lock(_mutex);
+        size_t accepted = 0;
+        for (auto &component : byComponent(_changed)) {
+            const TestTargetAddress component_target{_system_id, component.first};
+            for (const Stream* stream : component.second) {
+                // -1 disables the stream again, 0 requests the default rate
+                sendSetInterval(link, component_target, stream->message_id,
+                                stream->original_interval_us < 0 ? -1.f : static_cast<float>(stream->original_interval_us));
+            }
+            accepted += collectAcks(link, component_target, MAV_CMD_SET_MESSAGE_INTERVAL, component.second.size());
+        }
+        if (!_changed.empty()) {
+            printf("Streams: restored %zu of %zu\n", accepted, _changed.size());
+        }
+        _changed.clear();
+    }
+
+    /**
+     * How long a rate test waits for one message: a few intervals of the required rate, so a
+     * stream that is missing fails fast instead of after the full default timeout.
+     */
+    uint32_t sampleTimeoutMs(const std::string &test) {
+        std::scoped_lock lock(_mutex);
+        auto rate = _required_rates.find(test);
+        if (rate == _required_rates.end()) {
+            return DEFAULT_SAMPLE_TIMEOUT_MS;
+        }
+        double timeout_ms = SAMPLE_TIMEOUT_INTERVALS * 1000. / rate->second;
+        return static_cast<uint32_t>(std::clamp(timeout_ms, static_cast<double>(MIN_SAMPLE_TIMEOUT_MS),
+                                                static_cast<double>(DEFAULT_SAMPLE_TIMEOUT_MS)));
+    }
+};
+
+};
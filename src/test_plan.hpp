@@ -0,0 +1,303 @@
+#pragma once
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include "gtest/gtest.h"
+
+namespace RASATestingSuite {
+
+class ConfigError : public std::runtime_error {
+public:
+    ConfigError(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+/**
+ * Config keys each test reads besides skip, by gtest full name. Filled by CONFIG_KEYS during
+ * static initialization, so that the plan can reject keys no test reads.
+ */
+inline std::map<std::string, std::set<std::string>>& configKeysByTest() {
+    static std::map<std::string, std::set<std::string>> keys;
+    return keys;
+}
+
+inline bool registerConfigKeys(const std::string &test, const std::set<std::string> &keys) {
+    configKeysByTest()[test].insert(keys.begin(), keys.end());
+    return true;
+}
+
+// declares the config keys read by the test SUITE.NAME, with the gtest names
+#define CONFIG_KEYS(SUITE, NAME, ...) \
+    [[maybe_unused]] static const bool SUITE##_##NAME##_config_keys = \
+        RASATestingSuite::registerConfigKeys(#SUITE "." #NAME, {__VA_ARGS__})
+
+/**
+ * The YAML config compiled against the registered tests. Validated once at startup, so that
+ * a typo fails the run immediately instead of silently skipping a test. Tests that are skipped
+ * or not configured are excluded through the gtest filter, before their fixture is built.
+ */
+class TestPlan {
+private:
+    // config names that differ from the gtest names
+    inline static const std::map<std::string, std::string> SUITE_ALIASES = {
+        {"Param", "Params"},
+    };
+    inline static const std::map<std::string, std::string> TEST_ALIASES = {
+        {"Mission.UploadTakeoffReturn", "Mission.UploadTakeoffChangeSpeedReturn"},
+    };
+
+    static constexpr unsigned DEFAULT_PARALLEL_JOBS = 8;
+    static constexpr unsigned DEFAULT_RTT_PROBE_INTERVAL_MS = 1000;
+    static constexpr unsigned DEFAULT_TIMESYNC_INTERVAL_MS = 1000;
+
+    std::map<std::string, bool> _skip;  // by gtest full name of the configured tests
+    uint8_t _system_id = 0;
+    uint8_t _component_id = 0;
+    double _sim_factor = 0.;
+    unsigned _parallel_jobs = DEFAULT_PARALLEL_JOBS;
+    unsigned _receive_timeout_ms = 0;
+    unsigned _rtt_probe_interval_ms = DEFAULT_RTT_PROBE_INTERVAL_MS;
+    unsigned _timesync_interval_ms = DEFAULT_TIMESYNC_INTERVAL_MS;
+    bool _provision_streams = true;
+
+    static uint8_t parseId(const YAML::Node &global, const std::string &key) {
+        const YAML::Node node = global[key];
+        int id = -1;
+        try {
+            id = node.as<int>();
+        } catch (YAML::Exception&) {
+        }
+        if (id < 0 || id > 255) {
+            throw ConfigError("Global." + key + " must be an id between 0 and 255");
+        }
+        return static_cast<uint8_t>(id);
+    }
+
+    static unsigned parseCount(const YAML::Node &global, const std::string &key) {
+        int value = -1;
+        try {
+            value = global[key].as<int>();
+        } catch (YAML::Exception&) {
+        }
+        if (value < 0) {
+            throw ConfigError("Global." + key + " must be 0 or a positive number");
+        }
+        return static_cast<unsigned>(value);
+    }
+
+    void parseGlobal(const YAML::Node &config) {
+        const YAML::Node global = config["Global"];
+        if (!global.IsMap()) {
+            throw ConfigError("Missing Global section");
+        }
+        _system_id = parseId(global, "system_id");
+        _component_id = parseId(global, "component_id");
+
+        if (global["parallel_jobs"]) {
+            _parallel_jobs = parseCount(global, "parallel_jobs");
+        }
+        if (global["rtt_probe_interval_ms"]) {
+            _rtt_probe_interval_ms = parseCount(global, "rtt_probe_interval_ms");
+        }
+        if (global["timesync_interval_ms"]) {
+            _timesync_interval_ms = parseCount(global, "timesync_interval_ms");
+        }
+        if (global["provision_streams"]) {
+            try {
+                _provision_streams = global["provision_streams"].as<bool>();
+            } catch (YAML::Exception&) {
+                throw ConfigError("Global.provision_streams must be true or false");
+            }
+        }
+        const YAML::Node receive_timeout = global["receive_timeout_ms"];
+        if (receive_timeout && receive_timeout.as<std::string>() != "auto") {
+            _receive_timeout_ms = parseCount(global, "receive_timeout_ms");
+            if (_receive_timeout_ms == 0) {
+                throw ConfigError("Global.receive_timeout_ms must be \"auto\" or a positive number");
+            }
+        }
+
+        // a fixed factor overrides the estimation, older configs have it in the Telemetry section
+        for (const char* section : {"Global", "Telemetry"}) {
+            const YAML::Node sim_factor = config[section]["sim_factor"];
+            if (!sim_factor || sim_factor.as<std::string>() == "auto") {
+                continue;
+            }
+            try {
+                _sim_factor = sim_factor.as<double>();
+            } catch (YAML::Exception&) {
+            }
+            if (_sim_factor <= 0.) {
+                throw ConfigError(std::string(section) + ".sim_factor must be \"auto\" or a positive number");
+            }
+            break;
+        }
+    }
+
+    static std::map<std::string, std::set<std::string>> registeredTests() {
+        std::map<std::string, std::set<std::string>> tests;
+        auto* unit_test = ::testing::UnitTest::GetInstance();
+        for (int i = 0; i < unit_test->total_test_suite_count(); i++) {
+            const auto* suite = unit_test->GetTestSuite(i);
+            for (int j = 0; j < suite->total_test_count(); j++) {
+                tests[suite->name()].insert(suite->GetTestInfo(j)->name());
+            }
+        }
+        return tests;
+    }
+
+    static void checkKeys(const std::string &full_name, const std::string &config_key, const YAML::Node &node) {
+        static const std::set<std::string> NONE;
+        const auto declared = configKeysByTest().find(full_name);
+        const std::set<std::string> &keys = declared != configKeysByTest().end() ? declared->second : NONE;
+        for (const auto &item : node) {
+            const std::string key = item.first.as<std::string>();
+            if (key == "skip" || keys.count(key) > 0) {
+                continue;
+            }
+            std::string known = "skip";
+            for (const auto &name : keys) {
+                known += ", " + name;
+            }
+            throw ConfigError("Unknown key " + config_key + "." + key + ", the test reads " + known);
+        }
+    }
+
+    void parseSection(const std::string &section, const YAML::Node &node,
+                      const std::map<std::string, std::set<std::string>> &registered) {
+        if (!node.IsMap()) {
+            throw ConfigError("Section " + section + " must be a map");
+        }
+        const std::string suite = SUITE_ALIASES.count(section) > 0 ? SUITE_ALIASES.at(section) : section;
+        for (const auto &item : node) {
+            const std::string key = item.first.as<std::string>();
+            const std::string config_key = section + "." + key;
+            if (item.second.IsScalar() || item.second.IsSequence()) {
+                continue;  // parameter of the whole section, e.g. Mission.home_lat
+            }
+            std::string full_name = suite + "." + key;
+            if (TEST_ALIASES.count(config_key) > 0) {
+                full_name = TEST_ALIASES.at(config_key);
+            }
+            const std::string name = full_name.substr(full_name.find('.') + 1);
+            auto registered_suite = registered.find(suite);
+            if (registered_suite == registered.end() || registered_suite->second.count(name) == 0) {
+                std::cerr << "Config entry " << config_key << " matches no test, ignoring it\n";
+                continue;
+            }
+
+            checkKeys(full_name, config_key, item.second);
+
+            bool skip = false;
+            const YAML::Node skip_node = item.second["skip"];
+            if (skip_node) {
+                try {
+                    skip = skip_node.as<bool>();
+                } catch (YAML::Exception&) {
+                    throw ConfigError(config_key + ".skip must be true or false");
+                }
+            }
+            _skip[full_name] = skip;
+        }
+    }
+
+public:
+    /**
+     * Throws ConfigError if the config is invalid. Needs the tests to be registered, which
+     * happens during static initialization.
+     */
+    TestPlan(const YAML::Node &config) {
+        if (!config.IsMap()) {
+            throw ConfigError("Config must be a map of sections");
+        }
+        parseGlobal(config);
+        const auto registered = registeredTests();
+        for (const auto &section : config) {
+            const std::string name = section.first.as<std::string>();
+            if (name != "Global") {
+                parseSection(name, section.second, registered);
+            }
+        }
+    }
+
+    uint8_t systemId() const {
+        return _system_id;
+    }
+
+    uint8_t componentId() const {
+        return _component_id;
+    }
+
+    // configured simulation speed, 0 if it is estimated
+    double simFactor() const {
+        return _sim_factor;
+    }
+
+    // threads for the observations run before the tests, 0 runs each with its test
+    unsigned parallelJobs() const {
+        return _parallel_jobs;
+    }
+
+    // fixed default receive timeout, 0 if it follows the round trip time
+    unsigned receiveTimeoutMs() const {
+        return _receive_timeout_ms;
+    }
+
+    // interval of the PINGs measuring the round trip time, 0 measures on commands only
+    unsigned rttProbeIntervalMs() const {
+        return _rtt_probe_interval_ms;
+    }
+
+    // interval of the TIMESYNC requests for the vehicle clock offset, 0 turns them off
+    unsigned timesyncIntervalMs() const {
+        return _timesync_interval_ms;
+    }
+
+    // whether the streams of the rate tests are set to their required rate before the tests
+    bool provisionStreams() const {
+        return _provision_streams;
+    }
+
+    bool isEnabled(const std::string &suite, const std::string &name) const {
+        auto entry = _skip.find(suite + "." + name);
+        return entry != _skip.end() && !entry->second;
+    }
+
+    std::vector<std::string> disabledTests() const {
+        std::vector<std::string> disabled;
+        for (const auto &suite : registeredTests()) {
+            for (const auto &name : suite.second) {
+                if (!isEnabled(suite.first, name)) {
+                    disabled.push_back(suite.first + "." + name);
+                }
+            }
+        }
+        return disabled;
+    }
+
+    /**
+     * Adds the disabled tests to the negative patterns of a gtest filter, so that a filter given
+     * on the command line still applies.
+     */
+    std::string mergeFilter(const std::string &filter) const {
+        const std::vector<std::string> disabled = disabledTests();
+        if (disabled.empty()) {
+            return filter;
+        }
+        std::string merged = filter.empty() ? "*" : filter;
+        merged += merged.find('-') == std::string::npos ? "-" : ":";
+        for (size_t i = 0; i < disabled.size(); i++) {
+            merged += (i > 0 ? ":" : "") + disabled[i];
+        }
+        return merged;
+    }
+
+    void applyFilter() const {
+        ::testing::GTEST_FLAG(filter) = mergeFilter(::testing::GTEST_FLAG(filter));
+    }
+};
+
+};
@@ -1,44 +1,174 @@
 #include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
 #include "../environment.hpp"
+#include "../statistics.hpp"
 using namespace RASATestingSuite;
 
 class Arm : public ::testing::Test {
 protected:
+    using Clock = std::chrono::steady_clock;
+
     const std::shared_ptr<PassthroughTester> link;
     const TestTargetAddress target;
+    CommandClient commands;
+
+    // one arming or disarming, timed by the arrival of the messages on the link
+    struct Transition {
+        bool armed = false;
+        Clock::time_point sent;
+        std::optional<Clock::time_point> ack;
+        std::optional<Clock::time_point> state;
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    Transition _transition;
+    int _listener = -1;
+    bool _heartbeat_rate_changed = false;
 
     Arm() :
           link(Environment::getInstance()->getPassthroughTester()),
-          target(Environment::getInstance()->getTargetAddress()) {
+          target(Environment::getInstance()->getTargetAddress()),
+          commands(link) {
         link->flushAll();
     }
+
+    // also cleans up after a test that ended with an exception, the link outlives the fixture
+    ~Arm() override {
+        if (_listener >= 0) {
+            link->removeListener(_listener);
+        }
+        if (_heartbeat_rate_changed) {
+            try {
+                setHeartbeatInterval(0.f);
+            } catch (TimeoutError&) {
+                printf("Could not restore the HEARTBEAT rate\n");
+            }
+        }
+    }
+
+    // in microseconds, 0 restores the default rate
+    void setHeartbeatInterval(float interval_us) {
+        commands.sendLong(target, MAV_CMD_SET_MESSAGE_INTERVAL, static_cast<float>(msg_helper<HEARTBEAT>::ID),
+                          interval_us, NAN, NAN, NAN, NAN, 0.f);
+    }
+
+    void onMessage(const mavlink_message_t &message, Clock::time_point arrival) {
+        if (message.sysid != target.system_id || message.compid != target.component_id) {
+            return;
+        }
+        std::scoped_lock lock(_mutex);
+        if (message.msgid == msg_helper<COMMAND_ACK>::ID && !_transition.ack) {
+            mavlink_command_ack_t ack;
+            msg_helper<COMMAND_ACK>::unpack(&message, &ack);
+            if (ack.command == MAV_CMD_COMPONENT_ARM_DISARM) {
+                _transition.ack = arrival;
+            }
+        } else if (message.msgid == msg_helper<HEARTBEAT>::ID && !_transition.state && arrival > _transition.sent) {
+            mavlink_heartbeat_t heartbeat;
+            msg_helper<HEARTBEAT>::unpack(&message, &heartbeat);
+            if (((heartbeat.base_mode & MAV_MODE_FLAG_SAFETY_ARMED) != 0) == _transition.armed) {
+                _transition.state = arrival;
+            }
+        }
+        _changed.notify_all();
+    }
+
+    /**
+     * Arms or disarms and waits until a HEARTBEAT shows the new state.
+     */
+    Transition transition(bool armed, uint32_t state_timeout_ms) {
+        {
+            std::scoped_lock lock(_mutex);
+            _transition = Transition();
+            _transition.armed = armed;
+            _transition.sent = Clock::now();
+        }
+        auto result = commands.sendLong(target, MAV_CMD_COMPONENT_ARM_DISARM, armed ? 1.f : 0.f,
+                                        NAN, NAN, NAN, NAN, NAN, NAN);
+        EXPECT_EQ(result.result, MAV_RESULT_ACCEPTED) << (armed ? "Arming" : "Disarming") << " not accepted";
+        std::unique_lock lock(_mutex);
+        _changed.wait_for(lock, std::chrono::milliseconds(link->scaleTimeout(state_timeout_ms)), [this]() {
+            return _transition.state.has_value();
+        });
+        return _transition;
+    }
+
+    static double ms(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
 };
 
+CONFIG_KEYS(Arm, ArmDisarm, "cycles", "heartbeat_rate_hz", "state_timeout_ms", "max_ack_ms", "max_state_ms");
+
 TEST_F(Arm, ArmDisarm) {
     auto conf = Environment::getInstance()->getConfig({"Arm", "ArmDisarm"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    link->send<COMMAND_LONG>(target, MAV_CMD_COMPONENT_ARM_DISARM,
-                             0, 1., NAN, NAN, NAN, NAN, NAN, NAN);
-    auto ack = link->receive<COMMAND_ACK>(target);
-    EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-
-    EXPECT_TRUE(link->expectCondition<HEARTBEAT>(target, 10, 2000, [](auto msg) {
-        return (msg.base_mode & MAV_MODE_FLAG_SAFETY_ARMED) == MAV_MODE_FLAG_SAFETY_ARMED;
-    })) << "MAV_MODE_SAFETY_ARMED not set to true";
-
-
-    link->send<COMMAND_LONG>(target, MAV_CMD_COMPONENT_ARM_DISARM,
-                             0, 0.f, NAN, NAN, NAN, NAN, NAN, NAN);
-    ack = link->receive<COMMAND_ACK>(target);
-    EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
+    const int cycles = conf["cycles"].as<int>(1);
+    const uint32_t state_timeout_ms = conf["state_timeout_ms"].as<uint32_t>(10000);
 
-    link->flush<HEARTBEAT>(target);
+    // a faster HEARTBEAT resolves the time of the state change better
+    const double heartbeat_rate = conf["heartbeat_rate_hz"].as<double>(0.);
+    if (heartbeat_rate > 0.) {
+        _heartbeat_rate_changed = true;
+        setHeartbeatInterval(static_cast<float>(1e6 / heartbeat_rate));
+    }
+    _listener = link->addListener([this](const mavlink_message_t &message, Clock::time_point arrival) {
+        onMessage(message, arrival);
+    });
 
-    EXPECT_TRUE(link->expectCondition<HEARTBEAT>(target, 10, 2000, [](auto msg) {
-        return (msg.base_mode & MAV_MODE_FLAG_SAFETY_ARMED) == 0;
-    })) << "MAV_MODE_SAFETY_ARMED not re-set to false";
+    std::map<std::string, RunningStats> latencies_ms;
+    for (int cycle = 0; cycle < cycles && !HasFailure(); cycle++) {
+        for (bool armed : {true, false}) {
+            const std::string name = armed ? "arm" : "disarm";
+            Transition transition;
+            try {
+                transition = this->transition(armed, state_timeout_ms);
+            } catch (TimeoutError &e) {
+                ADD_FAILURE() << (armed ? "Arming: " : "Disarming: ") << e.what();
+                break;
+            }
+            if (!transition.state) {
+                ADD_FAILURE() << "MAV_MODE_SAFETY_ARMED not " << (armed ? "set to true" : "re-set to false");
+                break;
+            }
+            if (transition.ack) {
+                latencies_ms[name + " command to ack"].add(ms(transition.sent, *transition.ack));
+                // the state may also show before the ack arrives
+                latencies_ms[name + " ack to HEARTBEAT"].add(ms(*transition.ack, *transition.state));
+            }
+            latencies_ms[name + " command to HEARTBEAT"].add(ms(transition.sent, *transition.state));
+        }
+    }
+    link->removeListener(_listener);
+    _listener = -1;
 
+    for (const auto &latency : latencies_ms) {
+        printf("  %-28s min %8.1f ms, mean %8.1f ms, max %8.1f ms from %lu\n", latency.first.c_str(),
+               latency.second.min(), latency.second.mean(), latency.second.max(),
+               static_cast<unsigned long>(latency.second.count()));
+        RecordProperty(latency.first + " max_ms", std::to_string(latency.second.max()));
+    }
+    const std::map<std::string, std::string> limits = {
+        {"max_ack_ms", "command to ack"}, {"max_state_ms", "command to HEARTBEAT"},
+    };
+    for (const auto &limit : limits) {
+        if (!conf[limit.first]) {
+            continue;
+        }
+        for (const char* name : {"arm ", "disarm "}) {
+            auto latency = latencies_ms.find(name + limit.second);
+            if (latency != latencies_ms.end()) {
+                EXPECT_LE(latency->second.max(), conf[limit.first].as<double>()) << latency->first;
+            }
+        }
+    }
 }
-
@@ -2,9 +2,19 @@
 #include <sys/time.h>
 #include <filesystem>
 #include "../environment.hpp"
+#include "../observations.hpp"
 #include <curl/curl.h>
 using namespace RASATestingSuite;
 
+// the message requests only observe the vehicle and run concurrently before the tests
+[[maybe_unused]] static const bool request_observations_registered = []() {
+    addRequestMessageObservation<CAMERA_INFORMATION>("Camera.RequestCameraInformation");
+    addRequestMessageObservation<CAMERA_SETTINGS>("Camera.RequestCameraSettings");
+    addRequestMessageObservation<STORAGE_INFORMATION>("Camera.RequestStorageInformation");
+    addRequestMessageObservation<VIDEO_STREAM_INFORMATION>("Camera.RequestVideoStreamInformation");
+    return true;
+}();
+
 inline uint64_t micros() {
     struct timeval t;
     gettimeofday(&t, nullptr);
@@ -18,15 +28,15 @@ size_t write_data(void *ptr, size_t size, size_t nmemb, FILE *stream) {
 
 class Camera : public ::testing::Test {
 protected:
-    const std::shared_ptr<mavsdk::Ftp> ftp;
     const std::shared_ptr<PassthroughTester> link;
     const TestTargetAddress target;
+    CommandClient commands;
 
 
     Camera() :
-          ftp(Environment::getInstance()->getFtpPlugin()),
           link(Environment::getInstance()->getPassthroughTester()),
-          target(Environment::getInstance()->getTargetAddress()) {
+          target(Environment::getInstance()->getTargetAddress()),
+          commands(link) {
         link->flushAll();
     }
 
@@ -34,12 +44,9 @@ protected:
     typename msg_helper<MSG>::decode_type requestMessageCommand() {
         // make sure to flush all existing messages
         link->flush<MSG>(target);
-        link->send<COMMAND_LONG>(target,
-                                 MAV_CMD_REQUEST_MESSAGE, 0,
-                                 static_cast<float>(msg_helper<MSG>::ID), NAN, NAN, NAN, NAN, NAN, NAN);
-        auto ack = link->receive<COMMAND_ACK>(target);
+        auto ack = commands.sendLong(target, MAV_CMD_REQUEST_MESSAGE,
+                                     static_cast<float>(msg_helper<MSG>::ID), NAN, NAN, NAN, NAN, NAN, NAN);
         EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-        EXPECT_EQ(ack.command, MAV_CMD_REQUEST_MESSAGE);
         return link->receive<MSG>(target, 1000);
     }
 };
@@ -49,7 +56,7 @@ TEST_F(Camera, RequestCameraInformation) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    requestMessageCommand<CAMERA_INFORMATION>();
+    expectRequestedMessage(Scheduler::getInstance().awaitCurrentTest());
 }
 
 TEST_F(Camera, RequestCameraSettings) {
@@ -57,7 +64,7 @@ TEST_F(Camera, RequestCameraSettings) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    requestMessageCommand<CAMERA_SETTINGS>();
+    expectRequestedMessage(Scheduler::getInstance().awaitCurrentTest());
 }
 
 TEST_F(Camera, SetCameraMode) {
@@ -65,10 +72,8 @@ TEST_F(Camera, SetCameraMode) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    link->send<COMMAND_LONG>(target, MAV_CMD_SET_CAMERA_MODE, 0, 0, CAMERA_MODE_IMAGE, NAN, NAN, NAN, NAN, NAN);
-    auto ack = link->receive<COMMAND_ACK>(target);
+    auto ack = commands.sendLong(target, MAV_CMD_SET_CAMERA_MODE, 0, CAMERA_MODE_IMAGE, NAN, NAN, NAN, NAN, NAN);
     EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-    EXPECT_EQ(ack.command, MAV_CMD_SET_CAMERA_MODE);
 }
 
 TEST_F(Camera, RequestStorageInformation) {
@@ -76,7 +81,7 @@ TEST_F(Camera, RequestStorageInformation) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    requestMessageCommand<STORAGE_INFORMATION>();
+    expectRequestedMessage(Scheduler::getInstance().awaitCurrentTest());
 }
 
 TEST_F(Camera, CaptureImage) {
@@ -86,26 +91,24 @@ TEST_F(Camera, CaptureImage) {
     }
 
     // demand to capture 3 images with 1s in between
-    link->send<COMMAND_LONG>(target, MAV_CMD_IMAGE_START_CAPTURE, 0, 0, 1.f, 3, 0, NAN, NAN, NAN);
-    auto ack = link->receive<COMMAND_ACK>(target);
+    auto ack = commands.sendLong(target, MAV_CMD_IMAGE_START_CAPTURE, 0, 1.f, 3, 0, NAN, NAN, NAN);
     EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-    EXPECT_EQ(ack.command, MAV_CMD_IMAGE_START_CAPTURE);
 
-    int last_interval_time = micros();
+    const double sim_factor = Environment::getInstance()->getSimFactor();
+    uint64_t last_interval_time = micros();
 
     for (int i=0; i<3; i++) {
         link->receive<CAMERA_IMAGE_CAPTURED>(target, 2000);
-        int interval = micros() - last_interval_time;
+        // the capture interval is in vehicle time
+        double interval = static_cast<double>(micros() - last_interval_time) * sim_factor;
         last_interval_time = micros();
 
-        EXPECT_GT(interval, 900000) << "Camera picture timing incorrect";
-        EXPECT_LT(interval, 1100000) << "Camera picture timing incorrect";
+        EXPECT_GT(interval, 900000.) << "Camera picture timing incorrect";
+        EXPECT_LT(interval, 1100000.) << "Camera picture timing incorrect";
     }
 
-    link->send<COMMAND_LONG>(target, MAV_CMD_IMAGE_STOP_CAPTURE, 0, 0, 0, 0, 0, NAN, NAN, NAN);
-    auto ack_stop = link->receive<COMMAND_ACK>(target);
+    auto ack_stop = commands.sendLong(target, MAV_CMD_IMAGE_STOP_CAPTURE, 0, 0, 0, 0, NAN, NAN, NAN);
     EXPECT_EQ(ack_stop.result, MAV_RESULT_ACCEPTED);
-    EXPECT_EQ(ack_stop.command, MAV_CMD_IMAGE_STOP_CAPTURE);
 
     try {
         link->receive<CAMERA_IMAGE_CAPTURED>(target, 2000);
@@ -121,19 +124,15 @@ TEST_F(Camera, CaptureVideo) {
     }
 
     // demand to capture 3 images with 1s in between
-    link->send<COMMAND_LONG>(target, MAV_CMD_VIDEO_START_CAPTURE, 0, 1, 5, NAN, NAN, NAN, NAN, NAN);
-    auto ack = link->receive<COMMAND_ACK>(target);
+    auto ack = commands.sendLong(target, MAV_CMD_VIDEO_START_CAPTURE, 1, 5, NAN, NAN, NAN, NAN, NAN);
     EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-    EXPECT_EQ(ack.command, MAV_CMD_VIDEO_START_CAPTURE);
 
     for (int i=0; i<3; i++) {
         link->receive<CAMERA_CAPTURE_STATUS>(target, 2000);
     }
 
-    link->send<COMMAND_LONG>(target, MAV_CMD_VIDEO_STOP_CAPTURE, 0, 0, 0, 0, 0, NAN, NAN, NAN);
-    auto ack_stop = link->receive<COMMAND_ACK>(target);
+    auto ack_stop = commands.sendLong(target, MAV_CMD_VIDEO_STOP_CAPTURE, 0, 0, 0, 0, NAN, NAN, NAN);
     EXPECT_EQ(ack_stop.result, MAV_RESULT_ACCEPTED);
-    EXPECT_EQ(ack_stop.command, MAV_CMD_VIDEO_STOP_CAPTURE);
 
     // we should no longer get image capture notifications
     try {
@@ -148,7 +147,7 @@ TEST_F(Camera, RequestVideoStreamInformation) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    requestMessageCommand<VIDEO_STREAM_INFORMATION>();
+    expectRequestedMessage(Scheduler::getInstance().awaitCurrentTest());
 }
 
 TEST_F(Camera, DownloadCameraDefintionFile) {
@@ -166,6 +165,10 @@ TEST_F(Camera, DownloadCameraDefintionFile) {
     std::filesystem::remove(downloaded_file);
 
     if (cam_definition_uri.rfind("mftp", 0) == 0) {
+        auto ftp = Environment::getInstance()->getFtpPlugin();
+        if (!ftp) {
+            GTEST_SKIP() << "MAVSDK FTP plugin not available through a connection agent";
+        }
         // using mavlink ftp to download
         auto prom = std::promise<mavsdk::Ftp::Result>{};
         auto future = prom.get_future();
@@ -1,30 +1,54 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
 #include "../environment.hpp"
+#include "../observations.hpp"
 using namespace RASATestingSuite;
 
+// the message requests only observe the vehicle and run concurrently before the tests
+[[maybe_unused]] static const bool request_observations_registered = []() {
+    addRequestMessageObservation<PROTOCOL_VERSION>("Command.RequestMessage");
+    addRequestMessageObservation<ALTITUDE>("Command.RequestAltitude");
+    addRequestMessageObservation<POI_REPORT>("Command.RequestPoiReport");
+    addRequestMessageObservation<HOME_POSITION>("Command.RequestHomePosition");
+    addRequestMessageObservation<FLIGHT_INFORMATION>("Command.RequestFlightInformation");
+    return true;
+}();
+
 class Command : public ::testing::Test {
 protected:
     const std::shared_ptr<PassthroughTester> link;
     const TestTargetAddress target;
+    CommandClient commands;
 
 
     Command() :
           link(Environment::getInstance()->getPassthroughTester()),
-          target(Environment::getInstance()->getTargetAddress()) {
+          target(Environment::getInstance()->getTargetAddress()),
+          commands(link) {
         link->flushAll();
     }
 
-    template <int MSG>
-    void requestMessageCommand() {
-        // make sure to flush all existing ALTITUDE messages
-        link->flush<MSG>(target);
-        link->send<COMMAND_LONG>(target,
-                                 MAV_CMD_REQUEST_MESSAGE, 0,
-                                 static_cast<float>(msg_helper<MSG>::ID), NAN, NAN, NAN, NAN, NAN, NAN);
-        auto ack = link->receive<COMMAND_ACK>(target);
-        EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-        EXPECT_EQ(ack.command, MAV_CMD_REQUEST_MESSAGE);
-        link->receive<MSG>(target, 1000);
+    uint8_t setMessageInterval(const TestTargetAddress &component, int message_id, float interval_us) {
+        link->flush<COMMAND_ACK>(component);
+        return commands.sendLong(component, MAV_CMD_SET_MESSAGE_INTERVAL, static_cast<float>(message_id),
+                                 interval_us, NAN, NAN, NAN, NAN, 0.f).result;
+    }
+
+    // interval_us as reported by MESSAGE_INTERVAL: -1 if the stream is off, 0 if not reported
+    int32_t getMessageInterval(const TestTargetAddress &component, int message_id) {
+        link->flush<MESSAGE_INTERVAL>(component);
+        link->send<COMMAND_LONG>(component, MAV_CMD_GET_MESSAGE_INTERVAL, 0,
+                                 static_cast<float>(message_id), NAN, NAN, NAN, NAN, NAN, NAN);
+        try {
+            return link->receiveIf<MESSAGE_INTERVAL>(component, [message_id](const auto &received) {
+                return received.message_id == message_id;
+            }).interval_us;
+        } catch (TimeoutError&) {
+            return 0;
+        }
     }
 };
 
@@ -33,7 +57,7 @@ TEST_F(Command, RequestMessage) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    requestMessageCommand<PROTOCOL_VERSION>();
+    expectRequestedMessage(Scheduler::getInstance().awaitCurrentTest());
 }
 
 TEST_F(Command, RequestProtocolVersion) {
@@ -46,12 +70,8 @@ TEST_F(Command, RequestProtocolVersion) {
         link->receive<PROTOCOL_VERSION>(target);
         FAIL() << "PROTOCOL_VERSION published before requesting. Can not do test";
     } catch(...) {}
-    link->send<COMMAND_LONG>(target,
-                             MAV_CMD_REQUEST_PROTOCOL_VERSION, 0,
-                             1.f, NAN, NAN, NAN, NAN, NAN, NAN);
-    auto ack = link->receive<COMMAND_ACK>(target);
+    auto ack = commands.sendLong(target, MAV_CMD_REQUEST_PROTOCOL_VERSION, 1.f, NAN, NAN, NAN, NAN, NAN, NAN);
     EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-    EXPECT_EQ(ack.command, MAV_CMD_REQUEST_PROTOCOL_VERSION);
     auto version = link->receive<PROTOCOL_VERSION>(target, 1000);
     EXPECT_GE(version.version, 200);
 }
@@ -66,12 +86,8 @@ TEST_F(Command, RequestAutopilotCapabilities) {
         link->receive<AUTOPILOT_VERSION>(target);
         FAIL() << "AUTOPILOT_VERSION published before requesting. Can not do test";
     } catch(...) {}
-    link->send<COMMAND_LONG>(target,
-                             MAV_CMD_REQUEST_AUTOPILOT_CAPABILITIES, 0,
-                             1.f, NAN, NAN, NAN, NAN, NAN, NAN);
-    auto ack = link->receive<COMMAND_ACK>(target);
+    auto ack = commands.sendLong(target, MAV_CMD_REQUEST_AUTOPILOT_CAPABILITIES, 1.f, NAN, NAN, NAN, NAN, NAN, NAN);
     EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-    EXPECT_EQ(ack.command, MAV_CMD_REQUEST_AUTOPILOT_CAPABILITIES);
     link->receive<AUTOPILOT_VERSION>(target, 1000);
 }
 
@@ -80,7 +96,7 @@ TEST_F(Command, RequestAltitude) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    requestMessageCommand<ALTITUDE>();
+    expectRequestedMessage(Scheduler::getInstance().awaitCurrentTest());
 }
 
 TEST_F(Command, RequestPoiReport) {
@@ -88,7 +104,7 @@ TEST_F(Command, RequestPoiReport) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    requestMessageCommand<POI_REPORT>();
+    expectRequestedMessage(Scheduler::getInstance().awaitCurrentTest());
 }
 
 TEST_F(Command, RequestHomePosition) {
@@ -96,7 +112,7 @@ TEST_F(Command, RequestHomePosition) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    requestMessageCommand<HOME_POSITION>();
+    expectRequestedMessage(Scheduler::getInstance().awaitCurrentTest());
 }
 
 TEST_F(Command, RequestFlightInformation) {
@@ -104,7 +120,7 @@ TEST_F(Command, RequestFlightInformation) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    requestMessageCommand<FLIGHT_INFORMATION>();
+    expectRequestedMessage(Scheduler::getInstance().awaitCurrentTest());
 }
 
 TEST_F(Command, SetMessageInterval) {
@@ -114,10 +130,72 @@ TEST_F(Command, SetMessageInterval) {
     }
     link->flush<MESSAGE_INTERVAL>(target);
 
-    link->send<COMMAND_LONG>(target,
-                             MAV_CMD_SET_MESSAGE_INTERVAL, 0,
-                             msg_helper<ATTITUDE>::ID, 200000.F, 0.f, NAN, NAN, NAN, NAN);
-    auto ack = link->receive<COMMAND_ACK>(target);
+    auto ack = commands.sendLong(target, MAV_CMD_SET_MESSAGE_INTERVAL,
+                                 msg_helper<ATTITUDE>::ID, 200000.F, 0.f, NAN, NAN, NAN, NAN);
     EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-    EXPECT_EQ(ack.command, MAV_CMD_SET_MESSAGE_INTERVAL);
+}
+
+CONFIG_KEYS(Command, MessageIntervalSweep, "component_id", "duration_s", "messages", "min_rate_hz", "rates", "tolerance");
+
+TEST_F(Command, MessageIntervalSweep) {
+    auto conf = Environment::getInstance()->getConfig({"Command", "MessageIntervalSweep"});
+    if (!conf || conf["skip"].as<bool>(false)) {
+        GTEST_SKIP();
+    }
+    const auto rates = conf["rates"].as<std::vector<double>>(std::vector<double>{1., 10., 50., 100., 250.});
+    ASSERT_FALSE(rates.empty()) << "No rates to sweep";
+    const double duration_s = conf["duration_s"].as<double>(3.);
+    // an achieved rate this close to the requested one counts as reached
+    const double tolerance = conf["tolerance"].as<double>(0.1);
+    const TestTargetAddress component{target.system_id, conf["component_id"].as<int>(target.component_id)};
+    const double sim_factor = Environment::getInstance()->getSimFactor();
+
+    for (const auto &name : conf["messages"].as<std::vector<std::string>>(std::vector<std::string>{"ATTITUDE"})) {
+        const int message_id = messageIdByName(name);
+        if (message_id < 0) {
+            ADD_FAILURE() << "Unknown message " << name;
+            continue;
+        }
+        const int32_t original_interval_us = getMessageInterval(component, message_id);
+        printf("%s (interval before %d us)\n", name.c_str(), original_interval_us);
+        printf("  %12s %12s %12s %19s %10s %10s %10s\n", "requested Hz", "reported Hz", "achieved Hz",
+               "95% confidence", "p50 ms", "p99 ms", "max gap ms");
+        double highest_reached_hz = 0.;
+        for (double rate : rates) {
+            const uint8_t result = setMessageInterval(component, message_id, static_cast<float>(1e6 / rate));
+            EXPECT_EQ(result, MAV_RESULT_ACCEPTED) << name << " at " << rate << " Hz";
+            const int32_t reported_us = getMessageInterval(component, message_id);
+            link->resetRate(message_id, component.system_id, component.component_id);
+            // at least a few intervals at low rates, in vehicle time
+            const double wait_s = std::max(duration_s, 5. / rate) / sim_factor;
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait_s));
+
+            // measured in host time, the requested rates are in vehicle time
+            const RateEstimate achieved = link->getRate(message_id, component.system_id, component.component_id);
+            const IntervalStats intervals = link->getIntervalStats(message_id, component.system_id,
+                                                                   component.component_id);
+            const double achieved_hz = achieved.rate_hz / sim_factor;
+            printf("  %12.1f %12.1f %12.1f %8.1f .. %-8.1f %10.1f %10.1f %10.1f\n", rate,
+                   reported_us > 0 ? 1e6 / reported_us : 0., achieved_hz, achieved.low_hz / sim_factor,
+                   achieved.high_hz / sim_factor, intervals.histogram_ms.percentile(0.5) * sim_factor,
+                   intervals.histogram_ms.percentile(0.99) * sim_factor, intervals.max_gap_ms * sim_factor);
+            if (achieved_hz >= rate * (1. - tolerance)) {
+                highest_reached_hz = std::max(highest_reached_hz, rate);
+            }
+        }
+        if (highest_reached_hz < rates.back()) {
+            printf("  %s saturates above %.1f Hz\n", name.c_str(), highest_reached_hz);
+        }
+        RecordProperty(name + "_max_rate_hz", std::to_string(highest_reached_hz));
+
+        // back to the previous interval, or to the default rate if it was not reported
+        const float restore_us = original_interval_us == 0 ? 0.f : static_cast<float>(original_interval_us);
+        EXPECT_EQ(setMessageInterval(component, message_id, restore_us), MAV_RESULT_ACCEPTED)
+                << "Restoring " << name;
+        link->resetRate(message_id, component.system_id, component.component_id);
+
+        if (conf["min_rate_hz"]) {
+            EXPECT_GE(highest_reached_hz, conf["min_rate_hz"].as<double>()) << name << " saturates too early";
+        }
+    }
 }
@@ -0,0 +1,280 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../environment.hpp"
+using namespace RASATestingSuite;
+
+namespace {
+
+// commands that can be given by name in the config, any other by number
+const std::map<std::string, uint16_t> COMMANDS_BY_NAME = {
+    {"MAV_CMD_REQUEST_MESSAGE", MAV_CMD_REQUEST_MESSAGE},
+    {"MAV_CMD_SET_MESSAGE_INTERVAL", MAV_CMD_SET_MESSAGE_INTERVAL},
+    {"MAV_CMD_GET_MESSAGE_INTERVAL", MAV_CMD_GET_MESSAGE_INTERVAL},
+    {"MAV_CMD_REQUEST_PROTOCOL_VERSION", MAV_CMD_REQUEST_PROTOCOL_VERSION},
+    {"MAV_CMD_REQUEST_AUTOPILOT_CAPABILITIES", MAV_CMD_REQUEST_AUTOPILOT_CAPABILITIES},
+    {"MAV_CMD_SET_CAMERA_MODE", MAV_CMD_SET_CAMERA_MODE},
+    {"MAV_CMD_DO_SET_ROI_LOCATION", MAV_CMD_DO_SET_ROI_LOCATION},
+    {"MAV_CMD_DO_SET_ROI_NONE", MAV_CMD_DO_SET_ROI_NONE},
+};
+
+struct Latencies {
+    std::vector<double> ack_ms;      // sorted
+    std::vector<double> message_ms;  // sorted
+    size_t sent = 0;
+    size_t rejected = 0;
+    size_t unanswered = 0;
+    size_t missing_messages = 0;
+    size_t late = 0;  // answers that arrived after their repetition timed out
+    bool streamed = false;  // the message arrived unrequested, so only the ack was timed
+
+    static double percentile(const std::vector<double> &sorted, double p) {
+        if (sorted.empty()) {
+            return 0.;
+        }
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())))];
+    }
+};
+
+}
+
+class CommandLatency : public ::testing::Test {
+protected:
+    using Clock = std::chrono::steady_clock;
+
+    const std::shared_ptr<PassthroughTester> link;
+    const TestTargetAddress target;
+
+    CommandLatency() :
+          link(Environment::getInstance()->getPassthroughTester()),
+          target(Environment::getInstance()->getTargetAddress()) {
+        link->flushAll();
+    }
+
+    ~CommandLatency() override {
+        link->flushAll();
+    }
+
+    static uint16_t commandId(const YAML::Node &command) {
+        auto found = COMMANDS_BY_NAME.find(command.as<std::string>());
+        return found != COMMANDS_BY_NAME.end() ? found->second : command.as<uint16_t>();
+    }
+
+    /**
+     * Sends the command repetitions times, one at a time, and times the COMMAND_ACK and, if
+     * message_id is not -1, the message it requests, both from their arrival on the link. After a
+     * timeout, the late answer is awaited before the next repetition, so it is not taken as the
+     * answer to that one. A message that also arrives unrequested, watched for timeout_ms before
+     * the first repetition and between the repetitions, is streamed and cannot be told from the
+     * answer, so only the ack is timed then.
+     */
+    Latencies benchmark(const TestTargetAddress &component, uint16_t command, const std::vector<float> &params,
+                        bool command_int, int message_id, size_t repetitions, uint32_t timeout_ms) {
+        std::mutex mutex;
+        std::condition_variable answered;
+        Clock::time_point sent;
+        Clock::time_point ack_arrival;
+        Clock::time_point message_arrival;
+        bool waiting = false;
+        bool acked = false;
+        bool received = false;
+        bool late_ack = false;
+        bool late_message = false;
+        uint8_t result = 0;
+        int timed_message = message_id;
+        size_t unrequested = 0;
+        Latencies latencies;
+
+        const int listener = link->addListener([&](const mavlink_message_t &message, Clock::time_point arrival) {
+            if (message.sysid != component.system_id || message.compid != component.component_id) {
+                return;
+            }
+            std::scoped_lock lock(mutex);
+            if (!waiting) {
+                if (message.msgid == msg_helper<COMMAND_ACK>::ID && late_ack) {
+                    mavlink_command_ack_t ack;
+                    msg_helper<COMMAND_ACK>::unpack(&message, &ack);
+                    if (ack.command != command || ack.result == MAV_RESULT_IN_PROGRESS) {
+                        return;
+                    }
+                    late_ack = false;
+                } else if (static_cast<int>(message.msgid) == message_id && late_message) {
+                    late_message = false;
+                } else {
+                    unrequested += static_cast<int>(message.msgid) == message_id;
+                    return;
+                }
+                latencies.late++;
+                answered.notify_all();
+                return;
+            }
+            if (message.msgid == msg_helper<COMMAND_ACK>::ID && !acked) {
+                mavlink_command_ack_t ack;
+                msg_helper<COMMAND_ACK>::unpack(&message, &ack);
+                if (ack.command != command || ack.result == MAV_RESULT_IN_PROGRESS) {
+                    return;
+                }
+                acked = true;
+                result = ack.result;
+                ack_arrival = arrival;
+            } else if (static_cast<int>(message.msgid) == timed_message && !received) {
+                received = true;
+                message_arrival = arrival;
+            } else {
+                return;
+            }
+            answered.notify_all();
+        });
+
+        if (message_id >= 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+            std::scoped_lock lock(mutex);
+            if (unrequested > 0) {
+                latencies.streamed = true;
+                timed_message = -1;
+            }
+        }
+
+        for (size_t i = 0; i < repetitions; i++) {
+            {
+                std::unique_lock lock(mutex);
+                answered.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&]() {
+                    return !late_ack && !late_message;
+                });
+                late_ack = false;
+                late_message = false;
+                waiting = true;
+                acked = false;
+                received = false;
+                sent = Clock::now();
+            }
+            if (command_int) {
+                link->send<COMMAND_INT>(component, MAV_FRAME_GLOBAL_INT, command, 0, 0, params[0], params[1],
+                                        params[2], params[3], static_cast<int32_t>(params[4]),
+                                        static_cast<int32_t>(params[5]), params[6]);
+            } else {
+                link->send<COMMAND_LONG>(component, command, 0, params[0], params[1], params[2], params[3],
+                                         params[4], params[5], params[6]);
+            }
+            latencies.sent++;
+
+            std::unique_lock lock(mutex);
+            answered.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&]() {
+                return acked && (timed_message < 0 || received || result != MAV_RESULT_ACCEPTED);
+            });
+            waiting = false;
+            if (!acked) {
+                latencies.unanswered++;
+                late_ack = true;
+                late_message = timed_message >= 0;
+                continue;
+            }
+            latencies.ack_ms.push_back(std::chrono::duration<double, std::milli>(ack_arrival - sent).count());
+            if (result != MAV_RESULT_ACCEPTED) {
+                latencies.rejected++;
+            } else if (timed_message >= 0) {
+                if (received) {
+                    latencies.message_ms.push_back(std::chrono::duration<double, std::milli>(message_arrival - sent).count());
+                } else {
+                    latencies.missing_messages++;
+                    late_message = true;
+                }
+            }
+        }
+        link->removeListener(listener);
+        if (unrequested > 0 && !latencies.streamed) {
+            latencies.streamed = true;
+            latencies.message_ms.clear();
+            latencies.missing_messages = 0;
+        }
+        std::sort(latencies.ack_ms.begin(), latencies.ack_ms.end());
+        std::sort(latencies.message_ms.begin(), latencies.message_ms.end());
+        return latencies;
+    }
+};
+
+CONFIG_KEYS(CommandLatency, Benchmark, "commands", "repetitions", "timeout_ms");
+
+TEST_F(CommandLatency, Benchmark) {
+    auto conf = Environment::getInstance()->getConfig({"CommandLatency", "Benchmark"});
+    if (!conf || conf["skip"].as<bool>(false)) {
+        GTEST_SKIP();
+    }
+    const size_t default_repetitions = conf["repetitions"].as<size_t>(20);
+    const uint32_t timeout_ms = conf["timeout_ms"].as<uint32_t>(1000);
+
+    printf("  %-40s %5s %8s %8s %8s %8s %10s %10s %6s\n", "Command", "sent", "ack min", "ack p50", "ack p99",
+           "ack max", "msg p50", "msg p99", "failed");
+    for (const auto &entry : conf["commands"]) {
+        const std::string name = entry.first.as<std::string>();
+        const YAML::Node &command_conf = entry.second;
+        const uint16_t command = commandId(command_conf["command"]);
+        const TestTargetAddress component{target.system_id, command_conf["component_id"].as<int>(target.component_id)};
+
+        // missing parameters are NAN, a message name as first parameter of a request is its id
+        std::vector<float> params(7, NAN);
+        int message_id = -1;
+        if (command_conf["message"]) {
+            message_id = messageIdByName(command_conf["message"].as<std::string>());
+            if (message_id < 0) {
+                ADD_FAILURE() << name << ": unknown message " << command_conf["message"].as<std::string>();
+                continue;
+            }
+            params[0] = static_cast<float>(message_id);
+        }
+        const auto configured = command_conf["params"].as<std::vector<float>>(std::vector<float>{});
+        const size_t first = message_id >= 0 ? 1 : 0;
+        std::copy_n(configured.begin(), std::min(configured.size(), params.size() - first), params.begin() + first);
+        const bool command_int = command_conf["int"].as<bool>(false);
+        if (command_int) {
+            // x and y of COMMAND_INT are integers
+            params[4] = std::isnan(params[4]) ? 0.f : params[4];
+            params[5] = std::isnan(params[5]) ? 0.f : params[5];
+        }
+
+        const Latencies latencies = benchmark(component, command, params, command_int, message_id,
+                                              command_conf["repetitions"].as<size_t>(default_repetitions), timeout_ms);
+        const size_t failed = latencies.unanswered + latencies.rejected + latencies.missing_messages;
+        printf("  %-40s %5zu %8.1f %8.1f %8.1f %8.1f ", name.c_str(), latencies.sent,
+               Latencies::percentile(latencies.ack_ms, 0.), Latencies::percentile(latencies.ack_ms, 0.5),
+               Latencies::percentile(latencies.ack_ms, 0.99), Latencies::percentile(latencies.ack_ms, 1.));
+        if (message_id >= 0 && !latencies.streamed) {
+            printf("%10.1f %10.1f", Latencies::percentile(latencies.message_ms, 0.5),
+                   Latencies::percentile(latencies.message_ms, 0.99));
+        } else {
+            printf("%10s %10s", "-", "-");
+        }
+        printf(" %6zu\n", failed);
+        if (latencies.streamed) {
+            printf("  %-40s message is streamed, only the ack is timed\n", "");
+        }
+        if (latencies.late > 0) {
+            printf("  %-40s %zu answers arrived after the timeout\n", "", latencies.late);
+        }
+
+        RecordProperty(name + " ack_p99_ms", std::to_string(Latencies::percentile(latencies.ack_ms, 0.99)));
+        EXPECT_EQ(latencies.unanswered, 0u) << name << ": commands without COMMAND_ACK";
+        EXPECT_EQ(latencies.rejected, 0u) << name << ": commands not accepted";
+        EXPECT_EQ(latencies.missing_messages, 0u) << name << ": requested message not received";
+        if (command_conf["max_p50_ack_ms"]) {
+            EXPECT_LE(Latencies::percentile(latencies.ack_ms, 0.5), command_conf["max_p50_ack_ms"].as<double>()) << name;
+        }
+        if (command_conf["max_p99_ack_ms"]) {
+            EXPECT_LE(Latencies::percentile(latencies.ack_ms, 0.99), command_conf["max_p99_ack_ms"].as<double>()) << name;
+        }
+        if (message_id >= 0 && !latencies.streamed) {
+            RecordProperty(name + " message_p99_ms", std::to_string(Latencies::percentile(latencies.message_ms, 0.99)));
+            if (command_conf["max_p99_message_ms"]) {
+                EXPECT_LE(Latencies::percentile(latencies.message_ms, 0.99),
+                          command_conf["max_p99_message_ms"].as<double>()) << name;
+            }
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include "../environment.hpp"
+
+using namespace RASATestingSuite;
+
+namespace {
+
+/**
+ * A vehicle behind a transport that answers every COMMAND_LONG with two COMMAND_ACKs, as it does
+ * when it also received a retransmission. The acks carry the number of the command received in
+ * result_param2.
+ */
+class DuplicatingVehicle : public Transport {
+private:
+    static constexpr uint8_t OUR_SYSTEM_ID = 255;
+
+    MessageCallback _incoming;
+    MessageCallback _outgoing;
+    std::mutex _mutex;
+    int32_t _commands = 0;
+
+public:
+    static constexpr uint8_t SYSTEM_ID = 1;
+    static constexpr uint8_t COMPONENT_ID = 1;
+
+    void send(mavlink_message_t &message) override {
+        MessageCallback incoming;
+        MessageCallback outgoing;
+        int32_t number = 0;
+        {
+            std::scoped_lock lock(_mutex);
+            incoming = _incoming;
+            outgoing = _outgoing;
+            number = message.msgid == msg_helper<COMMAND_LONG>::ID ? ++_commands : 0;
+        }
+        if (outgoing) {
+            outgoing(message);
+        }
+        if (number == 0 || !incoming) {
+            return;
+        }
+        mavlink_command_long_t command;
+        msg_helper<COMMAND_LONG>::unpack(&message, &command);
+        for (int copy = 0; copy < 2; copy++) {
+            mavlink_message_t ack;
+            msg_helper<COMMAND_ACK>::pack(SYSTEM_ID, COMPONENT_ID, &ack, command.command,
+                                          static_cast<uint8_t>(MAV_RESULT_ACCEPTED), 0, number, message.sysid,
+                                          message.compid);
+            incoming(ack);
+        }
+    }
+
+    uint8_t ourSystemId() const override {
+        return OUR_SYSTEM_ID;
+    }
+
+    uint8_t ourComponentId() const override {
+        return MAV_COMP_ID_MISSIONPLANNER;
+    }
+
+    void subscribeIncoming(MessageCallback callback) override {
+        std::scoped_lock lock(_mutex);
+        _incoming = std::move(callback);
+    }
+
+    void subscribeOutgoing(MessageCallback callback) override {
+        std::scoped_lock lock(_mutex);
+        _outgoing = std::move(callback);
+    }
+};
+
+}
+
+/**
+ * Checks the CommandClient against a simulated vehicle, without using the connection.
+ */
+class CommandProtocol : public ::testing::Test {
+protected:
+    const std::shared_ptr<DuplicatingVehicle> vehicle;
+    const std::shared_ptr<PassthroughTester> link;
+    const TestTargetAddress target;
+
+    CommandProtocol() :
+          vehicle(std::make_shared<DuplicatingVehicle>()),
+          link(std::make_shared<PassthroughTester>(vehicle)),
+          target{DuplicatingVehicle::SYSTEM_ID, DuplicatingVehicle::COMPONENT_ID} {}
+};
+
+TEST_F(CommandProtocol, DuplicateAck) {
+    auto conf = Environment::getInstance()->getConfig({"CommandProtocol", "DuplicateAck"});
+    if (!conf || conf["skip"].as<bool>(false)) {
+        GTEST_SKIP();
+    }
+    CommandClient commands(link);
+    const auto request = [&]() {
+        return commands.sendLong(target, MAV_CMD_REQUEST_MESSAGE, static_cast<float>(msg_helper<HEARTBEAT>::ID),
+                                 NAN, NAN, NAN, NAN, NAN, NAN);
+    };
+    const CommandResult first = request();
+    EXPECT_EQ(first.result_param2, 1);
+    // the second ack of the first command is still queued
+    const CommandResult second = request();
+    EXPECT_EQ(second.result_param2, 2) << "Took the duplicate COMMAND_ACK of the previous command";
+    EXPECT_EQ(second.transmissions, 1);
+}
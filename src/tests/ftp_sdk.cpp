@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "../environment.hpp"
+#include "../protocol_stats.hpp"
 #include <future>
 #include <memory>
 #include <vector>
@@ -16,6 +17,7 @@ protected:
     const std::string FILENAME = "dummy_data.bin";
 
     const std::shared_ptr<mavsdk::Ftp> ftp;
+    const std::shared_ptr<PassthroughTester> link;
     const YAML::Node config;
     size_t file_size;
     std::string target_path;
@@ -28,6 +30,7 @@ protected:
 
     FTPSDK() :
           ftp(Environment::getInstance()->getFtpPlugin()),
+          link(Environment::getInstance()->getPassthroughTester()),
           config(Environment::getInstance()->getConfig({"FTPSDK"}))
     {
         if (!!config) {
@@ -87,6 +90,16 @@ protected:
         }
     }
 
+    /**
+     * MAVLink FTP is strictly request / response and MAVSDK repeats a request until it gets an
+     * answer, so every request without its own response is a retry.
+     */
+    uint64_t ftpRetries(uint64_t sent_before, uint64_t received_before) {
+        uint64_t sent = link->getTxCount(msg_helper<FILE_TRANSFER_PROTOCOL>::ID) - sent_before;
+        uint64_t received = link->getRxCount(msg_helper<FILE_TRANSFER_PROTOCOL>::ID) - received_before;
+        return sent > received ? sent - received : 0;
+    }
+
     bool checkFilesEqual(const std::filesystem::path &f1, const std::filesystem::path &f2) {
         std::ifstream if1, if2;
         if1.open(f1, std::ios::binary);
@@ -116,10 +129,16 @@ TEST_F(FTPSDK, UploadCompareDownloadCompare) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
+    if (!ftp) {
+        GTEST_SKIP() << "MAVSDK FTP plugin not available through a connection agent";
+    }
 
     {
         auto prom = std::promise<mavsdk::Ftp::Result>{};
         auto future = prom.get_future();
+        ProtocolStats stats("ftp_upload", link);
+        const uint64_t sent = link->getTxCount(msg_helper<FILE_TRANSFER_PROTOCOL>::ID);
+        const uint64_t received = link->getRxCount(msg_helper<FILE_TRANSFER_PROTOCOL>::ID);
         ftp->upload_async(
             _out_file.c_str(), target_path,
             [&prom](const mavsdk::Ftp::Result result, const mavsdk::Ftp::ProgressData& progress) {
@@ -131,6 +150,9 @@ TEST_F(FTPSDK, UploadCompareDownloadCompare) {
 
         future.wait_for(std::chrono::seconds(5));
         auto res = future.get();
+        stats.addPayloadBytes(file_size);
+        stats.addRetries(ftpRetries(sent, received));
+        stats.finish();
         ASSERT_EQ(res, mavsdk::Ftp::Result::Success);
     }
 
@@ -149,6 +171,9 @@ TEST_F(FTPSDK, UploadCompareDownloadCompare) {
     {
         auto prom = std::promise<mavsdk::Ftp::Result>{};
         auto future = prom.get_future();
+        ProtocolStats stats("ftp_download", link);
+        const uint64_t sent = link->getTxCount(msg_helper<FILE_TRANSFER_PROTOCOL>::ID);
+        const uint64_t received = link->getRxCount(msg_helper<FILE_TRANSFER_PROTOCOL>::ID);
         ftp->download_async(
             target_path + FILENAME, (_temp_dir / IN_DIR).c_str(),
             [&prom](const mavsdk::Ftp::Result result, const mavsdk::Ftp::ProgressData& progress) {
@@ -160,6 +185,9 @@ TEST_F(FTPSDK, UploadCompareDownloadCompare) {
 
         future.wait_for(std::chrono::seconds(5));
         auto res = future.get();
+        stats.addPayloadBytes(file_size);
+        stats.addRetries(ftpRetries(sent, received));
+        stats.finish();
         ASSERT_EQ(res, mavsdk::Ftp::Result::Success);
 
         bool files_equal = checkFilesEqual(_out_file, _temp_dir / IN_DIR / FILENAME);
@@ -1,31 +1,27 @@
 #include <gtest/gtest.h>
 #include "../environment.hpp"
+#include "../observations.hpp"
 using namespace RASATestingSuite;
 
+// the message requests only observe the vehicle and run concurrently before the tests
+[[maybe_unused]] static const bool request_observations_registered = []() {
+    addRequestMessageObservation<GIMBAL_MANAGER_INFORMATION>("Gimbal.RequestGimbalManagerInformation");
+    return true;
+}();
+
 class Gimbal : public ::testing::Test {
 protected:
     const std::shared_ptr<PassthroughTester> link;
     const TestTargetAddress target;
+    CommandClient commands;
 
 
     Gimbal() :
           link(Environment::getInstance()->getPassthroughTester()),
-          target(Environment::getInstance()->getTargetAddress()) {
+          target(Environment::getInstance()->getTargetAddress()),
+          commands(link) {
         link->flushAll();
     }
-
-    template <int MSG>
-    void requestMessageCommand() {
-        // make sure to flush all existing ALTITUDE messages
-        link->flush<MSG>(target);
-        link->send<COMMAND_LONG>(target,
-                                 MAV_CMD_REQUEST_MESSAGE, 0,
-                                 static_cast<float>(msg_helper<MSG>::ID), NAN, NAN, NAN, NAN, NAN, NAN);
-        auto ack = link->receive<COMMAND_ACK>(target);
-        EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-        EXPECT_EQ(ack.command, MAV_CMD_REQUEST_MESSAGE);
-        link->receive<MSG>(target, 1000);
-    }
 };
 
 TEST_F(Gimbal, RequestGimbalManagerInformation) {
@@ -33,7 +29,7 @@ TEST_F(Gimbal, RequestGimbalManagerInformation) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    requestMessageCommand<GIMBAL_MANAGER_INFORMATION>();
+    expectRequestedMessage(Scheduler::getInstance().awaitCurrentTest());
 }
 
 TEST_F(Gimbal, SetGimbalROILocation) {
@@ -41,12 +37,9 @@ TEST_F(Gimbal, SetGimbalROILocation) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    link->send<COMMAND_INT>(target, MAV_FRAME_GLOBAL_INT,
-                             MAV_CMD_DO_SET_ROI_LOCATION, 0, 0, 154.,
-                             NAN, NAN, NAN, 0, 0, NAN);
-    auto ack = link->receive<COMMAND_ACK>(target);
+    auto ack = commands.sendInt(target, MAV_FRAME_GLOBAL_INT, MAV_CMD_DO_SET_ROI_LOCATION, 154.f,
+                                NAN, NAN, NAN, 0, 0, NAN);
     EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-    EXPECT_EQ(ack.command, MAV_CMD_DO_SET_ROI_LOCATION);
 }
 
 TEST_F(Gimbal, SetGimbalROINone) {
@@ -54,10 +47,7 @@ TEST_F(Gimbal, SetGimbalROINone) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    link->send<COMMAND_INT>(target, MAV_FRAME_GLOBAL_INT,
-                            MAV_CMD_DO_SET_ROI_NONE, 0, 0, 154.,
-                            NAN, NAN, NAN, 0, 0, NAN);
-    auto ack = link->receive<COMMAND_ACK>(target);
+    auto ack = commands.sendInt(target, MAV_FRAME_GLOBAL_INT, MAV_CMD_DO_SET_ROI_NONE, 154.f,
+                                NAN, NAN, NAN, 0, 0, NAN);
     EXPECT_EQ(ack.result, MAV_RESULT_ACCEPTED);
-    EXPECT_EQ(ack.command, MAV_CMD_DO_SET_ROI_NONE);
 }
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "../environment.hpp"
+
+using namespace RASATestingSuite;
+
+/**
+ * Compares the links when connected to the vehicle over several of them, with a comma
+ * separated connection URL.
+ */
+class Link : public ::testing::Test {
+protected:
+    const std::shared_ptr<PassthroughTester> link;
+    const TestTargetAddress target;
+
+    Link() :
+          link(Environment::getInstance()->getPassthroughTester()),
+          target(Environment::getInstance()->getTargetAddress()) {
+        link->flushAll();
+    }
+
+    void SetUp() override {
+        if (link->linkCount() < 2) {
+            GTEST_SKIP() << "Connected over a single link";
+        }
+    }
+};
+
+CONFIG_KEYS(Link, CompareLinks, "duration_s", "max_loss");
+
+TEST_F(Link, CompareLinks) {
+    auto conf = Environment::getInstance()->getConfig({"Link", "CompareLinks"});
+    const double duration_s = conf["duration_s"].as<double>(10.);
+    const double max_loss = conf["max_loss"].as<double>(0.05);
+
+    auto before = link->getLinkStats();
+    std::this_thread::sleep_for(std::chrono::duration<double>(duration_s));
+    auto after = link->getLinkStats();
+
+    printf("  %-5s %9s %10s %7s %10s %12s %11s\n", "link", "messages", "kB/s", "loss", "duplicates",
+           "mean lag ms", "max lag ms");
+    for (size_t i = 0; i < after.size(); i++) {
+        const uint64_t messages = after[i].rx_messages - before[i].rx_messages;
+        const uint64_t lost = after[i].lost - before[i].lost;
+        const uint64_t duplicates = after[i].duplicates - before[i].duplicates;
+        const double kbytes_per_s = static_cast<double>(after[i].rx_bytes - before[i].rx_bytes) / 1000. / duration_s;
+        const double loss = messages + lost > 0 ? static_cast<double>(lost) / static_cast<double>(messages + lost) : 0.;
+        const double mean_lag_ms = duplicates > 0 ? (after[i].lag_sum_ms - before[i].lag_sum_ms) / duplicates : 0.;
+        printf("  %-5zu %9lu %10.1f %6.2f%% %10lu %12.2f %11.2f\n", i, messages, kbytes_per_s, loss * 100.,
+               duplicates, mean_lag_ms, after[i].lag_max_ms);
+
+        const std::string prefix = "link" + std::to_string(i) + "_";
+        RecordProperty(prefix + "messages", std::to_string(messages));
+        RecordProperty(prefix + "loss", std::to_string(loss));
+        RecordProperty(prefix + "mean_lag_ms", std::to_string(mean_lag_ms));
+
+        EXPECT_GT(messages, 0u) << "Nothing received on link " << i;
+        EXPECT_LE(loss, max_loss) << "Loss on link " << i;
+    }
+}
+
+CONFIG_KEYS(Link, PingLatencyPerLink, "n_pings");
+
+TEST_F(Link, PingLatencyPerLink) {
+    auto conf = Environment::getInstance()->getConfig({"Link", "PingLatencyPerLink"});
+    const int n_pings = conf["n_pings"].as<int>(10);
+
+    uint32_t seq = 1000;
+    for (size_t i = 0; i < link->linkCount(); i++) {
+        std::vector<double> rtts_ms;
+        for (int n = 0; n < n_pings; n++, seq++) {
+            auto sent = std::chrono::steady_clock::now();
+            uint64_t time_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+            link->sendVia<PING>(i, time_usec, seq, 0, 0);
+            try {
+                link->receiveIf<PING>(target, [seq](const auto &ping) {
+                    return ping.seq == seq;
+                });
+                rtts_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+            } catch (TimeoutError&) {
+            }
+        }
+        ASSERT_FALSE(rtts_ms.empty()) << "No ping answered on link " << i;
+        std::sort(rtts_ms.begin(), rtts_ms.end());
+        printf("  link %zu: %zu/%d answered, rtt min %.2f ms, median %.2f ms, max %.2f ms\n", i, rtts_ms.size(),
+               n_pings, rtts_ms.front(), rtts_ms[rtts_ms.size() / 2], rtts_ms.back());
+        RecordProperty("link" + std::to_string(i) + "_median_rtt_ms", std::to_string(rtts_ms[rtts_ms.size() / 2]));
+    }
+}
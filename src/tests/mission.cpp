@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "../environment.hpp"
 #include "../passthrough_messages.hpp"
+#include "../protocol_stats.hpp"
 
 using namespace RASATestingSuite;
 
@@ -17,6 +18,9 @@ protected:
     const YAML::Node config;
     const TestTargetAddress target;
 
+    // attempts per message exchange before giving up on a lossy link
+    static constexpr int MAX_ATTEMPTS = 5;
+
     Mission() :
           link(Environment::getInstance()->getPassthroughTester()),
           config(Environment::getInstance()->getConfig({"Mission"})),
@@ -57,36 +61,87 @@ protected:
         };
     }
 
-    void uploadMission(int N_ITEMS=10) {
-        EXPECT_TRUE(hasCapability(MAV_PROTOCOL_CAPABILITY_COMMAND_INT)) << "MISSION_INT capability not reported";
-        link->send<MISSION_COUNT>(target, N_ITEMS, MAV_MISSION_TYPE_MISSION);
-        auto req = link->receive<MISSION_REQUEST_INT>(target);
+    void sendMissionItem(int seq) {
+        auto c = missionCoordGen(seq);
+        link->send<MISSION_ITEM_INT>(target, seq, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_WAYPOINT, 0, 1,
+                                     0.f, 1.f, 0.f, NAN,
+                                     c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_MISSION);
+    }
+
+    /**
+     * Runs the upload part of the mission protocol for count items of the given type. send_item
+     * sends the item with the given sequence number. Lost messages are recovered as in the
+     * protocol: we repeat our last message on timeout, and answer repeated requests again.
+     */
+    void uploadItems(uint8_t mission_type, int count, const std::function<void(int)> &send_item,
+                     const std::string &name = "mission_upload") {
+        ProtocolStats stats(name, link);
+        auto send_count = [&]() {
+            link->send<MISSION_COUNT>(target, count, mission_type);
+        };
+        send_count();
+        auto req = link->receiveRetrying<MISSION_REQUEST_INT>(target, MAX_ATTEMPTS, [&]() {
+            stats.addRetry();
+            send_count();
+        });
         EXPECT_EQ(req.seq, 0);
 
-        for (int i=0; i<N_ITEMS; i++) {
-            auto c = missionCoordGen(i);
-            link->send<MISSION_ITEM_INT>(target, i, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_WAYPOINT, 0, 1,
-                                         0.f, 1.f, 0.f, NAN,
-                                         c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_MISSION);
-            if (i<N_ITEMS -1) {
-                req = link->receive<MISSION_REQUEST_INT>(target);
-                EXPECT_EQ(req.seq, i+1);
-            } else {
-                auto ack = link->receive<MISSION_ACK>(1,1);
-                EXPECT_EQ(ack.type, MAV_MISSION_ACCEPTED) << "Mission not accepted" << std::endl;
+        int highest_sent = -1;
+        while (true) {
+            const int seq = req.seq;
+            ASSERT_LT(seq, count) << "Requested item out of range";
+            EXPECT_LE(seq, highest_sent + 1) << "Requested items not in sequence";
+            if (seq <= highest_sent) {
+                stats.addRetry();
+            }
+            highest_sent = std::max(highest_sent, seq);
+            send_item(seq);
+
+            auto resend = [&]() {
+                stats.addRetry();
+                send_item(seq);
+            };
+            if (highest_sent == count - 1) {
+                auto ack = link->receiveRetrying<MISSION_ACK>(target, MAX_ATTEMPTS, resend);
+                EXPECT_EQ(ack.type, MAV_MISSION_ACCEPTED) << name << " not accepted" << std::endl;
+                return;
             }
+            req = link->receiveRetrying<MISSION_REQUEST_INT>(target, MAX_ATTEMPTS, resend);
         }
     }
 
+    void uploadMission(int N_ITEMS=10) {
+        EXPECT_TRUE(hasCapability(MAV_PROTOCOL_CAPABILITY_COMMAND_INT)) << "MISSION_INT capability not reported";
+        uploadItems(MAV_MISSION_TYPE_MISSION, N_ITEMS, [this](int seq) { sendMissionItem(seq); });
+    }
+
     void downloadMission(int N_ITEMS=10) {
-        link->send<MISSION_REQUEST_LIST>(target, MAV_MISSION_TYPE_MISSION);
-        auto cnt = link->receive<MISSION_COUNT>(target);
+        ProtocolStats stats("mission_download", link);
+        auto request_list = [&]() {
+            link->send<MISSION_REQUEST_LIST>(target, MAV_MISSION_TYPE_MISSION);
+        };
+        request_list();
+        auto cnt = link->receiveRetrying<MISSION_COUNT>(target, MAX_ATTEMPTS, [&]() {
+            stats.addRetry();
+            request_list();
+        });
 
         EXPECT_EQ(cnt.count, N_ITEMS) << "Received wrong mission count" << std::endl;
         EXPECT_EQ(cnt.mission_type, MAV_MISSION_TYPE_MISSION) << "Received count for wrong mission type" << std::endl;
         for (int i=0; i<N_ITEMS; i++) {
-            link->send<MISSION_REQUEST_INT>(target, i, MAV_MISSION_TYPE_MISSION);
-            auto item = link->receive<MISSION_ITEM_INT>(target);
+            auto request_item = [&]() {
+                link->send<MISSION_REQUEST_INT>(target, i, MAV_MISSION_TYPE_MISSION);
+            };
+            auto resend = [&]() {
+                stats.addRetry();
+                request_item();
+            };
+            request_item();
+            auto item = link->receiveRetrying<MISSION_ITEM_INT>(target, MAX_ATTEMPTS, resend);
+            // answers to repeated requests of earlier items can still arrive
+            while (item.seq < i) {
+                item = link->receiveRetrying<MISSION_ITEM_INT>(target, MAX_ATTEMPTS, resend);
+            }
             checkMissionItem(item, i);
         }
         link->send<MISSION_ACK>(target, MAV_MISSION_ACCEPTED, MAV_MISSION_TYPE_MISSION);
@@ -103,8 +158,11 @@ protected:
     }
 
     void clearAll() {
-        link->send<MISSION_CLEAR_ALL>(target, MAV_MISSION_TYPE_ALL);
-        auto ack = link->receive<MISSION_ACK>(target);
+        auto send_clear = [this]() {
+            link->send<MISSION_CLEAR_ALL>(target, MAV_MISSION_TYPE_ALL);
+        };
+        send_clear();
+        auto ack = link->receiveRetrying<MISSION_ACK>(target, MAX_ATTEMPTS, send_clear);
         EXPECT_EQ(ack.type, MAV_MISSION_ACCEPTED);
     }
 };
@@ -158,42 +216,21 @@ TEST_F(Mission, UploadPolygonFence) {
     }
     EXPECT_TRUE(hasCapability(MAV_PROTOCOL_CAPABILITY_MISSION_FENCE)) << "MISSION_FENCE capability not reported";
 
-    link->send<MISSION_COUNT>(target, 4, MAV_MISSION_TYPE_FENCE);
-    auto req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 0);
-
     // send inclusion fence
-    for (int i=0; i<4; i++) {
-        auto c = fenceCoordGen(i);
-        link->send<MISSION_ITEM_INT>(target, i, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_FENCE_POLYGON_VERTEX_INCLUSION, 0, 0,
+    uploadItems(MAV_MISSION_TYPE_FENCE, 4, [this](int seq) {
+        auto c = fenceCoordGen(seq);
+        link->send<MISSION_ITEM_INT>(target, seq, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_FENCE_POLYGON_VERTEX_INCLUSION, 0, 0,
                                      4.f, 1.f, NAN, NAN,
                                      c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_FENCE);
-        if (i<3) {
-            req = link->receive<MISSION_REQUEST_INT>(target);
-            EXPECT_EQ(req.seq, i+1);
-        } else {
-            auto ack = link->receive<MISSION_ACK>(target);
-            EXPECT_EQ(ack.type, MAV_MISSION_ACCEPTED) << "Mission not accepted" << std::endl;
-        }
-    }
+    }, "fence_inclusion_upload");
 
-    link->send<MISSION_COUNT>(target, 4, MAV_MISSION_TYPE_FENCE);
-    req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 0);
     // send exclusion fence
-    for (int i=0; i<4; i++) {
-        auto c = fenceCoordGen(i);
-        link->send<MISSION_ITEM_INT>(target, i, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_FENCE_POLYGON_VERTEX_EXCLUSION, 0, 0,
+    uploadItems(MAV_MISSION_TYPE_FENCE, 4, [this](int seq) {
+        auto c = fenceCoordGen(seq);
+        link->send<MISSION_ITEM_INT>(target, seq, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_FENCE_POLYGON_VERTEX_EXCLUSION, 0, 0,
                                      4.f, 2.f, NAN, NAN,
                                      c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_FENCE);
-        if (i<3) {
-            req = link->receive<MISSION_REQUEST_INT>(target);
-            EXPECT_EQ(req.seq, i+1);
-        } else {
-            auto ack = link->receive<MISSION_ACK>(target);
-            EXPECT_EQ(ack.type, MAV_MISSION_ACCEPTED) << "Fence not accepted" << std::endl;
-        }
-    }
+    }, "fence_exclusion_upload");
 
     clearAll();
 }
@@ -208,19 +245,17 @@ TEST_F(Mission, UploadCircularFence) {
     double latitude = config["home_lat"].as<double>();
     double longitude = config["home_lon"].as<double>();
 
-    link->send<MISSION_COUNT>(target, 2, MAV_MISSION_TYPE_FENCE);
-    auto req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 0);
-    link->send<MISSION_ITEM_INT>(target, 0, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_FENCE_CIRCLE_INCLUSION, 0, 0,
-                                 100.f, 1.f, NAN, NAN,
-                                 latitude, longitude, 0, MAV_MISSION_TYPE_FENCE);
-    req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 1);
-    link->send<MISSION_ITEM_INT>(target, 1, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_FENCE_CIRCLE_EXCLUSION, 0, 0,
-                                 20.f, 1.f, NAN, NAN,
-                                 latitude, longitude, 0, MAV_MISSION_TYPE_FENCE);
-    auto ack = link->receive<MISSION_ACK>(target);
-    EXPECT_EQ(ack.type, MAV_MISSION_ACCEPTED) << "Fence not accepted" << std::endl;
+    uploadItems(MAV_MISSION_TYPE_FENCE, 2, [&](int seq) {
+        if (seq == 0) {
+            link->send<MISSION_ITEM_INT>(target, 0, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_FENCE_CIRCLE_INCLUSION, 0, 0,
+                                         100.f, 1.f, NAN, NAN,
+                                         latitude, longitude, 0, MAV_MISSION_TYPE_FENCE);
+        } else {
+            link->send<MISSION_ITEM_INT>(target, 1, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_FENCE_CIRCLE_EXCLUSION, 0, 0,
+                                         20.f, 1.f, NAN, NAN,
+                                         latitude, longitude, 0, MAV_MISSION_TYPE_FENCE);
+        }
+    }, "fence_upload");
     clearAll();
 }
 
@@ -231,14 +266,11 @@ TEST_F(Mission, UploadRallyPoints) {
     }
     EXPECT_TRUE(hasCapability(MAV_PROTOCOL_CAPABILITY_MISSION_RALLY)) << "MISSION_RALLY capability not reported";
 
-    link->send<MISSION_COUNT>(target, 1, MAV_MISSION_TYPE_RALLY);
-    auto req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 0);
-    auto c = fenceCoordGen(0);
-    link->send<MISSION_ITEM_INT>(target, 0, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_RALLY_POINT, 0, 1,
-                                 NAN, NAN, NAN, NAN, c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_RALLY);
-    auto ack = link->receive<MISSION_ACK>(target);
-    EXPECT_EQ(ack.type, MAV_MISSION_ACCEPTED) << "Rally point not accepted" << std::endl;
+    uploadItems(MAV_MISSION_TYPE_RALLY, 1, [this](int seq) {
+        auto c = fenceCoordGen(seq);
+        link->send<MISSION_ITEM_INT>(target, seq, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_RALLY_POINT, 0, 1,
+                                     NAN, NAN, NAN, NAN, c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_RALLY);
+    }, "rally_upload");
     clearAll();
 }
 
@@ -248,24 +280,13 @@ TEST_F(Mission, UploadTakeoffLoiterMission) {
         GTEST_SKIP();
     }
 
-    link->send<MISSION_COUNT>(target, 2, MAV_MISSION_TYPE_MISSION);
-    auto req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 0);
-    auto c = missionCoordGen(0);
-
-    link->send<MISSION_ITEM_INT>(target, 0, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_TAKEOFF, 0, 1,
+    uploadItems(MAV_MISSION_TYPE_MISSION, 2, [this](int seq) {
+        auto c = missionCoordGen(seq);
+        link->send<MISSION_ITEM_INT>(target, seq, MAV_FRAME_GLOBAL_INT,
+                                     seq == 0 ? MAV_CMD_NAV_TAKEOFF : MAV_CMD_NAV_LOITER_UNLIM, 0, 1,
                                      0.f, 1.f, 0.f, NAN,
                                      c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_MISSION);
-    req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 1);
-
-    c = missionCoordGen(1);
-    link->send<MISSION_ITEM_INT>(target, 1, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_LOITER_UNLIM, 0, 1,
-                                 0.f, 1.f, 0.f, NAN,
-                                 c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_MISSION);
-
-    auto ack = link->receive<MISSION_ACK>(target);
-    EXPECT_EQ(ack.type, MAV_MISSION_ACCEPTED) << "Mission not accepted" << std::endl;
+    });
 }
 
 TEST_F(Mission, UploadTakeoffLandMission) {
@@ -274,24 +295,18 @@ TEST_F(Mission, UploadTakeoffLandMission) {
         GTEST_SKIP();
     }
 
-    link->send<MISSION_COUNT>(target, 2, MAV_MISSION_TYPE_MISSION);
-    auto req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 0);
-    auto c = missionCoordGen(0);
-
-    link->send<MISSION_ITEM_INT>(target, 0, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_TAKEOFF, 0, 1,
-                                 0.f, 1.f, 0.f, NAN,
-                                 c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_MISSION);
-    req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 1);
-
-    c = missionCoordGen(1);
-    link->send<MISSION_ITEM_INT>(target, 1, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_LAND, 0, 1,
-                                 0.f, 0.f, 0.f, NAN,
-                                 c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_MISSION);
-
-    auto ack = link->receive<MISSION_ACK>(target);
-    EXPECT_EQ(ack.type, MAV_MISSION_ACCEPTED) << "Mission not accepted" << std::endl;
+    uploadItems(MAV_MISSION_TYPE_MISSION, 2, [this](int seq) {
+        auto c = missionCoordGen(seq);
+        if (seq == 0) {
+            link->send<MISSION_ITEM_INT>(target, 0, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_TAKEOFF, 0, 1,
+                                         0.f, 1.f, 0.f, NAN,
+                                         c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_MISSION);
+        } else {
+            link->send<MISSION_ITEM_INT>(target, 1, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_LAND, 0, 1,
+                                         0.f, 0.f, 0.f, NAN,
+                                         c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_MISSION);
+        }
+    });
 }
 
 TEST_F(Mission, UploadTakeoffChangeSpeedReturn) {
@@ -300,29 +315,20 @@ TEST_F(Mission, UploadTakeoffChangeSpeedReturn) {
         GTEST_SKIP();
     }
 
-    link->send<MISSION_COUNT>(target, 3, MAV_MISSION_TYPE_MISSION);
-    auto req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 0);
-    auto c = missionCoordGen(0);
-
-    link->send<MISSION_ITEM_INT>(target, 0, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_TAKEOFF, 0, 1,
-                                 0.f, 1.f, 0.f, NAN,
-                                 c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_MISSION);
-    req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 1);
-
-    link->send<MISSION_ITEM_INT>(target, 1, MAV_FRAME_MISSION, MAV_CMD_DO_CHANGE_SPEED, 0, 1,
-                                 1.f, 5.f, -1.f,
-                                 NAN, UINT32_MAX, UINT32_MAX, UINT32_MAX, MAV_MISSION_TYPE_MISSION);
-
-    req = link->receive<MISSION_REQUEST_INT>(target);
-    EXPECT_EQ(req.seq, 2);
-
-    c = missionCoordGen(1);
-    link->send<MISSION_ITEM_INT>(target, 2, MAV_FRAME_MISSION, MAV_CMD_NAV_RETURN_TO_LAUNCH, 0, 1,
-                                 NAN, NAN, NAN, NAN,
-                                 UINT32_MAX, UINT32_MAX, UINT32_MAX, MAV_MISSION_TYPE_MISSION);
-
-    auto ack = link->receive<MISSION_ACK>(target);
-    EXPECT_EQ(ack.type, MAV_MISSION_ACCEPTED) << "Mission not accepted" << std::endl;
+    uploadItems(MAV_MISSION_TYPE_MISSION, 3, [this](int seq) {
+        if (seq == 0) {
+            auto c = missionCoordGen(0);
+            link->send<MISSION_ITEM_INT>(target, 0, MAV_FRAME_GLOBAL_INT, MAV_CMD_NAV_TAKEOFF, 0, 1,
+                                         0.f, 1.f, 0.f, NAN,
+                                         c.latitude, c.longitude, c.altitude, MAV_MISSION_TYPE_MISSION);
+        } else if (seq == 1) {
+            link->send<MISSION_ITEM_INT>(target, 1, MAV_FRAME_MISSION, MAV_CMD_DO_CHANGE_SPEED, 0, 1,
+                                         1.f, 5.f, -1.f,
+                                         NAN, UINT32_MAX, UINT32_MAX, UINT32_MAX, MAV_MISSION_TYPE_MISSION);
+        } else {
+            link->send<MISSION_ITEM_INT>(target, 2, MAV_FRAME_MISSION, MAV_CMD_NAV_RETURN_TO_LAUNCH, 0, 1,
+                                         NAN, NAN, NAN, NAN,
+                                         UINT32_MAX, UINT32_MAX, UINT32_MAX, MAV_MISSION_TYPE_MISSION);
+        }
+    });
 }
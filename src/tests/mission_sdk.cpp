@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "../environment.hpp"
+#include "../protocol_stats.hpp"
 #include <future>
 #include <memory>
 #include <vector>
@@ -9,12 +10,19 @@ using namespace RASATestingSuite;
 class MissionSDK : public ::testing::Test {
 protected:
     const std::shared_ptr<mavsdk::Mission> mission;
+    const std::shared_ptr<PassthroughTester> link;
     const YAML::Node config;
 
     MissionSDK() :
     mission(Environment::getInstance()->getMissionPlugin()),
+    link(Environment::getInstance()->getPassthroughTester()),
     config(Environment::getInstance()->getConfig({"Mission"})) {}
 
+    // MAVSDK repeats items on timeout, every item sent beyond the plan size is a retry
+    static uint64_t itemRetries(uint64_t items_sent, size_t plan_size) {
+        return items_sent > plan_size ? items_sent - plan_size : 0;
+    }
+
 
     mavsdk::Mission::MissionItem makeMissionItem(double latitude_deg, double longitude_deg,
                                                  float relative_altitude_m) {
@@ -47,22 +55,35 @@ TEST_F(MissionSDK, UploadDownloadCompare) {
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
+    if (!mission) {
+        GTEST_SKIP() << "MAVSDK mission plugin not available through a connection agent";
+    }
     const auto plan = assembleMissionPlan();
 
     // -- Upload mission --
     std::promise<mavsdk::Mission::Result> prom{};
     auto fut = prom.get_future();
 
+    ProtocolStats upload_stats("mission_upload", link);
+    const uint64_t items_sent = link->getTxCount(msg_helper<MISSION_ITEM_INT>::ID);
     mission->upload_mission_async(
         plan, [&prom](mavsdk::Mission::Result result) { prom.set_value(result); });
 
     // wait until uploaded
     fut.wait_for(std::chrono::seconds(1));
     const mavsdk::Mission::Result result = fut.get();
+    upload_stats.addRetries(itemRetries(link->getTxCount(msg_helper<MISSION_ITEM_INT>::ID) - items_sent,
+                                        plan.mission_items.size()));
+    upload_stats.finish();
     ASSERT_EQ(result, mavsdk::Mission::Result::Success);
 
     // -- Download mission --
+    ProtocolStats download_stats("mission_download", link);
+    const uint64_t requests_sent = link->getTxCount(msg_helper<MISSION_REQUEST_INT>::ID);
     auto dl_result = mission->download_mission();
+    download_stats.addRetries(itemRetries(link->getTxCount(msg_helper<MISSION_REQUEST_INT>::ID) - requests_sent,
+                                          plan.mission_items.size()));
+    download_stats.finish();
 
     // wait until downloaded
     ASSERT_EQ(dl_result.first, mavsdk::Mission::Result::Success);
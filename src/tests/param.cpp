@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
+#include <set>
 #include "../environment.hpp"
+#include "../param_download.hpp"
 #include "../passthrough_messages.hpp"
+#include "../protocol_stats.hpp"
 
 using namespace RASATestingSuite;
 
@@ -9,17 +12,35 @@ protected:
     const std::shared_ptr<PassthroughTester> link;
     const TestTargetAddress target;
 
+    // attempts per message exchange before giving up on a lossy link
+    static constexpr int MAX_ATTEMPTS = 5;
+
     Params() : 
     link(Environment::getInstance()->getPassthroughTester()),
     target(Environment::getInstance()->getTargetAddress()) {
         link->flushAll();
     }
+
+    /**
+     * Sends a parameter request and waits for the PARAM_VALUE answering it, repeating the
+     * request on timeout. Late answers to earlier requests are dropped first.
+     */
+    mavlink_param_value_t exchange(ProtocolStats &stats, const std::function<void()> &request) {
+        link->flush<PARAM_VALUE>(target);
+        request();
+        return link->receiveRetrying<PARAM_VALUE>(target, MAX_ATTEMPTS, [&]() {
+            stats.addRetry();
+            request();
+        });
+    }
 };
 
 std::string paramIdString(const char* param_id) {
     return std::string(param_id, strnlen(param_id, 16));
 }
 
+CONFIG_KEYS(Params, ParamReadWriteInteger, "param_id", "default_value", "change_value");
+
 TEST_F(Params, ParamReadWriteInteger) {
     auto conf = Environment::getInstance()->getConfig({"Param", "ParamReadWriteInteger"});
     if (!conf || conf["skip"].as<bool>(false)) {
@@ -29,31 +50,38 @@ TEST_F(Params, ParamReadWriteInteger) {
     auto default_value = conf["default_value"].as<int>();
     auto change_value = conf["change_value"].as<int>();
 
+    ProtocolStats stats("param_read_write", link);
+    auto read_param = [&]() {
+        link->send<PARAM_REQUEST_READ>(target, param_id.c_str(), -1);
+    };
+
     // Read current value
-    link->send<PARAM_REQUEST_READ>(target, param_id.c_str(), -1);
-    auto r1 = link->receive<PARAM_VALUE>(target);
+    auto r1 = exchange(stats, read_param);
     EXPECT_EQ(paramIdString(r1.param_id), param_id) << "Returned param ID does not match requested param ID";
     EXPECT_EQ(floatUnpack<int32_t>(r1.param_value), default_value) << "Returned value for param " << param_id << " does not have configured default value";
     EXPECT_EQ(r1.param_type, MAV_PARAM_TYPE_INT32) << "Returned param type is wrong";
 
     // Write new value
-    link->send<PARAM_SET>(target, param_id.c_str(), floatPack(change_value), MAV_PARAM_TYPE_INT32);
-    auto r2 = link->receive<PARAM_VALUE>(target);
+    auto r2 = exchange(stats, [&]() {
+        link->send<PARAM_SET>(target, param_id.c_str(), floatPack(change_value), MAV_PARAM_TYPE_INT32);
+    });
     EXPECT_EQ(paramIdString(r2.param_id), param_id) << "Returned param ID does not match requested param ID";
 
     // Re-read new value
-    link->send<PARAM_REQUEST_READ>(target, param_id.c_str(), -1);
-    auto r3 = link->receive<PARAM_VALUE>(target);
+    auto r3 = exchange(stats, read_param);
     EXPECT_EQ(paramIdString(r3.param_id), param_id) << "Returned param ID does not match requested param ID";
     EXPECT_EQ(floatUnpack<int32_t>(r3.param_value), change_value) << "Returned value for param " << param_id << " is not changed value";
     EXPECT_EQ(r3.param_type, MAV_PARAM_TYPE_INT32) << "Returned param type is wrong";
 
     // Restore default value
-    link->send<PARAM_SET>(target, param_id.c_str(), floatPack(default_value), MAV_PARAM_TYPE_INT32);
-    auto r4 = link->receive<PARAM_VALUE>(target);
+    auto r4 = exchange(stats, [&]() {
+        link->send<PARAM_SET>(target, param_id.c_str(), floatPack(default_value), MAV_PARAM_TYPE_INT32);
+    });
     EXPECT_EQ(paramIdString(r4.param_id), param_id) << "Returned param ID does not match requested param ID";
 }
 
+CONFIG_KEYS(Params, ParamReadWriteFloat, "param_id", "default_value", "change_value");
+
 TEST_F(Params, ParamReadWriteFloat) {
     auto conf = Environment::getInstance()->getConfig({"Param", "ParamReadWriteFloat"});
     if (!conf || conf["skip"].as<bool>(false)) {
@@ -63,56 +91,71 @@ TEST_F(Params, ParamReadWriteFloat) {
     auto default_value = conf["default_value"].as<float>();
     auto change_value = conf["change_value"].as<float>();
 
+    ProtocolStats stats("param_read_write", link);
+    auto read_param = [&]() {
+        link->send<PARAM_REQUEST_READ>(target, param_id.c_str(), -1);
+    };
+
     // Read current value
-    link->send<PARAM_REQUEST_READ>(target, param_id.c_str(), -1);
-    auto r1 = link->receive<PARAM_VALUE>(target);
+    auto r1 = exchange(stats, read_param);
     EXPECT_EQ(paramIdString(r1.param_id), param_id) << "Returned param ID does not match requested param ID";
     EXPECT_EQ(floatUnpack<float>(r1.param_value), default_value) << "Returned value for param " << param_id << " does not have configured default value";
     EXPECT_EQ(r1.param_type, MAV_PARAM_TYPE_REAL32) << "Returned param type is wrong";
 
     // Write new value
-    link->send<PARAM_SET>(target, param_id.c_str(), floatPack(change_value), MAV_PARAM_TYPE_REAL32);
-    auto r2 = link->receive<PARAM_VALUE>(target);
+    auto r2 = exchange(stats, [&]() {
+        link->send<PARAM_SET>(target, param_id.c_str(), floatPack(change_value), MAV_PARAM_TYPE_REAL32);
+    });
     EXPECT_EQ(paramIdString(r2.param_id), param_id) << "Returned param ID does not match requested param ID";
 
     // Re-read new value
-    link->send<PARAM_REQUEST_READ>(target, param_id.c_str(), -1);
-    auto r3 = link->receive<PARAM_VALUE>(target);
+    auto r3 = exchange(stats, read_param);
     EXPECT_EQ(paramIdString(r3.param_id), param_id) << "Returned param ID does not match requested param ID";
     EXPECT_EQ(floatUnpack<float>(r3.param_value), change_value) << "Returned value for param " << param_id << " is not changed value";
     EXPECT_EQ(r3.param_type, MAV_PARAM_TYPE_REAL32) << "Returned param type is wrong";
 
     // Restore default value
-    link->send<PARAM_SET>(target, param_id.c_str(), floatPack(default_value), MAV_PARAM_TYPE_REAL32);
-    auto r4 = link->receive<PARAM_VALUE>(target);
+    auto r4 = exchange(stats, [&]() {
+        link->send<PARAM_SET>(target, param_id.c_str(), floatPack(default_value), MAV_PARAM_TYPE_REAL32);
+    });
     EXPECT_EQ(paramIdString(r4.param_id), param_id) << "Returned param ID does not match requested param ID";
 }
 
+CONFIG_KEYS(Params, ParamListAll, "depth", "max_attempts", "list_timeout_ms", "max_time_s", "min_params_per_s");
+
 TEST_F(Params, ParamListAll) {
     auto conf = Environment::getInstance()->getConfig({"Param", "ParamListAll"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    link->send<PARAM_REQUEST_LIST>(target);
-    int count = 0;
-
-    std::set<std::string> received_param_ids;
-    do {
-        auto r = link->receive<PARAM_VALUE>(target);
-        count = r.param_count;
-        // The _HASH_CHECK param does not count towards the total count
-        if (paramIdString(r.param_id) != "_HASH_CHECK") {
-            received_param_ids.insert(paramIdString(r.param_id));
-        }
-    } while(static_cast<int>(received_param_ids.size()) < count);
+    ProtocolStats stats("param_list", link);
+    ParamDownloader downloader(link, target, conf["depth"].as<int>(ParamDownloader::DEFAULT_DEPTH),
+                               conf["max_attempts"].as<int>(MAX_ATTEMPTS), conf["list_timeout_ms"].as<uint32_t>(0));
+    const ParamDownloadResult result = downloader.download();
+    stats.addRetries(result.retries);
+    stats.finish();
+
+    printf("  %u params in %.3f s (%.1f params/s), stream %.3f s, %zu read by index, %zu duplicates\n",
+           result.param_count, result.total_ms / 1000., result.paramsPerSecond(), result.list_ms / 1000.,
+           result.gap_filled + result.missing.size(), result.duplicates);
+    RecordProperty("param_count", result.param_count);
+    RecordProperty("params_per_s", std::to_string(result.paramsPerSecond()));
+    RecordProperty("param_gap_filled", static_cast<int>(result.gap_filled));
+
+    ASSERT_GT(result.param_count, 0) << "No PARAM_VALUE received";
+    EXPECT_TRUE(result.missing.empty()) << "Did not receive all params, first missing index " << result.missing.front();
+    if (conf["min_params_per_s"]) {
+        EXPECT_GE(result.paramsPerSecond(), conf["min_params_per_s"].as<double>());
+    }
+    if (conf["max_time_s"]) {
+        EXPECT_LE(result.total_ms / 1000., conf["max_time_s"].as<double>());
+    }
 
-    EXPECT_EQ(received_param_ids.size(), count) << "Did not receive all params";
-    // next receive should time out
+    // a late PARAM_VALUE is only okay for a param we already have
+    std::set<std::string> received_param_ids(result.param_ids.begin(), result.param_ids.end());
+    received_param_ids.insert("_HASH_CHECK");
     try {
         while (true) {
-            // we expect this to time out.
-            // if it does not (we receive another param), it is only okay if we already have
-            // that param
             auto extra = link->receive<PARAM_VALUE>(target);
             if (received_param_ids.find(paramIdString(extra.param_id)) == received_param_ids.end()) {
                 FAIL() << "Received more params. Extra param " << paramIdString(extra.param_id);
@@ -120,4 +163,3 @@ TEST_F(Params, ParamListAll) {
         }
     } catch(TimeoutError&) {}
 }
-
@@ -1,6 +1,12 @@
 #include <gtest/gtest.h>
 #include "../environment.hpp"
 #include <sys/time.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
 
 using namespace RASATestingSuite;
 
@@ -13,6 +19,9 @@ inline uint64_t micros() {
 
 class Ping : public ::testing::Test {
 protected:
+    // share of the requested rate a sweep step has to send at to count as sustained
+    static constexpr double MIN_REACHED_RATE = 0.9;
+
     const std::shared_ptr<PassthroughTester> link;
     const TestTargetAddress target;
 
@@ -21,6 +30,97 @@ protected:
           target(Environment::getInstance()->getTargetAddress()) {
         link->flushAll();
     }
+
+    struct PingRun {
+        std::vector<double> rtts_ms;  // sorted
+        size_t sent = 0;
+        double duration_s = 0.;
+
+        double loss() const {
+            return sent > 0 ? 1. - static_cast<double>(rtts_ms.size()) / static_cast<double>(sent) : 0.;
+        }
+
+        double percentile(double p) const {
+            if (rtts_ms.empty()) {
+                return 0.;
+            }
+            return rtts_ms[std::min(rtts_ms.size() - 1, static_cast<size_t>(p * static_cast<double>(rtts_ms.size())))];
+        }
+    };
+
+    /**
+     * Sends count PINGs at rate_hz with at most depth of them unanswered at a time, and matches
+     * the replies of the target by seq and timestamp. A PING unanswered after timeout_ms is lost.
+     */
+    PingRun runPings(size_t count, double rate_hz, size_t depth, uint32_t timeout_ms) {
+        using Clock = std::chrono::steady_clock;
+        struct Outstanding {
+            uint64_t time_usec;
+            Clock::time_point sent;
+        };
+        std::map<uint32_t, Outstanding> outstanding;
+        std::mutex mutex;
+        std::condition_variable replied;
+        PingRun run;
+
+        const int listener = link->addListener([&](const mavlink_message_t &message, Clock::time_point arrival) {
+            if (message.msgid != msg_helper<PING>::ID || message.sysid != target.system_id ||
+                message.compid != target.component_id) {
+                return;
+            }
+            mavlink_ping_t reply;
+            msg_helper<PING>::unpack(&message, &reply);
+            std::scoped_lock lock(mutex);
+            auto found = outstanding.find(reply.seq);
+            if (found == outstanding.end() || found->second.time_usec != reply.time_usec) {
+                return;
+            }
+            run.rtts_ms.push_back(std::chrono::duration<double, std::milli>(arrival - found->second.sent).count());
+            outstanding.erase(found);
+            replied.notify_all();
+        });
+
+        const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1. / rate_hz));
+        const auto timeout = std::chrono::milliseconds(timeout_ms);
+        const auto start = Clock::now();
+        auto next_send = start;
+        std::unique_lock lock(mutex);
+        auto expire = [&]() {
+            for (auto it = outstanding.begin(); it != outstanding.end();) {
+                it = Clock::now() - it->second.sent > timeout ? outstanding.erase(it) : std::next(it);
+            }
+        };
+        while (run.sent < count) {
+            while (Clock::now() < next_send) {
+                replied.wait_until(lock, next_send);
+            }
+            expire();
+            if (outstanding.size() >= depth) {
+                replied.wait_for(lock, timeout, [&]() { return outstanding.size() < depth; });
+                continue;
+            }
+            const uint32_t seq = _next_seq++;
+            const uint64_t time_usec = micros();
+            outstanding[seq] = {time_usec, Clock::now()};
+            lock.unlock();
+            link->send<PING>(time_usec, seq, 0, 0);
+            lock.lock();
+            run.sent++;
+            next_send = std::max(next_send + period, Clock::now() - period);
+        }
+        replied.wait_for(lock, timeout, [&]() { return outstanding.empty(); });
+        run.duration_s = std::chrono::duration<double>(Clock::now() - start).count();
+        lock.unlock();
+
+        link->removeListener(listener);
+        link->flush<PING>(target);
+        std::sort(run.rtts_ms.begin(), run.rtts_ms.end());
+        return run;
+    }
+
+private:
+    // clear of the seqs of the other ping tests and of the RTT probes
+    static inline uint32_t _next_seq = 1000000;
 };
 
 TEST_F(Ping, PingPong) {
@@ -36,3 +136,65 @@ TEST_F(Ping, PingPong) {
     res = link->receive<PING>(target);
     EXPECT_EQ(res.seq, 1);
 }
+
+CONFIG_KEYS(Ping, Benchmark, "count", "depth", "max_loss", "max_p50_rtt_ms", "max_p99_rtt_ms", "min_sustained_rate_hz",
+            "rate_hz", "rtt_inflation", "sweep_count", "sweep_rates", "timeout_ms");
+
+TEST_F(Ping, Benchmark) {
+    auto conf = Environment::getInstance()->getConfig({"Ping", "Benchmark"});
+    if (!conf || conf["skip"].as<bool>(false)) {
+        GTEST_SKIP();
+    }
+    const uint32_t timeout_ms = conf["timeout_ms"].as<uint32_t>(1000);
+    const size_t depth = conf["depth"].as<size_t>(4);
+    const PingRun run = runPings(conf["count"].as<size_t>(200), conf["rate_hz"].as<double>(50.), depth, timeout_ms);
+    ASSERT_FALSE(run.rtts_ms.empty()) << "No ping answered";
+    printf("%zu pings at %.0f Hz, depth %zu: rtt min %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms, loss %.1f%%\n",
+           run.sent, conf["rate_hz"].as<double>(50.), depth, run.rtts_ms.front(), run.percentile(0.5),
+           run.percentile(0.99), run.rtts_ms.back(), run.loss() * 100.);
+    RecordProperty("rtt_p50_ms", std::to_string(run.percentile(0.5)));
+    RecordProperty("rtt_p99_ms", std::to_string(run.percentile(0.99)));
+    RecordProperty("loss", std::to_string(run.loss()));
+    if (conf["max_p50_rtt_ms"]) {
+        EXPECT_LE(run.percentile(0.5), conf["max_p50_rtt_ms"].as<double>());
+    }
+    if (conf["max_p99_rtt_ms"]) {
+        EXPECT_LE(run.percentile(0.99), conf["max_p99_rtt_ms"].as<double>());
+    }
+    EXPECT_LE(run.loss(), conf["max_loss"].as<double>(0.01));
+
+    // the highest rate that is reached with at most depth PINGs outstanding and the round trip
+    // time within rtt_inflation times its median at the lowest rate, without losing more than max_loss
+    const auto sweep_rates = conf["sweep_rates"].as<std::vector<double>>(std::vector<double>{});
+    if (sweep_rates.empty()) {
+        return;
+    }
+    const double inflation = conf["rtt_inflation"].as<double>(2.);
+    const size_t sweep_count = conf["sweep_count"].as<size_t>(100);
+    double baseline_ms = 0.;
+    double sustained_hz = 0.;
+    printf("  %10s %10s %10s %10s %8s\n", "rate Hz", "sent Hz", "p50 ms", "p99 ms", "loss");
+    for (double rate : sweep_rates) {
+        const PingRun step = runPings(sweep_count, rate, depth, timeout_ms);
+        printf("  %10.0f %10.1f %10.2f %10.2f %7.1f%%\n", rate, step.sent / step.duration_s, step.percentile(0.5),
+               step.percentile(0.99), step.loss() * 100.);
+        if (step.rtts_ms.empty()) {
+            break;
+        }
+        if (baseline_ms == 0.) {
+            baseline_ms = step.percentile(0.5);
+        }
+        // the depth limit holds the sending back once the replies are too slow for the rate
+        const bool reached = step.sent / step.duration_s >= MIN_REACHED_RATE * rate;
+        if (!reached || step.percentile(0.5) > inflation * baseline_ms ||
+            step.loss() > conf["max_loss"].as<double>(0.01)) {
+            break;
+        }
+        sustained_hz = rate;
+    }
+    printf("Highest sustained ping rate: %.0f Hz\n", sustained_hz);
+    RecordProperty("sustained_rate_hz", std::to_string(sustained_hz));
+    if (conf["min_sustained_rate_hz"]) {
+        EXPECT_GE(sustained_hz, conf["min_sustained_rate_hz"].as<double>());
+    }
+}
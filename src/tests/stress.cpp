@@ -0,0 +1,296 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../environment.hpp"
+#include "../statistics.hpp"
+using namespace RASATestingSuite;
+
+class Stress : public ::testing::Test {
+protected:
+    using Clock = std::chrono::steady_clock;
+
+    // the requests of the load mix, each answered by one message of the component
+    enum class Request { Ping, ParamRead, RequestMessage, MissionList };
+
+    struct Outstanding {
+        int64_t key;  // what the answer has to match, e.g. the param index
+        Clock::time_point sent;
+    };
+
+    struct StepResult {
+        double rate_hz = 0.;
+        size_t sent = 0;
+        size_t lost = 0;
+        std::vector<double> latencies_ms;  // sorted
+        RunningStats load_percent;
+        RunningStats drop_rate_percent;
+        std::map<std::string, double> stream_rates_hz;
+
+        double loss() const {
+            return sent > 0 ? static_cast<double>(lost) / static_cast<double>(sent) : 0.;
+        }
+
+        double percentile(double p) const {
+            if (latencies_ms.empty()) {
+                return 0.;
+            }
+            return latencies_ms[std::min(latencies_ms.size() - 1,
+                                         static_cast<size_t>(p * static_cast<double>(latencies_ms.size())))];
+        }
+    };
+
+    static constexpr int PARAM_INDEXES = 16;
+
+    const std::shared_ptr<PassthroughTester> link;
+    const TestTargetAddress target;
+
+    std::mutex _mutex;
+    std::map<Request, std::deque<Outstanding>> _outstanding;
+    StepResult* _step = nullptr;
+    std::map<int, size_t> _stream_counts;
+    uint32_t _next_ping_seq = 3000000;
+    int _next_param_index = 0;
+
+    Stress() :
+          link(Environment::getInstance()->getPassthroughTester()),
+          target(Environment::getInstance()->getTargetAddress()) {
+        link->flushAll();
+    }
+
+    ~Stress() override {
+        link->flushAll();
+    }
+
+    static bool requestByName(const std::string &name, Request &request) {
+        static const std::map<std::string, Request> REQUESTS = {
+            {"PING", Request::Ping},
+            {"PARAM_REQUEST_READ", Request::ParamRead},
+            {"REQUEST_MESSAGE", Request::RequestMessage},
+            {"MISSION_REQUEST_LIST", Request::MissionList},
+        };
+        auto found = REQUESTS.find(name);
+        if (found == REQUESTS.end()) {
+            return false;
+        }
+        request = found->second;
+        return true;
+    }
+
+    // called with _mutex held
+    void answered(Request request, int64_t key, Clock::time_point arrival) {
+        auto &queue = _outstanding[request];
+        auto match = std::find_if(queue.begin(), queue.end(), [key](const Outstanding &outstanding) {
+            return outstanding.key == key;
+        });
+        if (match == queue.end() || _step == nullptr) {
+            return;
+        }
+        _step->latencies_ms.push_back(std::chrono::duration<double, std::milli>(arrival - match->sent).count());
+        queue.erase(match);
+    }
+
+    void onMessage(const mavlink_message_t &message, Clock::time_point arrival) {
+        if (message.sysid != target.system_id || message.compid != target.component_id) {
+            return;
+        }
+        std::scoped_lock lock(_mutex);
+        auto stream = _stream_counts.find(static_cast<int>(message.msgid));
+        if (stream != _stream_counts.end()) {
+            stream->second++;
+        }
+        switch (message.msgid) {
+            case msg_helper<PING>::ID: {
+                mavlink_ping_t ping;
+                msg_helper<PING>::unpack(&message, &ping);
+                answered(Request::Ping, ping.seq, arrival);
+                break;
+            }
+            case msg_helper<PARAM_VALUE>::ID: {
+                mavlink_param_value_t value;
+                msg_helper<PARAM_VALUE>::unpack(&message, &value);
+                answered(Request::ParamRead, value.param_index, arrival);
+                break;
+            }
+            case msg_helper<COMMAND_ACK>::ID: {
+                mavlink_command_ack_t ack;
+                msg_helper<COMMAND_ACK>::unpack(&message, &ack);
+                if (ack.command == MAV_CMD_REQUEST_MESSAGE) {
+                    answered(Request::RequestMessage, 0, arrival);
+                }
+                break;
+            }
+            case msg_helper<MISSION_COUNT>::ID:
+                answered(Request::MissionList, 0, arrival);
+                break;
+            case msg_helper<SYS_STATUS>::ID: {
+                mavlink_sys_status_t status;
+                msg_helper<SYS_STATUS>::unpack(&message, &status);
+                if (_step != nullptr) {
+                    _step->load_percent.add(status.load / 10.);
+                    _step->drop_rate_percent.add(status.drop_rate_comm / 100.);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void send(Request request, int requested_message_id) {
+        int64_t key = 0;
+        {
+            std::scoped_lock lock(_mutex);
+            if (request == Request::Ping) {
+                key = _next_ping_seq++;
+            } else if (request == Request::ParamRead) {
+                key = _next_param_index++ % PARAM_INDEXES;
+            }
+            _outstanding[request].push_back({key, Clock::now()});
+        }
+        switch (request) {
+            case Request::Ping:
+                link->send<PING>(micros(), static_cast<uint32_t>(key), 0, 0);
+                break;
+            case Request::ParamRead:
+                link->send<PARAM_REQUEST_READ>(target, "", static_cast<int16_t>(key));
+                break;
+            case Request::RequestMessage:
+                link->send<COMMAND_LONG>(target, MAV_CMD_REQUEST_MESSAGE, 0, static_cast<float>(requested_message_id),
+                                         NAN, NAN, NAN, NAN, NAN, NAN);
+                break;
+            case Request::MissionList:
+                link->send<MISSION_REQUEST_LIST>(target, MAV_MISSION_TYPE_MISSION);
+                break;
+        }
+    }
+
+    // drops the requests unanswered for longer than timeout as lost
+    void expire(std::chrono::milliseconds timeout) {
+        std::scoped_lock lock(_mutex);
+        const auto now = Clock::now();
+        for (auto &queue : _outstanding) {
+            while (!queue.second.empty() && now - queue.second.front().sent > timeout) {
+                queue.second.pop_front();
+                _step->lost++;
+            }
+        }
+    }
+
+    static uint64_t micros() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+};
+
+CONFIG_KEYS(Stress, LoadRamp, "max_load_percent", "max_loss", "max_p99_ms", "min_budget_hz", "mix", "rates",
+            "request_message", "step_duration_s", "streams", "timeout_ms");
+
+TEST_F(Stress, LoadRamp) {
+    auto conf = Environment::getInstance()->getConfig({"Stress", "LoadRamp"});
+    if (!conf || conf["skip"].as<bool>(false)) {
+        GTEST_SKIP();
+    }
+    const auto rates = conf["rates"].as<std::vector<double>>(std::vector<double>{10., 50., 100., 200.});
+    const double step_duration_s = conf["step_duration_s"].as<double>(5.);
+    const auto timeout = std::chrono::milliseconds(conf["timeout_ms"].as<uint32_t>(1000));
+    const int requested_message_id = messageIdByName(conf["request_message"].as<std::string>("PROTOCOL_VERSION"));
+    ASSERT_GE(requested_message_id, 0) << "Unknown request_message";
+
+    // the mix as a repeating sequence, e.g. weights PING: 2, REQUEST_MESSAGE: 1 give PING PING REQUEST_MESSAGE
+    std::vector<Request> mix;
+    for (const auto &entry : conf["mix"]) {
+        Request request;
+        ASSERT_TRUE(requestByName(entry.first.as<std::string>(), request)) << "Unknown request " << entry.first;
+        mix.insert(mix.end(), entry.second.as<size_t>(), request);
+    }
+    if (mix.empty()) {
+        mix = {Request::Ping, Request::Ping, Request::ParamRead, Request::RequestMessage, Request::MissionList};
+    }
+    std::vector<std::string> streams = conf["streams"].as<std::vector<std::string>>(
+            std::vector<std::string>{"ATTITUDE", "GLOBAL_POSITION_INT"});
+    for (const auto &stream : streams) {
+        ASSERT_GE(messageIdByName(stream), 0) << "Unknown stream " << stream;
+    }
+
+    const int listener = link->addListener([this](const mavlink_message_t &message, Clock::time_point arrival) {
+        onMessage(message, arrival);
+    });
+    std::vector<StepResult> steps;
+    size_t next = 0;
+    for (double rate : rates) {
+        StepResult step;
+        step.rate_hz = rate;
+        {
+            std::scoped_lock lock(_mutex);
+            _outstanding.clear();
+            _stream_counts.clear();
+            for (const auto &stream : streams) {
+                _stream_counts[messageIdByName(stream)] = 0;
+            }
+            _step = &step;
+        }
+        const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1. / rate));
+        const auto start = Clock::now();
+        const auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(step_duration_s));
+        for (auto send_time = start; send_time < end; send_time += period) {
+            std::this_thread::sleep_until(send_time);
+            send(mix[next++ % mix.size()], requested_message_id);
+            step.sent++;
+            expire(timeout);
+        }
+        // the answers to the last requests
+        std::this_thread::sleep_for(timeout);
+        expire(std::chrono::milliseconds(0));
+        const double elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+        {
+            std::scoped_lock lock(_mutex);
+            _step = nullptr;
+            for (const auto &stream : streams) {
+                step.stream_rates_hz[stream] = static_cast<double>(_stream_counts[messageIdByName(stream)]) / elapsed_s;
+            }
+        }
+        std::sort(step.latencies_ms.begin(), step.latencies_ms.end());
+        steps.push_back(step);
+        link->flushAll();
+    }
+    link->removeListener(listener);
+
+    printf("  %8s %8s %8s %8s %7s %7s %7s", "req Hz", "p50 ms", "p99 ms", "max ms", "loss", "load", "drop");
+    for (const auto &stream : streams) {
+        printf(" %14s", (stream + " Hz").c_str());
+    }
+    printf("\n");
+    const double max_loss = conf["max_loss"].as<double>(0.01);
+    double budget_hz = 0.;
+    bool saturated = false;
+    for (const auto &step : steps) {
+        printf("  %8.0f %8.1f %8.1f %8.1f %6.1f%% %6.1f%% %6.2f%%", step.rate_hz, step.percentile(0.5),
+               step.percentile(0.99), step.percentile(1.), step.loss() * 100., step.load_percent.max(),
+               step.drop_rate_percent.max());
+        for (const auto &stream : streams) {
+            printf(" %14.1f", step.stream_rates_hz.at(stream));
+        }
+        printf("\n");
+        RecordProperty("p99_ms_at_" + std::to_string(static_cast<int>(step.rate_hz)) + "_hz",
+                       std::to_string(step.percentile(0.99)));
+        saturated = saturated || step.loss() > max_loss ||
+                    (conf["max_p99_ms"] && step.percentile(0.99) > conf["max_p99_ms"].as<double>()) ||
+                    (conf["max_load_percent"] && step.load_percent.max() > conf["max_load_percent"].as<double>());
+        if (!saturated) {
+            budget_hz = step.rate_hz;
+        }
+    }
+    printf("Request budget: %.0f requests/s within %.1f%% loss%s\n", budget_hz, max_loss * 100.,
+           saturated ? "" : " (not saturated by the highest rate)");
+    RecordProperty("request_budget_hz", std::to_string(budget_hz));
+    if (conf["min_budget_hz"]) {
+        EXPECT_GE(budget_hz, conf["min_budget_hz"].as<double>());
+    }
+}
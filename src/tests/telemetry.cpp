@@ -1,15 +1,39 @@
 #include <gtest/gtest.h>
-#include <sys/time.h>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <thread>
 #include "../environment.hpp"
+#include "../column_checks.hpp"
+#include "../observations.hpp"
+#include "../stream_join.hpp"
 using namespace RASATestingSuite;
 
-// Get current timestamp in microseconds
-inline uint64_t micros() {
-    struct timeval t;
-    gettimeofday(&t, nullptr);
-    return t.tv_sec * ((uint64_t)1000000) + t.tv_usec;
-}
+// the rate measurements only observe the vehicle and run concurrently before the tests
+[[maybe_unused]] static const bool rate_observations_registered = []() {
+    addRateObservation<HEARTBEAT>("Telemetry", "HaveHeartbeat", 3);
+    addRateObservation<BATTERY_STATUS>("Telemetry", "HaveBatteryStatus", 2);
+    addRateObservation<SYS_STATUS>("Telemetry", "HaveSysStatus", 2);
+    addRateObservation<EXTENDED_SYS_STATE>("Telemetry", "HaveExtendedSysStatus", 2);
+    addRateObservation<GPS_RAW_INT>("Telemetry", "HaveGPSRaw", 3);
+    addRateObservation<GLOBAL_POSITION_INT>("Telemetry", "HaveGlobalPosition", 3);
+    addRateObservation<ALTITUDE>("Telemetry", "HaveAltitude", 3);
+    addRateObservation<ATTITUDE>("Telemetry", "HaveAttitude", 5);
+    addRateObservation<ESTIMATOR_STATUS>("Telemetry", "HaveEstimatorStatus", 2);
+    addRateObservation<ATTITUDE_QUATERNION>("Telemetry", "HaveAttitudeQuaternion", 5);
+    addRateObservation<ATTITUDE_TARGET>("Telemetry", "HaveAttitudeTarget", 5);
+    addRateObservation<HOME_POSITION>("Telemetry", "HaveHomePosition", 2);
+    addRateObservation<LOCAL_POSITION_NED>("Telemetry", "HaveLocalPosition", 5);
+    addRateObservation<POSITION_TARGET_LOCAL_NED>("Telemetry", "HavePositionTarget", 5);
+    addRateObservation<VFR_HUD>("Telemetry", "HaveVFRHUD", 3);
+    addRateObservation<GIMBAL_DEVICE_ATTITUDE_STATUS>("Telemetry", "HaveGimbalDeviceAttitudeStatus", 3);
+    return true;
+}();
+
 
+// read by checkStream and by the stream provisioning, see TelemetryStreams
+#define RATE_TEST_KEYS "minimal_rate", "component_id", "max_p99_interval_ms", "max_gap_ms", "max_source_jitter_ms", \
+                       "max_link_jitter_ms", "max_duplicates", "max_non_monotonic"
 
 class Telemetry : public ::testing::Test {
 protected:
@@ -26,195 +50,414 @@ protected:
         link->flushAll();
     }
 
-    template<int MSG>
-    double measureRate(int system_id, int component_id, int n_samples) {
-        assert(n_samples > 1);
-        link->flush<MSG>(system_id, component_id);
-        uint64_t last_received = 0;
-        uint64_t total_time = 0;
-        for (int i=0; i<n_samples; i++) {
-            link->template receive<MSG>(system_id, component_id, 5000);
-            uint64_t now = micros();
-            if (last_received != 0) {
-                total_time += (now - last_received);
-            }
-            last_received = now;
-        }
-        if (last_received == 0) {
-            return 0.;
-        }
-        return 1e6 * static_cast<double>(n_samples -1) / static_cast<double>(total_time);
+    // measured concurrently with the other observations, see addRateObservation
+    double observedRate() {
+        const ObservationValues values = Scheduler::getInstance().awaitCurrentTest();
+        printf("95%% confidence interval %.2f .. %.2f Hz from %.0f messages\n", values.at("rate_low"),
+               values.at("rate_high"), values.at("samples"));
+        RecordProperty("rate_hz", std::to_string(values.at("rate")));
+        return values.at("rate");
     }
 
+    double scaledRate(double rate) {
+        double sim_factor = Environment::getInstance()->getSimFactor();
+        return (rate / sim_factor) + RATE_MARGIN;
+    }
+
+    /**
+     * Checks the rate of the stream against minimal_rate, and its regularity against the
+     * optional max_p99_interval_ms and max_gap_ms, which hold for the whole run so far.
+     */
     template<int MSG>
-    double measureRate(int n_samples) {
-        return measureRate<MSG>(target.system_id, target.component_id, n_samples);
+    void checkStream(const YAML::Node &conf) {
+        double freq = observedRate();
+        printf("%s interval %.2f Hz\n", msg_helper<MSG>::NAME, freq);
+        EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+
+        const int component_id = conf["component_id"].as<int>(target.component_id);
+        const IntervalStats intervals = link->getIntervalStats<MSG>(target.system_id, component_id);
+        // measured in host time, the limits are in vehicle time
+        const double sim_factor = Environment::getInstance()->getSimFactor();
+        const double p99_ms = intervals.histogram_ms.percentile(0.99) * sim_factor;
+        const double max_gap_ms = intervals.max_gap_ms * sim_factor;
+        printf("Intervals: p50 %.1f ms, p99 %.1f ms, max %.1f ms from %lu intervals\n",
+               intervals.histogram_ms.percentile(0.5) * sim_factor, p99_ms, max_gap_ms,
+               static_cast<unsigned long>(intervals.histogram_ms.count()));
+        intervals.histogram_ms.print("ms");
+        RecordProperty("p99_interval_ms", std::to_string(p99_ms));
+        RecordProperty("max_gap_ms", std::to_string(max_gap_ms));
+        if (conf["max_p99_interval_ms"]) {
+            EXPECT_LE(p99_ms, conf["max_p99_interval_ms"].as<double>()) << "Irregular " << msg_helper<MSG>::NAME;
+        }
+        if (conf["max_gap_ms"]) {
+            EXPECT_LE(max_gap_ms, conf["max_gap_ms"].as<double>()) << "Gap in " << msg_helper<MSG>::NAME;
+        }
+        checkSourceTiming(link->getSourceTiming<MSG>(target.system_id, component_id), conf);
     }
 
-    double scaledRate(double rate) {
-        double sim_factor = config["sim_factor"].as<double>();
-        return (rate / sim_factor) + RATE_MARGIN;
+    /**
+     * Tells the publication jitter of the autopilot (spread of the source timestamp intervals)
+     * apart from the jitter the link adds, for streams with a source timestamp.
+     */
+    void checkSourceTiming(const SourceTiming &timing, const YAML::Node &conf) {
+        if (timing.samples == 0) {
+            return;
+        }
+        printf("Source timestamps: interval %.2f ms +- %.2f ms, link jitter +- %.2f ms, %lu duplicates, "
+               "%lu non-monotonic of %lu\n", timing.source_interval_ms.mean(), timing.source_interval_ms.stddev(),
+               timing.link_jitter_ms.stddev(), static_cast<unsigned long>(timing.duplicates),
+               static_cast<unsigned long>(timing.non_monotonic), static_cast<unsigned long>(timing.samples));
+        RecordProperty("source_jitter_ms", std::to_string(timing.source_interval_ms.stddev()));
+        RecordProperty("link_jitter_ms", std::to_string(timing.link_jitter_ms.stddev()));
+        RecordProperty("duplicates", std::to_string(timing.duplicates));
+        RecordProperty("non_monotonic", std::to_string(timing.non_monotonic));
+        if (conf["max_source_jitter_ms"]) {
+            EXPECT_LE(timing.source_interval_ms.stddev(), conf["max_source_jitter_ms"].as<double>())
+                    << "Publication jitter";
+        }
+        if (conf["max_link_jitter_ms"]) {
+            EXPECT_LE(timing.link_jitter_ms.stddev(), conf["max_link_jitter_ms"].as<double>()) << "Link jitter";
+        }
+        if (conf["max_duplicates"]) {
+            EXPECT_LE(timing.duplicates, conf["max_duplicates"].as<uint64_t>()) << "Duplicated samples";
+        }
+        if (conf["max_non_monotonic"]) {
+            EXPECT_LE(timing.non_monotonic, conf["max_non_monotonic"].as<uint64_t>()) << "Source time going backwards";
+        }
     }
 
 };
 
+CONFIG_KEYS(Telemetry, HaveHeartbeat, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveHeartbeat) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveHeartbeat"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    double freq = measureRate<HEARTBEAT>(3);
-    printf("HEARTBEAT interval %.2f Hz", freq);
-    EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<HEARTBEAT>(conf);
 }
 
 
+CONFIG_KEYS(Telemetry, HaveBatteryStatus, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveBatteryStatus) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveBatteryStatus"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    double freq = measureRate<BATTERY_STATUS>(2);
-    printf("BATTERY_STATUS interval %.2f Hz", freq);
-    EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<BATTERY_STATUS>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveSysStatus, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveSysStatus) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveSysStatus"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    double freq = measureRate<SYS_STATUS>(2);
-    printf("SYS_STATUS interval %.2f Hz\n", freq);
-    EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<SYS_STATUS>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveExtendedSysStatus, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveExtendedSysStatus) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveExtendedSysStatus"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    double freq = measureRate<EXTENDED_SYS_STATE>(2);
-    printf("EXTENDED_SYS_STATE interval %.2f Hz\n", freq);
-    EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<EXTENDED_SYS_STATE>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveGPSRaw, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveGPSRaw) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveGPSRaw"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    double freq = measureRate<GPS_RAW_INT>(3);
-    printf("GPS_RAW_INT interval %.2f Hz\n", freq);
-    EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<GPS_RAW_INT>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveGlobalPosition, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveGlobalPosition) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveGlobalPosition"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    double freq = measureRate<GLOBAL_POSITION_INT>(3);
-    printf("GLOBAL_POSITION_INT interval %.2f Hz\n", freq);
-    EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<GLOBAL_POSITION_INT>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveAltitude, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveAltitude) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveAltitude"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    double freq = measureRate<ALTITUDE>(3);
-    printf("ALTITUDE interval %.2f Hz\n", freq);
-    EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<ALTITUDE>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveAttitude, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveAttitude) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveAttitude"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    double freq = measureRate<ATTITUDE>(5);
-    printf("ATTITUDE interval %.2f Hz\n", freq);
-    EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<ATTITUDE>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveEstimatorStatus, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveEstimatorStatus) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveEstimatorStatus"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    double freq = measureRate<ESTIMATOR_STATUS>(2);
-    printf("ESTIMATOR_STATUS interval %.2f Hz\n", freq);
-    EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<ESTIMATOR_STATUS>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveAttitudeQuaternion, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveAttitudeQuaternion) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveAttitudeQuaternion"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-   double freq = measureRate<ATTITUDE_QUATERNION>(5);
-   printf("ATTITUDE_QUATERNION interval %.2f Hz\n", freq);
-   EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<ATTITUDE_QUATERNION>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveAttitudeTarget, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveAttitudeTarget) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveAttitudeTarget"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-   double freq = measureRate<ATTITUDE_TARGET>(5);
-   printf("ATTITUDE_TARGET interval %.2f Hz\n", freq);
-   EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<ATTITUDE_TARGET>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveHomePosition, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveHomePosition) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveHomePosition"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-   double freq = measureRate<HOME_POSITION>(2);
-   printf("HOME_POSITION interval %.2f Hz\n", freq);
-   EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<HOME_POSITION>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveLocalPosition, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveLocalPosition) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveLocalPosition"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-   double freq = measureRate<LOCAL_POSITION_NED>(5);
-   printf("LOCAL_POSITION_NED interval %.2f Hz\n", freq);
-   EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<LOCAL_POSITION_NED>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HavePositionTarget, RATE_TEST_KEYS);
 TEST_F(Telemetry, HavePositionTarget) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HavePositionTarget"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-   double freq = measureRate<POSITION_TARGET_LOCAL_NED>(5);
-   printf("POSITION_TARGET_LOCAL_NED interval %.2f Hz\n", freq);
-   EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<POSITION_TARGET_LOCAL_NED>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveVFRHUD, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveVFRHUD) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveVFRHUD"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-   double freq = measureRate<VFR_HUD>(3);
-   printf("VFR_HUD interval %.2f Hz\n", freq);
-   EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<VFR_HUD>(conf);
 }
 
+CONFIG_KEYS(Telemetry, HaveGimbalDeviceAttitudeStatus, RATE_TEST_KEYS);
 TEST_F(Telemetry, HaveGimbalDeviceAttitudeStatus) {
     auto conf = Environment::getInstance()->getConfig({"Telemetry", "HaveGimbalDeviceAttitudeStatus"});
     if (!conf || conf["skip"].as<bool>(false)) {
         GTEST_SKIP();
     }
-    double freq = measureRate<GIMBAL_DEVICE_ATTITUDE_STATUS>(target.system_id, 154, 3);
-    printf("GIMBAL_DEVICE_ATTITUDE_STATUS interval %.2f Hz\n", freq);
-    EXPECT_GT(scaledRate(freq), conf["minimal_rate"].as<double>());
+    checkStream<GIMBAL_DEVICE_ATTITUDE_STATUS>(conf);
+}
+
+CONFIG_KEYS(Telemetry, MaxAge, "duration_s", "streams");
+
+TEST_F(Telemetry, MaxAge) {
+    auto conf = Environment::getInstance()->getConfig({"Telemetry", "MaxAge"});
+    if (!conf || conf["skip"].as<bool>(false)) {
+        GTEST_SKIP();
+    }
+    // the messages with a timestamp on the vehicle clock
+    static const std::map<std::string, uint32_t> STAMPED_MESSAGES = {
+        {"ATTITUDE", ATTITUDE},
+        {"ATTITUDE_QUATERNION", ATTITUDE_QUATERNION},
+        {"ATTITUDE_TARGET", ATTITUDE_TARGET},
+        {"GLOBAL_POSITION_INT", GLOBAL_POSITION_INT},
+        {"LOCAL_POSITION_NED", LOCAL_POSITION_NED},
+        {"POSITION_TARGET_LOCAL_NED", POSITION_TARGET_LOCAL_NED},
+        {"ALTITUDE", ALTITUDE},
+        {"ESTIMATOR_STATUS", ESTIMATOR_STATUS},
+        {"GIMBAL_DEVICE_ATTITUDE_STATUS", GIMBAL_DEVICE_ATTITUDE_STATUS},
+    };
+
+    const ClockSync &clock = link->getClockSync();
+    const auto sync_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!clock.valid() && std::chrono::steady_clock::now() < sync_deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    ASSERT_TRUE(clock.valid()) << "No TIMESYNC replies, the age needs the vehicle clock offset";
+
+    link->resetMessageAges();
+    std::this_thread::sleep_for(std::chrono::duration<double>(conf["duration_s"].as<double>(5.)));
+
+    for (const auto &stream : conf["streams"]) {
+        const std::string name = stream.first.as<std::string>();
+        auto id = STAMPED_MESSAGES.find(name);
+        if (id == STAMPED_MESSAGES.end()) {
+            ADD_FAILURE() << name << " has no timestamp on the vehicle clock";
+            continue;
+        }
+        const int component_id = stream.second["component_id"].as<int>(target.component_id);
+        const MessageAge age = link->getMessageAge(id->second, target.system_id, component_id);
+        if (age.stats_ms.count() == 0) {
+            ADD_FAILURE() << "No " << name << " received";
+            continue;
+        }
+        const double p50_ms = age.histogram_ms.percentile(0.5);
+        const double p99_ms = age.histogram_ms.percentile(0.99);
+        printf("%s age: p50 %.1f ms, p99 %.1f ms, max %.1f ms from %lu messages\n", name.c_str(), p50_ms, p99_ms,
+               age.stats_ms.max(), static_cast<unsigned long>(age.stats_ms.count()));
+        RecordProperty(name + "_age_p50_ms", std::to_string(p50_ms));
+        RecordProperty(name + "_age_p99_ms", std::to_string(p99_ms));
+        if (stream.second["max_p50_ms"]) {
+            EXPECT_LE(p50_ms, stream.second["max_p50_ms"].as<double>()) << name << " median age";
+        }
+        if (stream.second["max_p99_ms"]) {
+            EXPECT_LE(p99_ms, stream.second["max_p99_ms"].as<double>()) << name << " 99th percentile age";
+        }
+    }
+}
+
+namespace {
+
+// roll, pitch and yaw of a quaternion
+void quaternionToEuler(double w, double x, double y, double z, double &roll, double &pitch, double &yaw) {
+    roll = std::atan2(2. * (w * x + y * z), 1. - 2. * (x * x + y * y));
+    pitch = std::asin(std::clamp(2. * (w * y - z * x), -1., 1.));
+    yaw = std::atan2(2. * (w * z + x * y), 1. - 2. * (y * y + z * z));
+}
+
+double angleDifferenceDeg(double a, double b) {
+    return std::abs(std::remainder(a - b, 2. * M_PI)) * 180. / M_PI;
+}
+
+}
+
+CONFIG_KEYS(Telemetry, StreamConsistency, "duration_s", "max_altitude_error_m", "max_attitude_error_deg",
+            "max_quaternion_norm_error", "max_tracking_error_m");
+
+TEST_F(Telemetry, StreamConsistency) {
+    auto conf = Environment::getInstance()->getConfig({"Telemetry", "StreamConsistency"});
+    if (!conf || conf["skip"].as<bool>(false)) {
+        GTEST_SKIP();
+    }
+    StreamJoinEngine engine(link, target);
+
+    engine.add(std::make_unique<StreamJoin<ATTITUDE, ATTITUDE_QUATERNION>>(
+            "ATTITUDE vs ATTITUDE_QUATERNION", "deg", conf["max_attitude_error_deg"].as<double>(1.),
+            JoinAlignment::SourceTime, std::chrono::milliseconds(5),
+            [](const mavlink_attitude_t &euler, const mavlink_attitude_quaternion_t &quaternion) {
+        double roll = 0., pitch = 0., yaw = 0.;
+        quaternionToEuler(quaternion.q1, quaternion.q2, quaternion.q3, quaternion.q4, roll, pitch, yaw);
+        return std::max({angleDifferenceDeg(euler.roll, roll), angleDifferenceDeg(euler.pitch, pitch),
+                         angleDifferenceDeg(euler.yaw, yaw)});
+    }));
+    engine.add(std::make_unique<SampleCheck<ATTITUDE_QUATERNION>>(
+            "ATTITUDE_QUATERNION norm - 1", "", conf["max_quaternion_norm_error"].as<double>(1e-3),
+            [](const mavlink_attitude_quaternion_t &quaternion) {
+        return std::sqrt(quaternion.q1 * quaternion.q1 + quaternion.q2 * quaternion.q2 +
+                         quaternion.q3 * quaternion.q3 + quaternion.q4 * quaternion.q4) - 1.;
+    }));
+    engine.add(std::make_unique<StreamJoin<GLOBAL_POSITION_INT, ALTITUDE>>(
+            "GLOBAL_POSITION_INT vs ALTITUDE amsl", "m", conf["max_altitude_error_m"].as<double>(1.),
+            JoinAlignment::SourceTime, std::chrono::milliseconds(20),
+            [](const mavlink_global_position_int_t &position, const mavlink_altitude_t &altitude) {
+        return position.alt / 1000. - altitude.altitude_amsl;
+    }));
+    engine.add(std::make_unique<StreamJoin<GLOBAL_POSITION_INT, ALTITUDE>>(
+            "GLOBAL_POSITION_INT vs ALTITUDE relative", "m", conf["max_altitude_error_m"].as<double>(1.),
+            JoinAlignment::SourceTime, std::chrono::milliseconds(20),
+            [](const mavlink_global_position_int_t &position, const mavlink_altitude_t &altitude) {
+        return position.relative_alt / 1000. - altitude.altitude_relative;
+    }));
+    // VFR_HUD has no timestamp and pairs by arrival
+    engine.add(std::make_unique<StreamJoin<GLOBAL_POSITION_INT, VFR_HUD>>(
+            "GLOBAL_POSITION_INT vs VFR_HUD", "m", conf["max_altitude_error_m"].as<double>(1.),
+            JoinAlignment::Arrival, std::chrono::milliseconds(50),
+            [](const mavlink_global_position_int_t &position, const mavlink_vfr_hud_t &hud) {
+        return position.alt / 1000. - hud.alt;
+    }));
+    engine.add(std::make_unique<StreamJoin<LOCAL_POSITION_NED, POSITION_TARGET_LOCAL_NED>>(
+            "LOCAL_POSITION_NED vs setpoint", "m", conf["max_tracking_error_m"].as<double>(10.),
+            JoinAlignment::SourceTime, std::chrono::milliseconds(50),
+            [](const mavlink_local_position_ned_t &position, const mavlink_position_target_local_ned_t &setpoint) {
+        // no position setpoint outside of position control
+        if ((setpoint.type_mask & 0x7) != 0 || std::isnan(setpoint.x) || std::isnan(setpoint.z)) {
+            return static_cast<double>(NAN);
+        }
+        return std::sqrt(std::pow(position.x - setpoint.x, 2) + std::pow(position.y - setpoint.y, 2) +
+                         std::pow(position.z - setpoint.z, 2));
+    }));
+
+    engine.start();
+    std::this_thread::sleep_for(std::chrono::duration<double>(conf["duration_s"].as<double>(10.)));
+    engine.stop();
+
+    const auto results = engine.results();
+    StreamJoinEngine::print(results);
+    for (const auto &result : results) {
+        if (result.residual.count() == 0) {
+            printf("%s: not checked, the streams are missing or never aligned\n", result.name.c_str());
+            continue;
+        }
+        RecordProperty(result.name + " worst", std::to_string(result.worst));
+        EXPECT_EQ(result.violations, 0u) << result.name << " diverged " << result.violations << " times, first after "
+                                         << result.first_violation_s << " s, worst " << result.worst << " "
+                                         << result.unit;
+    }
+}
+
+CONFIG_KEYS(Telemetry, CaptureValidation, "duration_s", "max_samples", "messages");
+
+TEST_F(Telemetry, CaptureValidation) {
+    auto conf = Environment::getInstance()->getConfig({"Telemetry", "CaptureValidation"});
+    if (!conf || conf["skip"].as<bool>(false)) {
+        GTEST_SKIP();
+    }
+    CaptureStore store(link, target, conf["max_samples"].as<size_t>(100000));
+    try {
+        for (const auto &message : conf["messages"]) {
+            store.capture(message.first.as<std::string>());
+        }
+    } catch (std::invalid_argument &e) {
+        FAIL() << e.what();
+    }
+    store.start();
+    std::this_thread::sleep_for(std::chrono::duration<double>(conf["duration_s"].as<double>(10.)));
+    store.stop();
+
+    for (const auto &message : conf["messages"]) {
+        const std::string name = message.first.as<std::string>();
+        const CapturedStream stream = store.stream(name);
+        if (stream.size() == 0) {
+            ADD_FAILURE() << "No " << name << " captured";
+            continue;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        const auto results = ColumnChecks::run(stream, message.second);
+        const double validation_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("%s: %zu samples, %zu checks in %.2f ms\n", name.c_str(), stream.size(), results.size(), validation_ms);
+        for (const auto &result : results) {
+            if (result.violations == 0) {
+                continue;
+            }
+            printf("  %s %s: %zu of %zu failed, first at sample %zu (%g)\n", result.field.c_str(),
+                   result.check.c_str(), result.violations, result.checked, result.first_index, result.first_value);
+            ADD_FAILURE() << name << "." << result.field << " " << result.check << ": " << result.violations
+                          << " of " << result.checked << " samples";
+        }
+    }
 }
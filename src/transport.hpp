@@ -0,0 +1,123 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <mavsdk/mavsdk.h>
+#include <mavsdk/plugins/mavlink_passthrough/mavlink_passthrough.h>
+
+namespace RASATestingSuite {
+
+struct PerLinkStats {
+    uint64_t rx_messages = 0;
+    uint64_t rx_bytes = 0;
+    uint64_t tx_messages = 0;
+    uint64_t first = 0;       // messages delivered from this link
+    uint64_t duplicates = 0;  // messages that arrived earlier on another link
+    uint64_t lost = 0;        // estimated from sequence number gaps
+    double lag_sum_ms = 0.;   // behind the first copy, summed over the duplicates
+    double lag_max_ms = 0.;
+    double seconds = 0.;      // since the links were opened
+};
+
+/**
+ * The link the PassthroughTester sends and receives raw MAVLink messages on.
+ */
+class Transport {
+public:
+    using MessageCallback = std::function<void(mavlink_message_t&)>;
+    using TimedMessageCallback = std::function<void(mavlink_message_t&, std::chrono::steady_clock::time_point)>;
+
+    virtual ~Transport() = default;
+
+    virtual void send(mavlink_message_t &message) = 0;
+
+    virtual uint8_t ourSystemId() const = 0;
+
+    virtual uint8_t ourComponentId() const = 0;
+
+    // called for every received message, nullptr unsubscribes
+    virtual void subscribeIncoming(MessageCallback callback) = 0;
+
+    // as subscribeIncoming, with the arrival time of the message, which is taken on delivery unless
+    // the transport knows when the message arrived on the link
+    virtual void subscribeIncomingTimed(TimedMessageCallback callback) {
+        if (!callback) {
+            subscribeIncoming(nullptr);
+            return;
+        }
+        subscribeIncoming([callback](mavlink_message_t &message) {
+            callback(message, std::chrono::steady_clock::now());
+        });
+    }
+
+    // called for every message sent on the link, also by other users of the link in this process
+    virtual void subscribeOutgoing(MessageCallback callback) = 0;
+
+    // transports over several links to the same vehicle can send on a specific one
+    virtual size_t linkCount() const {
+        return 1;
+    }
+
+    virtual void sendVia(size_t link, mavlink_message_t &message) {
+        if (link != 0) {
+            throw std::out_of_range("No link " + std::to_string(link));
+        }
+        send(message);
+    }
+
+    // statistics per link, empty for a single link
+    virtual std::vector<PerLinkStats> linkStats() {
+        return {};
+    }
+};
+
+/**
+ * Transport over a MAVSDK connection owned by this process.
+ */
+class MavsdkTransport : public Transport {
+private:
+    std::shared_ptr<mavsdk::MavlinkPassthrough> _passthrough;
+
+public:
+    MavsdkTransport(std::shared_ptr<mavsdk::MavlinkPassthrough> passthrough) :
+          _passthrough(std::move(passthrough)) {}
+
+    void send(mavlink_message_t &message) override {
+        _passthrough->send_message(message);
+    }
+
+    uint8_t ourSystemId() const override {
+        return _passthrough->get_our_sysid();
+    }
+
+    uint8_t ourComponentId() const override {
+        return _passthrough->get_our_compid();
+    }
+
+    void subscribeIncoming(MessageCallback callback) override {
+        if (!callback) {
+            _passthrough->intercept_incoming_messages_async(nullptr);
+            return;
+        }
+        _passthrough->intercept_incoming_messages_async([callback](mavlink_message_t &message) {
+            callback(message);
+            return true;
+        });
+    }
+
+    void subscribeOutgoing(MessageCallback callback) override {
+        if (!callback) {
+            _passthrough->intercept_outgoing_messages_async(nullptr);
+            return;
+        }
+        _passthrough->intercept_outgoing_messages_async([callback](mavlink_message_t &message) {
+            callback(message);
+            return true;
+        });
+    }
+};
+
+};